@@ -21,6 +21,7 @@ htif_isasim_t::htif_isasim_t(sim_t* _sim, const std::vector<std::string>& args)
   : htif_pthread_t(args), sim(_sim), reset(true), seqno(1), checkpoint(NULL)
 {
     checkpointing_active = false;
+    dump_replay = false;
 }
 
 htif_isasim_t::~htif_isasim_t()
@@ -86,11 +87,7 @@ void htif_isasim_t::tick_once()
         buf[i] = sim->debug_mmu->load_uint64((hdr.addr+i)*HTIF_DATA_ALIGN);
 
       if(checkpointing_active){
-        *checkpoint << "READ_MEM" << " " << hdr.addr << " " << hdr.data_size << std::endl;
-        for (size_t i = 0; i < hdr.data_size; i++){
-          *checkpoint << buf[i] << " ";
-        }
-        *checkpoint << std::endl;
+        record_mem(READ_MEM, hdr.addr, hdr.data_size, buf);
       }
 
       send(buf, hdr.data_size * sizeof(buf[0]));
@@ -105,11 +102,7 @@ void htif_isasim_t::tick_once()
         sim->debug_mmu->store_uint64((hdr.addr+i)*HTIF_DATA_ALIGN, buf[i]);
 
       if(checkpointing_active){
-        *checkpoint << "WRITE_MEM" << " " << hdr.addr << " " << hdr.data_size << std::endl;
-        for (size_t i = 0; i < hdr.data_size; i++){
-          *checkpoint << buf[i] << " ";
-        }
-        *checkpoint << std::endl;
+        record_mem(WRITE_MEM, hdr.addr, hdr.data_size, buf);
       }
 
       packet_header_t ack(HTIF_CMD_ACK, seqno, 0, 0);
@@ -134,7 +127,7 @@ void htif_isasim_t::tick_once()
       {
         uint64_t scr = sim->get_scr(regno);
         if(checkpointing_active){
-          *checkpoint << "MOD_SCR " << coreid << " " << regno << " " << scr << " " << scr << std::endl;
+          record_scr(coreid, regno, scr, scr);
         }
         send(&scr, sizeof(scr));
         break;
@@ -181,7 +174,7 @@ void htif_isasim_t::tick_once()
       // Print TOHOST content only when something significant happens)
       if((regno != (CSR_TOHOST & 0x1f)) || ((old_val != 0) || (old_val != new_val))){
         if(checkpointing_active){
-          *checkpoint << "MOD_SCR " << coreid << " " << regno << " " << old_val << " " << new_val << std::endl;
+          record_scr(coreid, regno, old_val, new_val);
         }
       }
       send(&old_val, sizeof(old_val));
@@ -245,8 +238,65 @@ bool htif_isasim_t::restore_checkpoint(std::istream& restore)
   // If reset is low (normal operation) tick only once to complete a single pending transaction
   //do tick_once(); while (reset);
 
-  FILE* restore_log = fopen("restore.htif","w");
+  FILE* restore_log = (dump_replay ? fopen("restore.htif","w") : NULL);
+
+  // A binary log starts with HTIF_CHECKPOINT_MAGIC ("HTIF..."), a text log with a command name.
+  if (restore.peek() == (HTIF_CHECKPOINT_MAGIC & 0xff))
+    restore_binary(restore, restore_log);
+  else
+    restore_text(restore, restore_log);
+
+  if (restore_log)
+    fclose(restore_log);
+
+  return true;
+
+}
+
+void htif_isasim_t::restore_binary(std::istream& restore, FILE* restore_log)
+{
+  uint64_t magic;
+  uint64_t header;
+  replay_pkt_t pkt;
+
+  restore.read((char*)&magic, sizeof(magic));
+  assert(magic == HTIF_CHECKPOINT_MAGIC);
+
+  while (restore.read((char*)&header, sizeof(header)))
+  {
+    pkt.command = (restore_cmd_t)(header & 0xff);
+    uint64_t words = (header >> 8);
+    switch (pkt.command)
+    {
+      case READ_MEM:
+      case WRITE_MEM:
+        assert((words >= 2) && (words <= (2 + HTIF_MAX_DATA_SIZE)));
+        restore.read((char*)&pkt.addr, sizeof(pkt.addr));
+        restore.read((char*)&pkt.data_size, sizeof(pkt.data_size));
+        assert(pkt.data_size == (words - 2));
+        restore.read((char*)pkt.data, (pkt.data_size * sizeof(pkt.data[0])));
+        break;
+      case MOD_SCR:
+        assert(words == 4);
+        restore.read((char*)&pkt.coreid, sizeof(pkt.coreid));
+        restore.read((char*)&pkt.regno, sizeof(pkt.regno));
+        restore.read((char*)&pkt.old_regval, sizeof(pkt.old_regval));
+        restore.read((char*)&pkt.new_regval, sizeof(pkt.new_regval));
+        break;
+      case END_CHECKPOINT:
+        assert(words == 0);
+        break;
+      default:
+        abort();
+    }
+    replay(&pkt, restore_log);
+    if (pkt.command == END_CHECKPOINT)
+      break;
+  }
+}
 
+void htif_isasim_t::restore_text(std::istream& restore, FILE* restore_log)
+{
   std::string token1;
   reg_t token2, token3;
   replay_pkt_t pkt;
@@ -254,21 +304,18 @@ bool htif_isasim_t::restore_checkpoint(std::istream& restore)
   while(restore.good())
   {
     restore >> token1 >> token2 >> token3;
-    fprintf(restore_log,"Reading line: %s %ld %ld\n",token1.c_str(),token2,token3);
-    if(!token1.compare("READ_MEM"))
+    if(!token1.compare("READ_MEM") || !token1.compare("WRITE_MEM"))
     {
-
-      fprintf(restore_log,"In READ_MEM\n");
       // Create the data packet
-      pkt.command = READ_MEM;
+      pkt.command = (!token1.compare("READ_MEM") ? READ_MEM : WRITE_MEM);
       pkt.addr = token2;
       pkt.data_size = token3;
+      assert(pkt.data_size <= HTIF_MAX_DATA_SIZE);
       for(unsigned int i=0; i < token3; i++)
         restore >> pkt.data[i];
     } 
     else if(!token1.compare("MOD_SCR"))
     {
-      fprintf(restore_log,"In MOD_SCR\n");
       // Update packet with SCR values
       pkt.command = MOD_SCR;
       pkt.coreid = token2;
@@ -279,12 +326,11 @@ bool htif_isasim_t::restore_checkpoint(std::istream& restore)
     else if(!token1.compare("END_HTIF_CHECKPOINT"))
     {
       // HTIF checkpoint restore complete
-      //fprintf(stderr,"Done restoring HTIF state\n");
       //Read in the rest of the line so that correct token is read in the next iteration
       std::string dummy_line;
       std::getline(restore,dummy_line); 
-      // Must tick to maintain the sequence of HTIF operations
-      tick_once();
+      pkt.command = END_CHECKPOINT;
+      replay(&pkt, restore_log);
       break;
     }
     else
@@ -296,27 +342,79 @@ bool htif_isasim_t::restore_checkpoint(std::istream& restore)
       tick_once();
       continue;
     }
-    // Setup the system state and the tick HTIF once
-    setup_replay_state(&pkt);
-    tick_once();
+    replay(&pkt, restore_log);
   }
+}
 
-  fclose(restore_log);
+// Replay one transaction of the checkpoint log: set up the system state that the host
+// will observe, and tick HTIF to complete the host's next transaction.
+void htif_isasim_t::replay(replay_pkt_t* pkt, FILE* restore_log)
+{
+  if (restore_log)
+  {
+    switch (pkt->command)
+    {
+      case READ_MEM:
+      case WRITE_MEM:
+        fprintf(restore_log, "%s %" PRIu64 " %" PRIu64 "\n", ((pkt->command == READ_MEM) ? "READ_MEM" : "WRITE_MEM"), pkt->addr, pkt->data_size);
+        for (size_t i = 0; i < pkt->data_size; i++)
+          fprintf(restore_log, "%" PRIu64 " ", pkt->data[i]);
+        fprintf(restore_log, "\n");
+        break;
+      case MOD_SCR:
+        fprintf(restore_log, "MOD_SCR %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", pkt->coreid, pkt->regno, pkt->old_regval, pkt->new_regval);
+        break;
+      case END_CHECKPOINT:
+        fprintf(restore_log, "END_HTIF_CHECKPOINT 0 0 0\n");
+        break;
+    }
+  }
 
-  return true;
+  switch (pkt->command)
+  {
+    case READ_MEM:
+    case MOD_SCR:
+      setup_replay_state(pkt);
+      tick_once();
+      break;
+    case WRITE_MEM:
+      // The original text log replay took a WRITE_MEM record's two lines (command, data)
+      // for two unrecognized lines, and ticked once for each.  Both formats still do.
+      tick_once();
+      tick_once();
+      break;
+    case END_CHECKPOINT:
+      tick_once();
+      break;
+  }
+}
+
+void htif_isasim_t::record_mem(restore_cmd_t command, reg_t addr, reg_t data_size, const uint64_t* data)
+{
+  uint64_t header[3] = {(command | ((2 + data_size) << 8)), addr, data_size};
+  checkpoint->write((const char*)header, sizeof(header));
+  checkpoint->write((const char*)data, (data_size * sizeof(data[0])));
+}
 
+void htif_isasim_t::record_scr(reg_t coreid, reg_t regno, reg_t old_regval, reg_t new_regval)
+{
+  uint64_t record[5] = {(MOD_SCR | (4 << 8)), coreid, regno, old_regval, new_regval};
+  checkpoint->write((const char*)record, sizeof(record));
 }
 
 void htif_isasim_t::start_checkpointing(std::ostream& checkpoint_file)
 {
   checkpointing_active = true;
   this->checkpoint = &checkpoint_file;
+  uint64_t magic = HTIF_CHECKPOINT_MAGIC;
+  checkpoint->write((const char*)&magic, sizeof(magic));
 }
 
 void htif_isasim_t::stop_checkpointing()
 {
   if(checkpointing_active){
-   *checkpoint << "END_HTIF_CHECKPOINT 0 0 0" << std::endl;
+    uint64_t record = END_CHECKPOINT;
+    checkpoint->write((const char*)&record, sizeof(record));
   }
 
   checkpointing_active = false;
@@ -10,7 +10,18 @@
 class sim_t;
 struct packet;
 
-typedef enum {READ_MEM, MOD_SCR} restore_cmd_t;
+typedef enum {READ_MEM, MOD_SCR, WRITE_MEM, END_CHECKPOINT} restore_cmd_t;
+
+// HTIF checkpoint log.
+// It is binary: HTIF_CHECKPOINT_MAGIC, then one record per transaction.  A record is a
+// header word, (command | (number of payload words << 8)), followed by its payload words:
+//   READ_MEM, WRITE_MEM: addr, data_size, data[data_size]
+//   MOD_SCR:             coreid, regno, old value, new value
+//   END_CHECKPOINT:      (none)
+// Older checkpoints have a text log (one token per word); restore_checkpoint() reads either.
+// Restoring can dump the replayed transactions, in the text format, to restore.htif.
+#define HTIF_CHECKPOINT_MAGIC	0x314e494246495448ULL	// "HTIFBIN1"
+#define HTIF_MAX_DATA_SIZE	256
 
 typedef struct replay_pkt
 {
@@ -18,7 +29,7 @@ typedef struct replay_pkt
   restore_cmd_t command;
   reg_t addr;
   reg_t data_size;
-  reg_t data[256];
+  reg_t data[HTIF_MAX_DATA_SIZE];
   reg_t coreid;
   reg_t regno;
   reg_t old_regval;
@@ -27,7 +38,7 @@ typedef struct replay_pkt
   void dump()
   {
     fprintf(stderr,"command: %s addr: %ld data_size: %ld coreid: %ld regno: %ld old_regval: %ld\n",
-                    command == READ_MEM ? "READ_MEM" : "MOD_SCR", 
+                    command == READ_MEM ? "READ_MEM" : (command == WRITE_MEM ? "WRITE_MEM" : "MOD_SCR"),
                     addr, data_size, coreid, regno, old_regval);
   };
 } replay_pkt_t;
@@ -48,6 +59,8 @@ public:
   bool restore_checkpoint(std::istream& restore);
   void start_checkpointing(std::ostream& checkpoint_file);
   void stop_checkpointing();
+  // Dump the transactions replayed by restore_checkpoint() to restore.htif, as text.
+  void set_dump_replay(bool dump) { dump_replay = dump; }
 
 private:
   sim_t* sim;
@@ -55,6 +68,13 @@ private:
   uint8_t seqno;
   void setup_replay_state(replay_pkt_t*);
   bool checkpointing_active;
+  bool dump_replay;
+
+  void record_mem(restore_cmd_t command, reg_t addr, reg_t data_size, const uint64_t* data);
+  void record_scr(reg_t coreid, reg_t regno, reg_t old_regval, reg_t new_regval);
+  void restore_binary(std::istream& restore, FILE* restore_log);
+  void restore_text(std::istream& restore, FILE* restore_log);
+  void replay(replay_pkt_t* pkt, FILE* restore_log);
 
   //std::fstream* checkpoint;
   std::ostream* checkpoint;
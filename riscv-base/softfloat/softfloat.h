@@ -53,7 +53,7 @@ enum {
 /*----------------------------------------------------------------------------
 | Software floating-point rounding mode.
 *----------------------------------------------------------------------------*/
-extern int_fast8_t softfloat_roundingMode;
+extern __thread int_fast8_t softfloat_roundingMode;
 enum {
     softfloat_round_nearest_even   = 0,
     softfloat_round_minMag         = 1,
@@ -65,7 +65,7 @@ enum {
 /*----------------------------------------------------------------------------
 | Software floating-point exception flags.
 *----------------------------------------------------------------------------*/
-extern int_fast8_t softfloat_exceptionFlags;
+extern __thread int_fast8_t softfloat_exceptionFlags;
 enum {
     softfloat_flag_inexact   =  1,
     softfloat_flag_underflow =  2,
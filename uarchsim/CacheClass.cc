@@ -33,7 +33,8 @@ CacheClass::CacheClass(int sets, int assoc, int _lineSize,
     missLatency(_missLatency),
 	  numMHSR(_numMHSR),
 	  numMissSrvPorts(_numMissSrvPorts),
-	  missSrvLatency(_missSrvLatency)
+	  missSrvLatency(_missSrvLatency),
+	  prefetching(false)
 	  /*------------------------------------------------------------------------*\
 	   | Constructor.  Allocates data structures and initializes D-cache state.
 	   |
@@ -78,28 +79,27 @@ CacheClass::CacheClass(int sets, int assoc, int _lineSize,
 
   assert(stats);
 
-#if 0
-  stats->register_counter((identifier+"_load_count").c_str()        ,identifier.c_str());
-  stats->register_counter((identifier+"_store_count").c_str()       ,identifier.c_str());
-  stats->register_counter((identifier+"_load_hit_count").c_str()    ,identifier.c_str());
-  stats->register_counter((identifier+"_store_hit_count").c_str()   ,identifier.c_str());
-  stats->register_counter((identifier+"_load_miss_count").c_str()   ,identifier.c_str());
-  stats->register_counter((identifier+"_store_miss_count").c_str()  ,identifier.c_str());
-  stats->register_counter((identifier+"_read_access_count").c_str() ,identifier.c_str());
-  stats->register_counter((identifier+"_write_access_count").c_str(),identifier.c_str());
+  // Resolve the per-cache counters once, so Access() only has to bump
+  // a handle instead of building and looking up a name every time.
+  load_count_ctr         = register_cache_counter("_load_count");
+  store_count_ctr        = register_cache_counter("_store_count");
+  load_hit_count_ctr     = register_cache_counter("_load_hit_count");
+  store_hit_count_ctr    = register_cache_counter("_store_hit_count");
+  load_miss_count_ctr    = register_cache_counter("_load_miss_count");
+  store_miss_count_ctr   = register_cache_counter("_store_miss_count");
+  read_access_count_ctr  = register_cache_counter("_read_access_count");
+  write_access_count_ctr = register_cache_counter("_write_access_count");
 
+}
+
+counter_handle_t CacheClass::register_cache_counter(const char* suffix)
+{
+  std::string name = identifier + suffix;
+  counter_handle_t ctr = stats->register_counter(name.c_str(), identifier.c_str());
   if(verbose_phase_counters){
-    stats->register_phase_counter((identifier+"_load_count").c_str()        ,identifier.c_str());
-    stats->register_phase_counter((identifier+"_store_count").c_str()       ,identifier.c_str());
-    stats->register_phase_counter((identifier+"_load_hit_count").c_str()    ,identifier.c_str());
-    stats->register_phase_counter((identifier+"_store_hit_count").c_str()   ,identifier.c_str());
-    stats->register_phase_counter((identifier+"_load_miss_count").c_str()   ,identifier.c_str());
-    stats->register_phase_counter((identifier+"_store_miss_count").c_str()  ,identifier.c_str());
-    stats->register_phase_counter((identifier+"_read_access_count").c_str() ,identifier.c_str());
-    stats->register_phase_counter((identifier+"_write_access_count").c_str(),identifier.c_str());
+    stats->register_phase_counter(name.c_str(), identifier.c_str());
   }
-#endif
-
+  return ctr;
 }
 
 void CacheClass::flush()
@@ -107,6 +107,34 @@ void CacheClass::flush()
 	array.flush();
 }
 
+void CacheClass::save_state(std::ostream& out)
+{
+	out.write((const char*)&lineSize, sizeof(lineSize));
+	array.save(out);
+}
+
+bool CacheClass::restore_state(std::istream& in)
+{
+	int saved_lineSize;
+	int i;
+
+	in.read((char*)&saved_lineSize, sizeof(saved_lineSize));
+	if (!in || (saved_lineSize != lineSize) || !array.restore(in)) {
+		flush();
+		return(false);
+	}
+
+	for (i=0; i < (int)(array.size * array.assoc); i++)
+		array.line(i).mhsr = -1;
+	for (i=0; i<numMHSR; i++) {
+		mhsr[i].resolved = 0;
+		mhsr[i].busy = false;
+	}
+	for (i=0; i<numMissSrvPorts; i++)
+		missPortAvail[i] = 0;
+	return(true);
+}
+
 CacheClass::~CacheClass()
 /*------------------------------------------------------------------------*\
  | Destructor.  Frees memory used by D-cache.
@@ -144,7 +172,8 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 	reg_t lineAddr;
 	reg_t oldAddr;
 	CacheLineClass* line;
-	CacheLineClass* newLine;
+	CacheLineClass victim;
+	bool victimValid;
 	int busyMHSR;
 	int newMHSR;
 	int newPort;
@@ -159,7 +188,7 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 	assert((Tid < 4) && (lineSize >= 2));
 	lineAddr = ((addr >> lineSize) | (Tid << 30));
 
-	line = array.lookup(lineAddr, NULL, &hit, &oldAddr, false);
+	line = array.lookup(lineAddr, &hit, &oldAddr, false);
 
 	if (probe) {
 		(*isHit) = hit;
@@ -167,9 +196,9 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 	}
 
   if(isStore){
-    inc_counter_str((identifier+"_store_count").c_str());
-  } else {
-    inc_counter_str((identifier+"_load_count").c_str());
+    stats->update_counter(store_count_ctr);
+  } else if (!prefetching) {
+    stats->update_counter(load_count_ctr);
   }
   // Line has been allocated in cache.
 	if (hit) {
@@ -209,11 +238,11 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 			//lineInArray = curCycle + hitLatency;
 			lineInArray = curCycle;
       if(isStore){
-        inc_counter_str((identifier+"_store_hit_count").c_str());
-        inc_counter_str((identifier+"_write_access_count").c_str());
+        stats->update_counter(store_hit_count_ctr);
+        stats->update_counter(write_access_count_ctr);
       } else {
-        inc_counter_str((identifier+"_load_hit_count").c_str());
-        inc_counter_str((identifier+"_read_access_count").c_str());
+        stats->update_counter(load_hit_count_ctr);
+        stats->update_counter(read_access_count_ctr);
       }
 		}
 	}
@@ -221,9 +250,9 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 	else {
 
     if(isStore){
-      inc_counter_str((identifier+"_store_miss_count").c_str());
-    } else {
-      inc_counter_str((identifier+"_load_miss_count").c_str());
+      stats->update_counter(store_miss_count_ctr);
+    } else if (!prefetching) {
+      stats->update_counter(load_miss_count_ctr);
     }
 
 		// Allocate MHSR to handle cache miss.
@@ -239,16 +268,15 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 		// Find the miss port to use for handling the miss.
 		newPort = FindNextPort(curCycle, &portAvail);
 
-		// Allocate a new cache line structure.
+		// Replace the old line in the cache. The line state lives in
+		// the array, so save the victim's state before overwriting it.
+		victimValid = false;
 		if (commit) {
-			// Allocate a new cache line structure.
-			newLine = new CacheLineClass;
-			assert(newLine);
-			newLine -> mhsr = newMHSR;
-			newLine -> dirty = isStore;
-
-			// Replace the old line in the cache.
-			line = array.lookup(lineAddr, newLine, &hit, &oldAddr, true);
+			line = array.lookup(lineAddr, &hit, &oldAddr, true);
+			victimValid = CacheArray::valid(oldAddr);
+			victim = *line;
+			line->mhsr = newMHSR;
+			line->dirty = isStore;
 		}
 
 		// Compute the time to load the new line from the next memory level.
@@ -262,8 +290,8 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 		}
 
 		// See if line being replaced is itself still being loaded.
-		if (commit && (line !=NULL)) {
-			busyMHSR = line->mhsr;
+		if (commit && victimValid) {
+			busyMHSR = victim.mhsr;
 			if (busyMHSR != -1) {
 				// Line being replaced is being loaded.  Must wait until this
 				//  line has been loaded to replace it.
@@ -276,8 +304,8 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 			}
 
 			// See if line is dirty.  Line must be written back, if dirty.
-			if (line->dirty) {
-        inc_counter_str((identifier+"_read_access_count").c_str());
+			if (victim.dirty) {
+        stats->update_counter(read_access_count_ctr);
         if(nextLevel == NULL){
 				  lineInArray = lineInArray + missLatency;
         } else {
@@ -315,18 +343,15 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
       assert(lineInArray > curCycle);
     }
 
-		// Free old cache line, allocate miss port and MHSR.
+		// Allocate MHSR.
 		// NOTE: Slight simulation approximation error here.
 		//       MHSR is being allocated this cycle, but in reality, can not
 		//       be allocated until hitLat cycles later, when miss is
 		//       known.
-		if (commit && line) {
-			delete line;
-		}
 		mhsr[newMHSR].resolved = lineInArray;
 		mhsr[newMHSR].busy = true;
 		mhsr[newMHSR].lineAddress = lineAddr;
-    inc_counter_str((identifier+"_write_access_count").c_str());
+    stats->update_counter(write_access_count_ctr);
 	}
 
 	if (isHit!=NULL) {
@@ -338,6 +363,36 @@ cycle_t CacheClass::Access(unsigned int Tid /* ER 11/16/02 */,
 	return(lineInArray + hitLatency);
 }
 
+bool CacheClass::Prefetch(unsigned int Tid, cycle_t curCycle, reg_t addr)
+{
+	bool hit;
+	reg_t lineAddr;
+	reg_t oldAddr;
+	int freeMHSR;
+	int i;
+
+	assert((Tid < 4) && (lineSize >= 2));
+	lineAddr = ((addr >> lineSize) | (Tid << 30));
+
+	array.lookup(lineAddr, &hit, &oldAddr, false);
+	if (hit)
+		return(false);
+
+	// Leave at least one MHSR for demand misses.
+	freeMHSR = 0;
+	for (i=0; i<numMHSR; i++) {
+		if (!mhsr[i].busy || (mhsr[i].resolved < curCycle))
+			freeMHSR++;
+	}
+	if (freeMHSR < 2)
+		return(false);
+
+	prefetching = true;
+	Access(Tid, curCycle, addr, false);
+	prefetching = false;
+	return(true);
+}
+
 void CacheClass::set_nextLevel(CacheClass* nLevel){
 	nextLevel = nLevel;
 }
@@ -356,7 +411,7 @@ int CacheClass::FindFreeMHSR(cycle_t curCycle)
 		}
 		if (mhsr[i].resolved < curCycle) {
 			// MHSR is finished.  Free it.
-			line = array.lookup(mhsr[i].lineAddress, NULL, &hit, &oldAddr, false);
+			line = array.lookup(mhsr[i].lineAddress, &hit, &oldAddr, false);
 			if (hit) {
 				if (line->mhsr == i) {
 					line->mhsr = -1;
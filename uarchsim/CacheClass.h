@@ -20,14 +20,16 @@
  |  Backing store port reuse latency
  |
  | Fixed cache parameters:
- |  Replacement policy (LRU)
+ |  Replacement policy (LRU, see CacheArray)
  |  Write policy (Write Back)
  |  Number of cache ports (unlimited)
 \*--------------------------------------------------------------------------*/
 #include "decode.h"
 #include "cache.h"
 #include "histogram.h"
+#include "stats.h"
 #include <string.h>
+#include <iostream>
 
 /*--------------------------------------------------------------------------*\
  | Miss Handleing Status Register provides multiple outstanding reads and
@@ -46,7 +48,7 @@ public:
 class CacheLineClass {
 public:
 	int mhsr;   /* Index of MHSR that is loading this line.        */
-	bool mhsrValid; /* -1 indicates that the line is not being loaded. */
+	            /* -1 indicates that the line is not being loaded. */
 	bool dirty; /* Indicates the line is dirty.                    */
 };
 
@@ -109,9 +111,30 @@ public:
 	 |  registers.
 	\*------------------------------------------------------------------------*/
 
+	bool Prefetch(unsigned int Tid, cycle_t curCycle, reg_t addr);
+	/*------------------------------------------------------------------------*\
+	 | Prefetch the line holding addr, if it is not in the cache.  The
+	 |  prefetch is dropped unless it leaves an MHSR free for a demand miss.
+	 |  It is not counted as a load.
+	 |
+	 | Returns true if the prefetch was issued.
+	\*------------------------------------------------------------------------*/
+
 	bool Probe(unsigned int Tid,cycle_t curCycle, reg_t addr1, unsigned int length);
 	HistogramClass* accessLatency;
 	void set_nextLevel(CacheClass* nLevel);
+
+	/*------------------------------------------------------------------------*\
+	 | Save/restore the cache's contents (tags, dirty bits, replacement
+	 |  state) as a checkpoint's warm state.  Misses in flight are not saved:
+	 |  restored lines are not being loaded by any MHSR, and all MHSRs and
+	 |  miss ports are free.
+	 |
+	 | restore_state() returns false, and leaves the cache empty, if the
+	 |  saved cache has a different geometry.
+	\*------------------------------------------------------------------------*/
+	void save_state(std::ostream& out);
+	bool restore_state(std::istream& in);
 private:
 
   pipeline_t* proc;
@@ -129,12 +152,24 @@ private:
                               *  Currently these ports are used for write-
                               *  backs as well.                              */
 	int         numMHSR;         /* The number of MHSRs.                         */
+	bool        prefetching;     /* Access() is issuing a prefetch.              */
 	MHSRClass*  mhsr;           /* The miss handling status registers.          */
 	int         numMissSrvPorts;       /* Number of miss ports available.              */
 	cycle_t     missSrvLatency;    /* Pipeline reuse latency for miss ports.       */
 
   stats_t* stats;
 
+  // Handles of this cache's counters, resolved at construction.
+  counter_handle_t register_cache_counter(const char* suffix);
+  counter_handle_t load_count_ctr;
+  counter_handle_t store_count_ctr;
+  counter_handle_t load_hit_count_ctr;
+  counter_handle_t store_hit_count_ctr;
+  counter_handle_t load_miss_count_ctr;
+  counter_handle_t store_miss_count_ctr;
+  counter_handle_t read_access_count_ctr;
+  counter_handle_t write_access_count_ctr;
+
 };
 
 #endif //DCACHE_H
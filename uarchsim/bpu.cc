@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <math.h>
+#include <iostream>
 #include "bpu.h"
 #include "parameters.h"
 
@@ -19,7 +21,8 @@ bpu_t::bpu_t(uint64_t instr_per_cycle,				// "n"
 	      cb_index(cb_pc_length, cb_bhr_length),		// construct gshare index function of conditional branch (cb) predictor
               ib_index(ib_pc_length, ib_bhr_length),		// construct gshare index function of indirect branch (ib) predictor
               ras(ras_size),					// construct return address stack (ras)
-	      bq(bq_size) {					// construct branch queue (bq)
+	      bq(bq_size),					// construct branch queue (bq)
+	      rfb_index(cb_pc_length, cb_bhr_length) {		// construct committed-path history for the retire-time fill unit
    // Memory-allocate the conditional branch (cb) prediction table and indirect branch (ib) prediction table.
    cb = new uint64_t[cb_index.table_size()];
    ib = new uint64_t[ib_index.table_size()];
@@ -30,6 +33,44 @@ bpu_t::bpu_t(uint64_t instr_per_cycle,				// "n"
    // The btb output array is statically size-constrained.
    assert(instr_per_cycle <= MAX_BTB_BANKS);
 
+   // Memory-allocate the branch-bias table (branch promotion).
+   bias_entries = BIAS_TABLE_ENTRIES;
+   assert(IsPow2(bias_entries));
+   bias = new bias_entry_t[bias_entries];
+   for (uint64_t i = 0; i < bias_entries; i++) {
+      bias[i].tag = 0;
+      bias[i].taken = false;
+      bias[i].count = 0;
+   }
+
+   // Memory-allocate the next-trace predictor.
+   ntp_entries = NTP_ENTRIES;
+   ntp = NULL;
+   if (ntp_entries) {
+      assert(IsPow2(ntp_entries));
+      ntp = new ntp_entry_t[ntp_entries];
+      for (uint64_t i = 0; i < ntp_entries; i++) {
+         ntp[i].tag = 0;
+         ntp[i].dirs = 0;
+         ntp[i].count = 0;
+         ntp[i].conf = 0;
+      }
+   }
+   ntp_hist = 0;
+   ntp_hist_predict = 0;
+   ntp_commit_hist = 0;
+
+   // Memory-allocate the fetch target queue.
+   ftq_size = FTQ_SIZE;
+   ftq = NULL;
+   if (ftq_size)
+      ftq = new ftq_entry_t[ftq_size];
+   ftq_head = 0;
+   ftq_length = 0;
+   ftq_pc = 0;
+   ftq_pc_valid = false;
+   ftq_fetched = 0;
+
    // Initialize measurements.
 
    meas_branch_n = 0;	// # branches
@@ -43,8 +84,24 @@ bpu_t::bpu_t(uint64_t instr_per_cycle,				// "n"
    meas_jumpind_m = 0;	// # mispredicted jumps, indirect
    meas_callind_m = 0;	// # mispredicted calls, indirect
    meas_jumpret_m = 0;	// # mispredicted jumps, return
+
+   meas_promoted_n = 0;		// # promoted branches
+   meas_promoted_m = 0;		// # promoted branches that faulted
+   meas_promoted_reject = 0;	// # trace cache hits rejected due to a demoted branch
+
+   meas_ntp_bundles = 0;	// # fetch bundles predicted
+   meas_ntp_used = 0;		// # fetch bundles predicted by the NTP
+   meas_ntp_n = 0;		// # committed conditional branches predicted by the NTP
+   meas_ntp_m = 0;		// # of them mispredicted
+   meas_ftq_pushed = 0;		// # fetch bundles predicted into the FTQ
+   meas_ftq_squashed = 0;	// # of them discarded before being fetched
+   meas_ftq_ahead = 0;		// FTQ occupancy behind fetched bundles
+   meas_ftq_prefetch = 0;	// # fetch bundles handed out for prefetching
    tc_hit_cnt = 0;
    tc_diff_bun = 0;
+   rfb_length = 0;
+   rfb_discard = 0;
+   delay = 0;
 }
 
 bpu_t::~bpu_t() {
@@ -64,7 +121,132 @@ bpu_t::~bpu_t() {
 //    5. Bit vector of branches within the fetch bundle (branch_vector).
 //    6. Bit vector of conditional branch predictions within the fetch bundle (pred_vector).
 //    7. Predicted next PC (next_pc).
-uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_t &fetch_bundle_length, uint64_t &branch_vector, uint64_t &pred_vector, uint64_t &next_pc) {
+//    8. On a trace cache hit, the trace's instructions and their decode-stage fields (tc_data), if available.
+uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_t &fetch_bundle_length, uint64_t &branch_vector, uint64_t &pred_vector, uint64_t &next_pc, tcm_data_t* &tc_data) {
+   if (ftq_size == 0)
+      return(predict_bundle(pc, pred_tags, tc_hit, fetch_bundle_length, branch_vector, pred_vector, next_pc, tc_data));
+
+   // The fetch stage is not where the FTQ expected it to be: discard the queued fetch bundles.
+   if (ftq_length && (ftq[ftq_head].pc != pc))
+      ftq_squash();
+
+   // The BPU has not run ahead yet (e.g., the FTQ just drained): predict the fetch bundle now.
+   if (ftq_length == 0) {
+      ftq_pc = pc;
+      ftq_pc_valid = true;
+      ftq_push();
+   }
+
+   // Hand out the head entry.
+   ftq_entry_t &e = ftq[ftq_head];
+   assert(e.pc == pc);
+   for (uint64_t i = 0; i < MAX_BTB_BANKS; i++)
+      pred_tags[i] = e.pred_tags[i];
+   tc_hit = e.tc_hit;
+   fetch_bundle_length = e.fetch_bundle_length;
+   branch_vector = e.branch_vector;
+   pred_vector = e.pred_vector;
+   next_pc = e.next_pc;
+   delay = e.delay;
+   tc_data = (e.data_valid ? &e.data : NULL);
+
+   // The fetch bundle's line fill buffer inputs, and its checkpoint in case of a BTB miss.
+   lfb = e.lfb;
+   ntp_hist_predict = e.ntp_hist;
+   ftq_fetched = ftq_head;
+
+   ftq_head++;
+   if (ftq_head == ftq_size)
+      ftq_head = 0;
+   ftq_length--;
+   meas_ftq_ahead += ftq_length;
+
+   return(e.fetch_pred_tag);
+}
+
+
+// Predict the fetch bundle starting at "ftq_pc" into the tail of the FTQ, and continue with its next pc.
+void bpu_t::ftq_push() {
+   assert(ftq_pc_valid && (ftq_length < ftq_size));
+   ftq_entry_t &e = ftq[(ftq_head + ftq_length) % ftq_size];
+   tcm_data_t *tc_data;
+
+   e.pc = ftq_pc;
+   e.cb_bhr = cb_index.get_bhr();
+   e.ib_bhr = ib_index.get_bhr();
+   e.ras_tos = ras.get_tos();
+   e.ntp_hist = ntp_hist;
+   for (uint64_t i = 0; i < MAX_BTB_BANKS; i++)
+      e.pred_tags[i] = 0;
+   e.fetch_pred_tag = predict_bundle(ftq_pc, e.pred_tags, e.tc_hit, e.fetch_bundle_length, e.branch_vector, e.pred_vector, e.next_pc, tc_data);
+   e.delay = delay;
+   e.data_valid = (tc_data != NULL);
+   if (tc_data)
+      e.data = *tc_data;
+   e.lfb = lfb;
+   e.prefetched = false;
+
+   ftq_length++;
+   ftq_pc = e.next_pc;
+   meas_ftq_pushed++;
+}
+
+
+// Discard all queued fetch bundles: roll-back the branch queue and restore the head's checkpoint.
+void bpu_t::ftq_squash() {
+   if (ftq_length == 0)
+      return;
+
+   ftq_entry_t &e = ftq[ftq_head];
+   bq.rollback((e.fetch_pred_tag >> 1), ((e.fetch_pred_tag & 1) == 1), false);
+   cb_index.set_bhr(e.cb_bhr);
+   ib_index.set_bhr(e.ib_bhr);
+   ras.set_tos(e.ras_tos);
+   ntp_hist = e.ntp_hist;
+
+   meas_ftq_squashed += ftq_length;
+   ftq_length = 0;
+}
+
+
+// Predict one more fetch bundle into the FTQ, if there is room for it and for its branches.
+// Room for another fetch bundle's branches is left in the branch queue, for the fetch stage's own prediction when the FTQ is empty.
+void bpu_t::run_ahead() {
+   if (ftq_size && ftq_pc_valid && (ftq_length < ftq_size) && (bq.space() >= (instr_per_cycle << 1)))
+      ftq_push();
+}
+
+
+// Get the start pc of the oldest queued fetch bundle whose I$ lines have not been prefetched.
+bool bpu_t::ftq_prefetch(uint64_t &pc) {
+   for (uint64_t i = 0; i < ftq_length; i++) {
+      ftq_entry_t &e = ftq[(ftq_head + i) % ftq_size];
+      if (!e.prefetched) {
+         e.prefetched = true;
+         pc = e.pc;
+         meas_ftq_prefetch++;
+         return(true);
+      }
+   }
+   return(false);
+}
+
+
+bool bpu_t::ftq_busy() {
+   if (ftq_size == 0)
+      return(false);
+   if (ftq_pc_valid && (ftq_length < ftq_size) && (bq.space() >= (instr_per_cycle << 1)))
+      return(true);
+   for (uint64_t i = 0; i < ftq_length; i++) {
+      if (!ftq[(ftq_head + i) % ftq_size].prefetched)
+         return(true);
+   }
+   return(false);
+}
+
+
+// Predict the fetch bundle starting at "pc" (see predict()), without going through the FTQ.
+uint64_t bpu_t::predict_bundle(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_t &fetch_bundle_length, uint64_t &branch_vector, uint64_t &pred_vector, uint64_t &next_pc, tcm_data_t* &tc_data) {
    ///////////////////////////////////////////////////////////////////////////////////////////////////////////
    // Preliminary step #1:
    // Before pushing the predicted fetch bundle onto the branch queue, we need to record where the
@@ -109,10 +291,34 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
    uint64_t tcm_fetch_bundle_length;
    btb_output_t tcm_fetch_bundle[MAX_BTB_BANKS];  // TCM's output for the fetch bundle.
    uint64_t tcm_next_pc;
+   tcm_data_t *tcm_data;
+   uint64_t tcm_promoted_mask;			  // TCM's promoted conditional branches in the fetch bundle (bit per slot)
+   uint64_t tcm_promoted_taken;			  // and their fixed directions
+   uint64_t promoted_mask = 0;
+   uint64_t promoted_taken = 0;
 
-   // Get "m" predictions from the conditional branch predictor.
+   // Get "m" predictions.
    // "m" two-bit counters are packed into a uint64_t.
-   cb_predictions = cb[cb_index.index(pc)];
+   // A confident next-trace predictor supplies the directions of the whole fetch bundle in one lookup;
+   // the conditional branch predictor supplies the rest (all of them, if the NTP is off or not confident).
+   uint64_t ntp_count = 0;	// # directions supplied by the NTP
+   ntp_hist_predict = ntp_hist;
+   meas_ntp_bundles++;
+   if (ntp_entries) {
+      ntp_entry_t &e = ntp[ntp_index(ntp_hist, pc)];
+      if ((e.tag == pc) && (e.conf >= 2))
+         ntp_count = e.count;
+      if (ntp_count) {
+         meas_ntp_used++;
+         cb_predictions = 0;
+         for (uint64_t k = 0; k < ntp_count; k++)
+            cb_predictions |= ((uint64_t)(((e.dirs >> k) & 1) ? 3 : 0) << (k << 1));
+         if (ntp_count < cond_branch_per_cycle)
+            cb_predictions |= ((cb[cb_index.index(pc)] >> (ntp_count << 1)) << (ntp_count << 1));
+      }
+   }
+   if (ntp_count == 0)
+      cb_predictions = cb[cb_index.index(pc)];
 
    // Get a predicted target from the indirect branch predictor.  It is only used if the fetch bundle ends at a jump indirect or call indirect.
    ib_predicted_target = ib[ib_index.index(pc)];
@@ -124,7 +330,8 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
    // 1. Its length (fetch_bundle_length, an output of this function).
    // 2. BTB information (hit, type, target) at each slot within the sequential fetch bundle (btb_fetch_bundle[]).
    // 3. Its next pc, if it can be provided by the BTB (next_pc, an output of this function).
-   btb.lookup(pc, cb_predictions, fetch_bundle_length, btb_fetch_bundle, next_pc);
+   // 4. Whether it needed the second-level BTB, which delays the fetch bundle.
+   delay = (btb.lookup(pc, cb_predictions, fetch_bundle_length, btb_fetch_bundle, next_pc) ? BTB2_LATENCY : 0);
 
    ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
    // FIX_ME #TRACECACHE
@@ -154,24 +361,30 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
 
    // tc_hit = tcm.lookup(pc, cb_predictions, fetch_bundle_length, btb_fetch_bundle, next_pc);
    tc_hit = false;
+   tc_data = NULL;
    if (cond_branch_per_cycle > 1) {
-      if (tcm.lookup(pc, cb_predictions, tcm_fetch_bundle_length, tcm_fetch_bundle, tcm_next_pc)) {
+      if (tcm.lookup(pc, fetch_cb_bhr, cb_predictions, tcm_fetch_bundle_length, tcm_fetch_bundle, tcm_next_pc, tcm_data, tcm_promoted_mask, tcm_promoted_taken) &&
+          !demoted(pc, cb_predictions, tcm_fetch_bundle_length, tcm_fetch_bundle, tcm_promoted_mask, tcm_promoted_taken)) {
          tc_hit = true;
+         promoted_mask = tcm_promoted_mask;
+         promoted_taken = tcm_promoted_taken;
+         tc_data = tcm_data;
          if (fetch_bundle_length < tcm_fetch_bundle_length)
             tc_diff_bun++;
          fetch_bundle_length = tcm_fetch_bundle_length;
          for (uint64_t i = 0; i < tcm_fetch_bundle_length; i++)
             btb_fetch_bundle[i] = tcm_fetch_bundle[i];
          next_pc = tcm_next_pc;
+         delay = 0;
          tc_hit_cnt++;
       }
    }
-   lfb_pc = pc;
-   lfb_cb_predictions = cb_predictions;
-   lfb_fetch_bundle_length = fetch_bundle_length;
+   lfb.pc = pc;
+   lfb.bhr = fetch_cb_bhr;
+   lfb.fetch_bundle_length = fetch_bundle_length;
    for (uint64_t i = 0; i < fetch_bundle_length; i++)
-      lfb_fetch_bundle[i] = btb_fetch_bundle[i];
-   lfb_next_pc = next_pc;
+      lfb.fetch_bundle[i] = btb_fetch_bundle[i];
+   lfb.next_pc = next_pc;
    ///////////////////////////////////////////////////////////////////////////////////////////////////////////
    // 1. Push entries into the branch queue, for all of the branches in the predicted fetch bundle.
    // 2. Update global histories and the RAS.
@@ -183,10 +396,25 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
    bool taken;					// taken/not-taken prediction for the current conditional branch (where we are at in the fetch bundle)
    uint64_t pred_tag;				// pred_tag is the index into the branch queue for the newly pushed branch
    bool pred_tag_phase;				// this will get appended to pred_tag so that the user interacts with the BPU via a single number
+   uint64_t slot_pc;				// pc of the current instruction in the fetch bundle (a trace, on a TCM hit, need not be sequential)
+   uint64_t ctr;				// two-bit counter of the current conditional branch
+   uint64_t last_pred_tag = 0;			// branch queue entry of the last branch in the fetch bundle
+   uint64_t used_cb = 0;			// # counters used from cb_predictions
+   uint64_t unused_cb = cb_predictions;		// counters not yet used
+   uint64_t fill_cb = 0;			// # counters in lfb.cb_predictions
+
+   uint64_t ntp_dirs = 0;			// directions of the fetch bundle's conditional branches so far (for the NTP)
+   uint64_t ntp_n = 0;				// # of them
+
+   lfb.cb_predictions = 0;
+   lfb.promoted_mask = 0;
+   lfb.promoted_taken = 0;
 
    branch_vector = 0; // Initialize this output of the function (locates branches within the fetch bundle)
    pred_vector = 0;   // Initialize this output of the function (taken/not-taken predictions of each conditional branch within the fetch bundle)
+   slot_pc = fetch_pc;
    for (uint64_t i = 0; i < fetch_bundle_length; i++) {
+      taken = false;
       if (btb_fetch_bundle[i].hit) {
          // (trace cache miss) The BTB predicted that this instruction is a branch.
          // (trace cache hit) The TCM says with certainty that this instruction is a branch.
@@ -204,6 +432,13 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
 
 	 // Set up context-related fields in the new branch queue entry.
 	 bq.bq[pred_tag].branch_type = btb_fetch_bundle[i].branch_type;
+	 bq.bq[pred_tag].pc = slot_pc;
+	 bq.bq[pred_tag].promoted = false;
+	 bq.bq[pred_tag].ntp_hist = ntp_hist;
+	 bq.bq[pred_tag].ntp_dirs = ntp_dirs;
+	 bq.bq[pred_tag].ntp_count = ntp_n;
+	 bq.bq[pred_tag].ntp_last = false;
+	 bq.bq[pred_tag].ntp_used = false;
 	 bq.bq[pred_tag].precise_cb_bhr = cb_index.get_bhr();
 	 bq.bq[pred_tag].precise_ib_bhr = ib_index.get_bhr();
 	 bq.bq[pred_tag].precise_ras_tos = ras.get_tos();
@@ -218,12 +453,35 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
 	 // Take action according to the branch type.
 	 switch (btb_fetch_bundle[i].branch_type) {
 	    case BTB_BRANCH:
+	       if (promoted_mask & (1 << i)) {
+	          // A promoted branch in the trace: its direction is fixed, and it does not use a prediction.
+	          taken = ((promoted_taken & (1 << i)) != 0);
+	          ctr = (taken ? 3 : 0);
+	          bq.bq[pred_tag].promoted = true;
+	       }
+	       else {
 	       // The low two bits of cb_predictions correspond to the next two-bit counter to examine (because we shift it right, subsequently).
 	       // From this two-bit counter, set the taken flag, accordingly.
-	       taken = ((cb_predictions & 3) >= 2);
+	       ctr = (cb_predictions & 3);
+	       taken = (ctr >= 2);
+	       bq.bq[pred_tag].ntp_used = (used_cb < ntp_count);
 
 	       // Shift out the used-up 2-bit counter, to set up the next conditional branch.
 	       cb_predictions = (cb_predictions >> 2);
+	       used_cb++;
+	       unused_cb = cb_predictions;
+	       }
+
+	       // The line fill buffer embeds the branch as promoted, if it (now) is, else with its counter.
+	       if (promoted(slot_pc, taken)) {
+	          lfb.promoted_mask |= (1 << i);
+	          if (taken)
+	             lfb.promoted_taken |= (1 << i);
+	       }
+	       else {
+	          lfb.cb_predictions |= (ctr << (fill_cb << 1));
+	          fill_cb++;
+	       }
 
 	       if (taken) {
 	          // Set the taken/not-taken bit, in "pred_vector" (an output of this function), corresponding to this instruction in the fetch bundle.
@@ -232,17 +490,27 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
 
 	       // Record the prediction.
 	       bq.bq[pred_tag].taken = taken;
-	       bq.bq[pred_tag].next_pc = (taken ? btb_fetch_bundle[i].target : (fetch_pc + ((i + 1) << 2)));
+	       bq.bq[pred_tag].next_pc = (taken ? btb_fetch_bundle[i].target : INCREMENT_PC(slot_pc));
 
 	       // Record this conditional branch's position within the conditional branch prediction bundle.
-	       bq.bq[pred_tag].fetch_cb_pos_in_entry = fetch_cb_pos_in_entry;
+	       // (A promoted branch has none.)
+	       if (!bq.bq[pred_tag].promoted) {
+	          bq.bq[pred_tag].fetch_cb_pos_in_entry = fetch_cb_pos_in_entry;
 
-	       // Increment the position to set up for the next conditional branch in the conditional branch prediction bundle.
-	       fetch_cb_pos_in_entry++;
+	          // Increment the position to set up for the next conditional branch in the conditional branch prediction bundle.
+	          fetch_cb_pos_in_entry++;
+	       }
 
 	       // Update the BHRs of the conditional branch predictor and indirect branch predictor.
 	       cb_index.update_bhr(taken);
 	       ib_index.update_bhr(taken);
+
+	       // Add the branch to the fetch bundle's trace ID (a promoted branch goes a fixed way).
+	       if (!bq.bq[pred_tag].promoted) {
+	          if (taken)
+	             ntp_dirs |= ((uint64_t)1 << ntp_n);
+	          ntp_n++;
+	       }
 	       break;
 
 	    case BTB_JUMP_DIRECT:
@@ -256,8 +524,7 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
 	       assert(i == (fetch_bundle_length - 1));
 
 	       // Push the RAS with the PC of the call instruction plus 4 (next sequential PC).
-	       // The calculation is shown below: fetch_PC + (# instructions in fetch bundle before the call + 1 instruction for the call)*4.
-	       ras.push(fetch_pc + ((i + 1) << 2));
+	       ras.push(INCREMENT_PC(slot_pc));
 
 	       // Record the prediction.
 	       bq.bq[pred_tag].taken = true;
@@ -285,8 +552,7 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
 	       next_pc = ib_predicted_target;
 
 	       // Push the RAS with the PC of the call instruction plus 4 (next sequential PC).
-	       // The calculation is shown below: fetch_PC + (# instructions in fetch bundle before the call + 1 instruction for the call)*4.
-	       ras.push(fetch_pc + ((i + 1) << 2));
+	       ras.push(INCREMENT_PC(slot_pc));
 
 	       // Record the prediction.
 	       bq.bq[pred_tag].taken = true;
@@ -314,9 +580,28 @@ uint64_t bpu_t::predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_
 	       break;
          }
 	 b++;	// increment number of branches
+	 last_pred_tag = pred_tag;
       }
+
+      // Advance to the pc of the next instruction: the target of a jump direct or a predicted-taken branch, else sequential.
+      if (btb_fetch_bundle[i].hit && ((btb_fetch_bundle[i].branch_type == BTB_JUMP_DIRECT) || ((btb_fetch_bundle[i].branch_type == BTB_BRANCH) && taken)))
+         slot_pc = btb_fetch_bundle[i].target;
+      else
+         slot_pc = INCREMENT_PC(slot_pc);
+   }
+
+   // Update the trace history with the fetch bundle's trace ID.
+   // Only fetch bundles with branches are included: the NTP is trained when their last branch commits.
+   if (b > 0) {
+      bq.bq[last_pred_tag].ntp_last = true;
+      if (ntp_entries)
+         ntp_hist = ntp_update_hist(ntp_hist, fetch_pc, ntp_dirs, ntp_n);
    }
 
+   // The counters beyond the fetch bundle's branches follow, as they would have without promotion.
+   if (fill_cb < 32)
+      lfb.cb_predictions |= (unused_cb << (fill_cb << 1));
+
    return(fetch_pred_tag);
 }
 
@@ -347,6 +632,19 @@ void bpu_t::btb_miss(uint64_t fetch_pred_tag, uint64_t pc, uint64_t btb_miss_bit
    cb_index.set_bhr(bq.bq[pred_tag].precise_cb_bhr);
    ib_index.set_bhr(bq.bq[pred_tag].precise_ib_bhr);
    ras.set_tos(bq.bq[pred_tag].precise_ras_tos);
+   ntp_hist = ntp_hist_predict;
+
+   // The fetch bundles queued behind it followed the flawed prediction: discard them.
+   // The fetch stage re-predicts from "pc" in the next fetch cycle.
+   // The fetch bundle's FTQ entry holds its exact checkpoint.
+   if (ftq_size) {
+      cb_index.set_bhr(ftq[ftq_fetched].cb_bhr);
+      ib_index.set_bhr(ftq[ftq_fetched].ib_bhr);
+      ras.set_tos(ftq[ftq_fetched].ras_tos);
+      meas_ftq_squashed += ftq_length;
+      ftq_length = 0;
+      ftq_pc = pc;
+   }
 
    // 3. Add the missing branch to the BTB.
 
@@ -399,8 +697,29 @@ void bpu_t::mispredict(uint64_t branch_pred_tag, bool taken, uint64_t next_pc) {
 
    bq.bq[pred_tag].misp = true;
 
+   // The fetch bundle now ends at this branch: restore the trace history with its corrected trace ID.
+   bq.bq[pred_tag].ntp_last = true;
+   if (ntp_entries) {
+      uint64_t dirs = bq.bq[pred_tag].ntp_dirs;
+      uint64_t count = bq.bq[pred_tag].ntp_count;
+      if ((bq.bq[pred_tag].branch_type == BTB_BRANCH) && !bq.bq[pred_tag].promoted) {
+         if (taken)
+            dirs |= ((uint64_t)1 << count);
+         count++;
+      }
+      ntp_hist = ntp_update_hist(bq.bq[pred_tag].ntp_hist, bq.bq[pred_tag].fetch_pc, dirs, count);
+   }
+
 	// 5. clear the line fill buffer as the previous pc != next pc				
 	tcm.clear_line_fill();
+
+   // 6. Discard the fetch bundles queued behind the branch, and run ahead again from its corrected next pc.
+   if (ftq_size) {
+      meas_ftq_squashed += ftq_length;
+      ftq_length = 0;
+      ftq_pc = next_pc;
+      ftq_pc_valid = true;
+   }
 }
 
 
@@ -415,6 +734,42 @@ void bpu_t::commit(uint64_t branch_pred_tag) {
    // Assert that the branch_pred_tag (pred_tag of the branch being committed from the pipeline) corresponds to the popped branch queue entry.
    assert(branch_pred_tag == ((pred_tag << 1) | (pred_tag_phase ? 1 : 0)));
 
+   // Train the next-trace predictor when the last branch of a fetch bundle commits:
+   // the fetch bundle's trace ID is now known, and it follows the trace history recorded with it.
+   if (ntp_entries) {
+      bq_entry_t &b = bq.bq[pred_tag];
+      bool cond = ((b.branch_type == BTB_BRANCH) && !b.promoted);
+      if (cond && b.ntp_used) {
+         meas_ntp_n++;
+         if (b.misp)
+            meas_ntp_m++;
+      }
+      if (b.ntp_last) {
+         uint64_t dirs = b.ntp_dirs;
+         uint64_t count = b.ntp_count;
+         if (cond) {
+            if (b.taken)
+               dirs |= ((uint64_t)1 << count);
+            count++;
+         }
+         ntp_entry_t &e = ntp[ntp_index(b.ntp_hist, b.fetch_pc)];
+         if ((e.tag == b.fetch_pc) && (e.dirs == dirs) && (e.count == count)) {
+            if (e.conf < 3)
+               e.conf++;
+         }
+         else if (e.conf > 0) {
+            e.conf--;
+         }
+         else {
+            e.tag = b.fetch_pc;
+            e.dirs = dirs;
+            e.count = count;
+            e.conf = 1;
+         }
+         ntp_commit_hist = ntp_update_hist(b.ntp_hist, b.fetch_pc, dirs, count);
+      }
+   }
+
    // Update the conditional branch predictor or indirect branch predictor.
    // Update measurements.
    uint64_t *cb_counters;	// FYI: The compiler forbids declaring these four local variables inside "case BTB_BRANCH:".
@@ -423,6 +778,34 @@ void bpu_t::commit(uint64_t branch_pred_tag) {
    uint64_t ctr;
    switch (bq.bq[pred_tag].branch_type) {
       case BTB_BRANCH:
+	 // Train the branch-bias table.
+	 // A promoted branch that went the other way (a fault) is demoted.
+	 if (PROMOTE_THRESHOLD) {
+	    bias_entry_t &e = bias[(bq.bq[pred_tag].pc >> 2) & (bias_entries - 1)];
+	    if (bq.bq[pred_tag].promoted) {
+	       meas_promoted_n++;
+	       if (bq.bq[pred_tag].misp)
+	          meas_promoted_m++;
+	    }
+	    if ((e.tag == bq.bq[pred_tag].pc) && (e.taken == bq.bq[pred_tag].taken)) {
+	       if (e.count < PROMOTE_THRESHOLD)
+	          e.count++;
+	    }
+	    else {
+	       e.tag = bq.bq[pred_tag].pc;
+	       e.taken = bq.bq[pred_tag].taken;
+	       e.count = 1;
+	    }
+	 }
+
+	 // A promoted branch was not predicted by the conditional branch predictor: there is no counter to train.
+	 if (bq.bq[pred_tag].promoted) {
+	    meas_branch_n++;
+	    if (bq.bq[pred_tag].misp)
+	       meas_branch_m++;
+	    break;
+	 }
+
 	 // Re-reference the conditional branch predictor, using the same context that was used by
 	 // the fetch bundle that this branch was a part of.
          // Using this original context, we re-reference the same "m" counters from the conditional branch predictor.
@@ -516,22 +899,204 @@ void bpu_t::flush() {
    cb_index.set_bhr(bq.bq[pred_tag].precise_cb_bhr);
    ib_index.set_bhr(bq.bq[pred_tag].precise_ib_bhr);
    ras.set_tos(bq.bq[pred_tag].precise_ras_tos);
+   ntp_hist = ntp_commit_hist;
    tcm.clear_line_fill();
+
+   // Discard the queued fetch bundles.  The fetch stage supplies the pc to run ahead from.
+   meas_ftq_squashed += ftq_length;
+   ftq_length = 0;
+   ftq_pc_valid = false;
 }
 
-void bpu_t::trace_constructor (bool valid_fetch_bundle, bool tcm_hit){
-	if (valid_fetch_bundle){
+void bpu_t::trace_constructor (bool valid_fetch_bundle, bool tcm_hit, insn_t fetch_insn[], bool insn_valid){
+	if (valid_fetch_bundle && (TCM_FILL == 0)){
 		if (cond_branch_per_cycle > 1) {
 			if (CLEAR_TCM_AT_HIT == 1) {
 				if (tcm_hit)
 					tcm.clear_line_fill();
 				else
-					tcm.line_fill_buffer (lfb_pc, lfb_cb_predictions, lfb_fetch_bundle_length, lfb_fetch_bundle, lfb_next_pc);
+					tcm.line_fill_buffer (lfb.pc, lfb.bhr, lfb.cb_predictions, lfb.promoted_mask, lfb.promoted_taken, lfb.fetch_bundle_length, lfb.fetch_bundle, lfb.next_pc, fetch_insn, insn_valid);
 			}
 			else
-				tcm.line_fill_buffer (lfb_pc, lfb_cb_predictions, lfb_fetch_bundle_length, lfb_fetch_bundle, lfb_next_pc);
+				tcm.line_fill_buffer (lfb.pc, lfb.bhr, lfb.cb_predictions, lfb.promoted_mask, lfb.promoted_taken, lfb.fetch_bundle_length, lfb.fetch_bundle, lfb.next_pc, fetch_insn, insn_valid);
+		}
+	}
+}
+
+
+// Retire-time fill unit.
+// Traces are assembled from committed instructions, so they are always on the correct path, and
+// nothing is lost on a squash.  The selection policy is that of trace_constructor(): a trace starts
+// at the start of a fetch bundle (where fetch will look it up), and stops after the m'th conditional
+// branch, "n" instructions, or a call, jump indirect, or return.  The whole trace is then passed to
+// the TCM line fill buffer at once, as a single (non-sequential) fetch bundle.
+void bpu_t::retire_fill(uint64_t pc, insn_t insn, bool bundle_start, bool branch, uint64_t branch_pred_tag) {
+	if ((TCM_FILL != 1) || (cond_branch_per_cycle <= 1))
+		return;
+
+	// A trap (or an exception's handler) breaks the committed path: start over.
+	if (rfb_length && (pc != rfb_next_pc)) {
+		rfb_length = 0;
+		rfb_discard++;
+	}
+	if (rfb_length == 0) {
+		if (!bundle_start) {
+			// Keep the committed-path history current while waiting for the next fetch bundle.
+			if (branch && (bq.bq[branch_pred_tag >> 1].branch_type == BTB_BRANCH)) {
+				rfb_index.set_bhr(bq.bq[branch_pred_tag >> 1].precise_cb_bhr);
+				rfb_index.update_bhr(bq.bq[branch_pred_tag >> 1].taken);
+			}
+			return;
+		}
+		rfb_pc = pc;
+		rfb_bhr = rfb_index.get_bhr();
+		rfb_cb_predictions = 0;
+		rfb_branches = 0;
+		rfb_promoted_mask = 0;
+		rfb_promoted_taken = 0;
+	}
+
+	btb_output_t &slot = rfb_bundle[rfb_length];
+	slot.hit = branch;
+	slot.branch_type = BTB_BRANCH;
+	slot.target = 0;
+	rfb_next_pc = INCREMENT_PC(pc);
+	if (branch) {
+		bq_entry_t &e = bq.bq[branch_pred_tag >> 1];
+		slot.branch_type = e.branch_type;
+		rfb_next_pc = e.next_pc;
+		switch (e.branch_type) {
+			case BTB_BRANCH:
+				slot.target = BRANCH_TARGET;
+				if (promoted(pc, e.taken)) {
+					rfb_promoted_mask |= (1 << rfb_length);
+					if (e.taken)
+						rfb_promoted_taken |= (1 << rfb_length);
+				}
+				else {
+					rfb_cb_predictions |= ((e.taken ? 3 : 0) << (rfb_branches << 1));
+					rfb_branches++;
+				}
+				rfb_index.set_bhr(e.precise_cb_bhr);
+				rfb_index.update_bhr(e.taken);
+				break;
+			case BTB_JUMP_DIRECT:
+			case BTB_CALL_DIRECT:
+				slot.target = JUMP_TARGET;
+				break;
+			default:
+				break;
+		}
+	}
+	rfb_insn[rfb_length] = insn;
+	rfb_length++;
+
+	if ((rfb_length == instr_per_cycle) || (rfb_branches == cond_branch_per_cycle) ||
+	    (branch && (slot.branch_type != BTB_BRANCH) && (slot.branch_type != BTB_JUMP_DIRECT))) {
+		tcm.clear_line_fill();
+		tcm.line_fill_buffer(rfb_pc, rfb_bhr, rfb_cb_predictions, rfb_promoted_mask, rfb_promoted_taken, rfb_length, rfb_bundle, rfb_next_pc, rfb_insn, true);
+		rfb_length = 0;
+	}
+}
+
+
+// Next-trace predictor index: the trace history and the start pc of the next trace, XOR-folded.
+uint64_t bpu_t::ntp_index(uint64_t hist, uint64_t pc) {
+	uint64_t x = (hist ^ (pc >> 2));
+	uint64_t f = 0;
+	uint64_t bits = (uint64_t) log2((double)ntp_entries);
+	if (bits == 0)
+		return(0);
+	while (x) {
+		f ^= (x & (ntp_entries - 1));
+		x >>= bits;
+	}
+	return(f);
+}
+
+// Shift a trace ID (start pc, # conditional branches and their directions), hashed to 16 bits,
+// into the trace history, which keeps the most recent NTP_HISTORY of them.
+uint64_t bpu_t::ntp_update_hist(uint64_t hist, uint64_t pc, uint64_t dirs, uint64_t count) {
+	uint64_t id = (((((pc >> 2) << 5) | count) << cond_branch_per_cycle) | dirs);
+	uint64_t h = 0;
+	uint64_t bits = ((4 * (NTP_HISTORY - 1)) + 16);
+	while (id) {
+		h ^= (id & 0xffff);
+		id >>= 16;
+	}
+	hist = ((hist << 4) ^ h);
+	return((bits >= 64) ? hist : (hist & (((uint64_t)1 << bits) - 1)));
+}
+
+// Is the conditional branch at "pc" promoted in direction "taken"?
+bool bpu_t::promoted(uint64_t pc, bool taken) {
+	bias_entry_t &e = bias[(pc >> 2) & (bias_entries - 1)];
+	return(PROMOTE_THRESHOLD && (e.tag == pc) && (e.taken == taken) && (e.count >= PROMOTE_THRESHOLD));
+}
+
+// Was any promoted branch in the trace demoted since the trace was filled?
+// Such a trace would keep predicting the faulting direction, so it is not used.
+// The trace's other branches agree with cb_predictions (else it would have missed), which locates the promoted branches' pcs.
+bool bpu_t::demoted(uint64_t pc, uint64_t cb_predictions, uint64_t length, btb_output_t bundle[], uint64_t promoted_mask, uint64_t promoted_taken) {
+	bool taken;
+	if (promoted_mask == 0)
+		return(false);
+	for (uint64_t i = 0; i < length; i++) {
+		taken = false;
+		if (bundle[i].hit && (bundle[i].branch_type == BTB_BRANCH)) {
+			if (promoted_mask & (1 << i)) {
+				taken = ((promoted_taken & (1 << i)) != 0);
+				if (!promoted(pc, taken)) {
+					meas_promoted_reject++;
+					return(true);
+				}
+			}
+			else {
+				taken = ((cb_predictions & 3) >= 2);
+				cb_predictions = (cb_predictions >> 2);
+			}
 		}
+		if (bundle[i].hit && ((bundle[i].branch_type == BTB_JUMP_DIRECT) || ((bundle[i].branch_type == BTB_BRANCH) && taken)))
+			pc = bundle[i].target;
+		else
+			pc = INCREMENT_PC(pc);
 	}
+	return(false);
+}
+
+
+void bpu_t::fence_i() {
+	tcm.invalidate_data();
+
+	// Queued fetch bundles hold their own copies of the trace data: drop them too.
+	for (uint64_t i = 0; i < ftq_length; i++)
+		ftq[(ftq_head + i) % ftq_size].data_valid = false;
+}
+
+
+void bpu_t::save_state(std::ostream &out) {
+   uint64_t geometry[4] = {cb_index.table_size(), ib_index.table_size(), bias_entries, ntp_entries};
+   out.write((const char *)geometry, sizeof(geometry));
+   out.write((const char *)cb, cb_index.table_size() * sizeof(uint64_t));
+   out.write((const char *)ib, ib_index.table_size() * sizeof(uint64_t));
+   out.write((const char *)bias, bias_entries * sizeof(bias_entry_t));
+   if (ntp)
+      out.write((const char *)ntp, ntp_entries * sizeof(ntp_entry_t));
+}
+
+
+bool bpu_t::restore_state(std::istream &in) {
+   uint64_t geometry[4];
+   in.read((char *)geometry, sizeof(geometry));
+   if (!in || (geometry[0] != cb_index.table_size()) || (geometry[1] != ib_index.table_size()) ||
+       (geometry[2] != bias_entries) || (geometry[3] != ntp_entries))
+      return(false);
+   in.read((char *)cb, cb_index.table_size() * sizeof(uint64_t));
+   in.read((char *)ib, ib_index.table_size() * sizeof(uint64_t));
+   in.read((char *)bias, bias_entries * sizeof(bias_entry_t));
+   if (ntp)
+      in.read((char *)ntp, ntp_entries * sizeof(ntp_entry_t));
+   return((bool)in);
 }
 
 
@@ -553,5 +1118,22 @@ void bpu_t::output(uint64_t num_instr, FILE *fp) {
    BP_OUTPUT(fp, "Call Indirect    ", meas_callind_n, meas_callind_m, num_instr);
    BP_OUTPUT(fp, "Return           ", meas_jumpret_n, meas_jumpret_m, num_instr);
    BP_OUTPUT(fp, "TCM hit count    ", tc_hit_cnt, tc_diff_bun, (uint64_t)0);
+   if (PROMOTE_THRESHOLD)
+      fprintf(fp, "Promoted branches %10lu %10lu %5.2lf%% (faults), %lu trace hits rejected (demoted)\n",
+              meas_promoted_n, meas_promoted_m, (meas_promoted_n ? (100.0*((double)meas_promoted_m/(double)meas_promoted_n)) : 0.0), meas_promoted_reject);
+   if (ntp_entries)
+      fprintf(fp, "Next-trace pred. %10lu %10lu %5.2lf%% (fetch bundles predicted, by the NTP); %lu NTP-predicted branches, %lu mispredicted (%.2lf%%)\n",
+              meas_ntp_bundles, meas_ntp_used, (meas_ntp_bundles ? (100.0*((double)meas_ntp_used/(double)meas_ntp_bundles)) : 0.0),
+              meas_ntp_n, meas_ntp_m, (meas_ntp_n ? (100.0*((double)meas_ntp_m/(double)meas_ntp_n)) : 0.0));
+   if (ftq_size) {
+      uint64_t fetched = (meas_ftq_pushed - meas_ftq_squashed - ftq_length);
+      fprintf(fp, "Fetch target queue: %lu fetch bundles predicted, %lu squashed (%.2lf%%), %.2lf queued behind each fetched bundle; %lu handed out for prefetching\n",
+              meas_ftq_pushed, meas_ftq_squashed, (meas_ftq_pushed ? (100.0*((double)meas_ftq_squashed/(double)meas_ftq_pushed)) : 0.0),
+              (fetched ? ((double)meas_ftq_ahead/(double)fetched) : 0.0), meas_ftq_prefetch);
+   }
+   if (TCM_FILL == 1)
+      fprintf(fp, "TCM retire fill: %lu traces discarded (discontinuous committed path)\n", rfb_discard);
+   btb.output(fp);
+   tcm.output(fp);
 }
 
@@ -9,6 +9,68 @@
 #include "ras.h"
 
 
+// A branch-bias table entry, for branch promotion.
+typedef
+struct {
+	uint64_t tag;		// the branch's pc
+	bool taken;		// its most recent outcome
+	uint64_t count;		// # consecutive outcomes in that direction (saturates at PROMOTE_THRESHOLD)
+} bias_entry_t;
+
+
+// A next-trace predictor entry.
+// It predicts the trace that starts at "tag": the directions of its first "count" conditional branches.
+typedef
+struct {
+	uint64_t tag;		// start pc of the trace
+	uint64_t dirs;		// bit k: direction of the k'th conditional branch
+	uint64_t count;		// # conditional branches in the trace
+	uint64_t conf;		// 2-bit confidence counter
+} ntp_entry_t;
+
+
+// The line fill buffer's inputs for a predicted fetch bundle (fetch-time fill, see trace_constructor()).
+typedef
+struct {
+	uint64_t pc;
+	uint64_t bhr;
+	uint64_t cb_predictions;
+	uint64_t promoted_mask;
+	uint64_t promoted_taken;
+	uint64_t fetch_bundle_length;
+	uint64_t next_pc;
+	btb_output_t fetch_bundle[MAX_BTB_BANKS];
+} lfb_t;
+
+
+// A fetch target queue entry: one fetch bundle, predicted ahead of the fetch stage.
+typedef
+struct {
+	// Outputs of predict() for the fetch bundle.
+	uint64_t pc;
+	uint64_t fetch_pred_tag;
+	uint64_t pred_tags[MAX_BTB_BANKS];
+	bool tc_hit;
+	uint64_t fetch_bundle_length;
+	uint64_t branch_vector;
+	uint64_t pred_vector;
+	uint64_t next_pc;
+	uint64_t delay;		// extra fetch cycles (second-level BTB)
+	tcm_data_t data;	// copy of the trace data (the TCM entry may be replaced before the fetch bundle is fetched)
+	bool data_valid;
+
+	lfb_t lfb;		// line fill buffer inputs
+
+	// Checkpoint of the global histories and the RAS before the fetch bundle was predicted.
+	uint64_t cb_bhr;
+	uint64_t ib_bhr;
+	uint64_t ras_tos;
+	uint64_t ntp_hist;
+
+	bool prefetched;	// its I$ lines were prefetched (FDIP)
+} ftq_entry_t;
+
+
 class bpu_t {
 private:
 	// Fetch bundle constraints.
@@ -67,6 +129,26 @@ private:
 	// Return address stack for predicting return targets.
 	ras_t ras;
 
+	// Branch-bias table for branch promotion (PROMOTE_THRESHOLD > 0).
+	// A conditional branch that went the same way PROMOTE_THRESHOLD consecutive times is promoted:
+	// traces embed it with a fixed direction, without using one of the "m" conditional branch predictions.
+	bias_entry_t *bias;
+	uint64_t bias_entries;
+	bool promoted(uint64_t pc, bool taken);	// is the branch at "pc" promoted in direction "taken"?
+	// Next-trace predictor (NTP_ENTRIES > 0).
+	// Indexed by a hash of the IDs (start pc and branch directions) of the most recent NTP_HISTORY fetch bundles,
+	// it predicts all "m" directions of the next fetch bundle in one lookup.  When it is not confident,
+	// the gshare predictor (always trained) supplies them.
+	ntp_entry_t *ntp;
+	uint64_t ntp_entries;
+	uint64_t ntp_hist;		// speculative trace history
+	uint64_t ntp_hist_predict;	// trace history before the most recently predicted fetch bundle (for BTB misses)
+	uint64_t ntp_commit_hist;	// trace history of the committed path (for complete squashes)
+	uint64_t ntp_index(uint64_t hist, uint64_t pc);
+	uint64_t ntp_update_hist(uint64_t hist, uint64_t pc, uint64_t dirs, uint64_t count);
+
+	bool demoted(uint64_t pc, uint64_t cb_predictions, uint64_t length, btb_output_t bundle[], uint64_t promoted_mask, uint64_t promoted_taken);
+
 	// Measurements.
 	uint64_t meas_branch_n;		// # branches
 	uint64_t meas_jumpdir_n;	// # jumps, direct
@@ -79,12 +161,54 @@ private:
 	uint64_t meas_jumpind_m;	// # mispredicted jumps, indirect
 	uint64_t meas_callind_m;	// # mispredicted calls, indirect
 	uint64_t meas_jumpret_m;	// # mispredicted jumps, return
+
+	uint64_t meas_promoted_n;	// # promoted branches (branches predicted by a trace's fixed direction)
+	uint64_t meas_promoted_m;	// # promoted branches that faulted (went the other way)
+	uint64_t meas_promoted_reject;	// # trace cache hits rejected because a promoted branch in the trace was since demoted
+
+	uint64_t meas_ntp_bundles;	// # fetch bundles predicted
+	uint64_t meas_ntp_used;		// # of them whose directions were supplied by the NTP
+	uint64_t meas_ntp_n;		// # committed conditional branches predicted by the NTP
+	uint64_t meas_ntp_m;		// # of them mispredicted
 	
-	uint64_t lfb_pc;
-	uint64_t lfb_cb_predictions;
-	uint64_t lfb_fetch_bundle_length;
-	uint64_t lfb_next_pc;
-	btb_output_t lfb_fetch_bundle[MAX_BTB_BANKS];
+	lfb_t lfb;
+
+	// Extra fetch cycles taken by the most recently predicted fetch bundle: its prediction needed the second-level BTB.
+	uint64_t delay;
+
+	// Fetch target queue (FTQ_SIZE > 0).
+	// The BPU runs ahead of the fetch stage, predicting up to FTQ_SIZE fetch bundles into the FTQ; predict()
+	// then hands out the head entry.  The queued fetch bundles drive fetch-directed I$ prefetching (FDIP).
+	ftq_entry_t *ftq;
+	uint64_t ftq_size;
+	uint64_t ftq_head;
+	uint64_t ftq_length;
+	uint64_t ftq_pc;		// start pc of the next fetch bundle to predict into the FTQ
+	bool ftq_pc_valid;		// false until the fetch stage supplies a pc (after a complete squash)
+	uint64_t ftq_fetched;		// FTQ entry of the fetch bundle most recently handed out (for BTB misses)
+	void ftq_push();
+	void ftq_squash();		// discard all queued fetch bundles, and restore the BPU to the head's checkpoint
+
+	uint64_t meas_ftq_pushed;	// # fetch bundles predicted into the FTQ
+	uint64_t meas_ftq_squashed;	// # of them discarded before being fetched
+	uint64_t meas_ftq_ahead;	// sum over fetched bundles of the FTQ occupancy behind them
+	uint64_t meas_ftq_prefetch;	// # fetch bundles handed out for prefetching
+
+	uint64_t predict_bundle(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_t &fetch_bundle_length, uint64_t &branch_vector, uint64_t &pred_vector, uint64_t &next_pc, tcm_data_t* &tc_data);
+
+	// Retire-time fill unit (TCM_FILL = 1): the trace being assembled from committed instructions.
+	gshare_index_t rfb_index;	// global branch history of the committed path
+	uint64_t rfb_pc;		// start pc of the trace
+	uint64_t rfb_bhr;		// global branch history at the start of the trace
+	uint64_t rfb_cb_predictions;	// outcomes of the trace's conditional branches, packed like cb_predictions
+	uint64_t rfb_branches;		// # conditional branches in the trace, other than promoted ones
+	uint64_t rfb_promoted_mask;	// bit per slot: promoted conditional branches
+	uint64_t rfb_promoted_taken;	// bit per slot: their directions
+	uint64_t rfb_length;		// # instructions in the trace (0: no trace under construction)
+	uint64_t rfb_next_pc;		// pc of the next committed instruction on the trace's path
+	btb_output_t rfb_bundle[MAX_BTB_BANKS];
+	insn_t rfb_insn[MAX_BTB_BANKS];
+	uint64_t rfb_discard;		// # traces discarded because the committed path was discontinuous (traps)
 
 public:
 	bpu_t(uint64_t instr_per_cycle,				// "n"
@@ -111,7 +235,21 @@ public:
 	//    5. Bit vector of branches within the fetch bundle (branch_vector).
 	//    6. Bit vector of conditional branch predictions within the fetch bundle (pred_vector).
 	//    7. Predicted next PC (next_pc).
-        uint64_t predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_t &fetch_bundle_length, uint64_t &branch_vector, uint64_t &pred_vector, uint64_t &next_pc);
+	//    8. On a trace cache hit, the trace's instructions and their decode-stage fields (tc_data).
+	//       NULL if the trace data array cannot supply them, in which case they must be fetched and decoded.
+        uint64_t predict(uint64_t pc, uint64_t pred_tags[], bool &tc_hit, uint64_t &fetch_bundle_length, uint64_t &branch_vector, uint64_t &pred_vector, uint64_t &next_pc, tcm_data_t* &tc_data);
+
+	// Extra fetch cycles before the fetch bundle most recently returned by predict() is available
+	// (its prediction needed the second-level BTB).
+	uint64_t fetch_delay() { return(delay); }
+
+	// Fetch target queue (FTQ_SIZE > 0).
+	// run_ahead():    predict one more fetch bundle into the FTQ, if there is room.  Called once per cycle.
+	// ftq_prefetch(): get the start pc of the oldest queued fetch bundle not yet prefetched (false: none).
+	// ftq_busy():     the BPU can make progress in the next cycle, without any help from the fetch stage.
+	void run_ahead();
+	bool ftq_prefetch(uint64_t &pc);
+	bool ftq_busy();
 
 	// A BTB miss was detected in the predicted fetch bundle.
 	// 1. Roll-back the branch queue to where it was prior to predicting the fetch bundle (fetch_pred_tag).
@@ -140,7 +278,25 @@ public:
 	// 1. Roll-back the branch queue to the head entry.
 	// 2. Restore checkpointed global histories and the RAS (as best we can for RAS).
 	void flush();
-	void trace_constructor (bool valid_fetch_bundle, bool tcm_hit);
+	// Feed the predicted fetch bundle to the trace cache line fill buffer.
+	// fetch_insn[] holds the fetched instructions; insn_valid is false if any had a fetch exception.
+	void trace_constructor (bool valid_fetch_bundle, bool tcm_hit, insn_t fetch_insn[], bool insn_valid);
+	// Feed a committed instruction to the retire-time fill unit (TCM_FILL = 1).
+	// bundle_start: the instruction was the first of its fetch bundle.
+	// Must be called before commit(), for a branch, while its branch queue entry is still valid.
+	void retire_fill(uint64_t pc, insn_t insn, bool bundle_start, bool branch, uint64_t branch_pred_tag);
+	// A FENCE.I committed: instructions held by the trace cache may be stale.
+	void fence_i();
 	// Output all branch prediction measurements.
 	void output(uint64_t num_instr, FILE *fp);
+	// Save/restore prediction state, for a checkpoint's warm state: the predictor tables (gshare, branch-bias
+	// and next-trace predictor tables), the BTB, and the TCM.  Global histories, the RAS and the branch queue
+	// are speculative state and are not saved.  A restore returns false, leaving the structure as is, if the
+	// saved structure has a different geometry.
+	void save_state(std::ostream &out);
+	bool restore_state(std::istream &in);
+	void save_btb_state(std::ostream &out) { btb.save_state(out); }
+	bool restore_btb_state(std::istream &in) { return(btb.restore_state(in)); }
+	void save_tcm_state(std::ostream &out) { tcm.save_state(out); }
+	bool restore_tcm_state(std::istream &in) { return(tcm.restore_state(in)); }
 };
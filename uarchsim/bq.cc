@@ -107,3 +107,11 @@ uint64_t bq_t::flush() {
    // Return the index of the head entry.
    return(head);
 }
+
+uint64_t bq_t::space() {
+   // Number of entries between the tail and the head.
+   if (tail_phase == head_phase)
+      return(size - (tail - head));
+   else
+      return(head - tail);
+}
@@ -3,6 +3,8 @@ class bq_entry_t {
 public:
 	// The type of branch.
 	btb_branch_type_e branch_type;
+	uint64_t pc;		// The branch's PC.
+	bool promoted;		// A promoted conditional branch: its direction was supplied by a trace, not by the conditional branch predictor.
 
 	// Precise information at this point in the instruction stream.
 	uint64_t precise_cb_bhr;  // Precise BHR (all prior branches included) to which we can restore the BHR of the conditional branch predictor (cb).
@@ -23,6 +25,13 @@ public:
 
 	// This flag indicates whether or not the branch was mispredicted.  It is needed for measuring mispredictions at retirement.
 	bool misp;
+
+	// Next-trace predictor (NTP) context of the fetch bundle that this branch was a part of.
+	uint64_t ntp_hist;	// trace history before the fetch bundle
+	uint64_t ntp_dirs;	// directions of the fetch bundle's conditional branches before this branch (bit k: k'th)
+	uint64_t ntp_count;	// # of them
+	bool ntp_last;		// this is the last branch of the fetch bundle (trains the NTP when it commits)
+	bool ntp_used;		// the NTP supplied this conditional branch's prediction
 };
 
 
@@ -46,5 +55,6 @@ public:
 	void rollback(uint64_t pred_tag, bool pred_tag_phase, bool do_checks);
 	void mark(uint64_t &pred_tag, bool &pred_tag_phase);
 	uint64_t flush();
+	uint64_t space();	// # free entries
 };
 
@@ -1,12 +1,14 @@
 #include <cinttypes>
 #include <cassert>
 #include <cmath>
+#include <iostream>
 
 #include "processor.h"
 #include "decode.h"
 #include "config.h"
 
 #include "btb.h"
+#include "parameters.h"
 
 
 btb_t::btb_t(uint64_t num_entries, uint64_t banks, uint64_t assoc, uint64_t cond_branch_per_cycle) {
@@ -33,6 +35,28 @@ btb_t::btb_t(uint64_t num_entries, uint64_t banks, uint64_t assoc, uint64_t cond
 	 }
       }
    }
+
+   // Allocate the second-level BTB.
+   btb2 = NULL;
+   sets2 = 0;
+   assoc2 = BTB2_ASSOC;
+   log2sets2 = 0;
+   if (BTB2_ENTRIES) {
+      sets2 = (BTB2_ENTRIES/assoc2);
+      assert(IsPow2(sets2));
+      assert(IsPow2(BTB2_REGION));
+      log2sets2 = (uint64_t) log2((double)sets2);
+      btb2 = new btb_entry_t *[sets2];
+      for (uint64_t s = 0; s < sets2; s++) {
+         btb2[s] = new btb_entry_t[assoc2];
+	 for (uint64_t way = 0; way < assoc2; way++) {
+	    btb2[s][way].valid = false;
+	    btb2[s][way].lru = way;
+	 }
+      }
+   }
+   meas_btb2_hit = 0;
+   meas_btb2_copy = 0;
 }
 
 
@@ -51,8 +75,9 @@ btb_t::~btb_t() {
 // 1. Its length (fetch_bundle_length).
 // 2. BTB information (hit, type, target) at each slot within the fetch bundle (btb_fetch_bundle[]).
 // 3. Its next pc, if it can be provided by the BTB (next_pc, an output of this function).
+// 4. Whether the second-level BTB supplied any of its branches (return value of function).
 //
-void btb_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t &next_pc) {
+bool btb_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t &next_pc) {
    uint64_t btb_bank;
    uint64_t btb_pc;
    uint64_t set;
@@ -60,11 +85,13 @@ void btb_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_
    bool taken;
    uint64_t num_cond_branch = 0;
    bool terminated = false;
+   bool btb2_hit = false;
 
    for (uint64_t pos = 0; pos < banks; pos++) {	// "pos" is position of the instruction within the maximum-length sequential fetch bundle.
       convert(pc, pos, btb_bank, btb_pc);	// convert {pc, pos} to {btb_bank, btb_pc}
 
       // Search for the instruction in its bank.
+      btb_fetch_bundle[pos].hit = false;
       if (search(btb_bank, btb_pc, set, way)) {
          // BTB hit.  The BTB coordinates of this branch are {btb_bank, set, way}.
          btb_fetch_bundle[pos].hit = true;
@@ -73,7 +100,19 @@ void btb_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_
 
          // Update LRU.
 	 update_lru(btb_bank, set, way);
+      }
+      else if (btb2 && search2(((pc >> 2) + pos), set, way)) {
+         // Second-level BTB hit.  Its region's branches, this one included, are copied into the first level.
+         btb_fetch_bundle[pos].hit = true;
+	 btb_fetch_bundle[pos].branch_type = btb2[set][way].branch_type;
+	 btb_fetch_bundle[pos].target = btb2[set][way].target;
+	 update_lru2(set, way);
+	 copy_region((pc >> 2) + pos);
+	 btb2_hit = true;
+	 meas_btb2_hit++;
+      }
 
+      if (btb_fetch_bundle[pos].hit) {
 	 // End the fetch bundle at any taken branch or at the maximum number of conditional branches.
          if (btb_fetch_bundle[pos].branch_type == BTB_BRANCH) {
 	    // The low two bits of cb_predictions correspond to the next two-bit counter to examine (because we shift it right, subsequently).
@@ -100,10 +139,6 @@ void btb_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_
 	    break;
          }
       }
-      else {
-	 // BTB miss.
-         btb_fetch_bundle[pos].hit = false;
-      }
    }
 
    if (!terminated) {
@@ -112,6 +147,7 @@ void btb_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_
    }
 
    assert(fetch_bundle_length <= banks);
+   return(btb2_hit);
 }
 
 
@@ -141,6 +177,42 @@ void btb_t::update(uint64_t pc, uint64_t btb_miss_bit, uint64_t btb_miss_target,
    // The entry's payload:
    btb[btb_bank][set][way].branch_type = decode(insn);
    btb[btb_bank][set][way].target = btb_miss_target;
+
+   // The second level holds every branch the first level was filled with.
+   if (btb2)
+      fill2(((pc >> 2) + btb_miss_bit), btb[btb_bank][set][way].branch_type, btb_miss_target);
+}
+
+
+void btb_t::output(FILE *fp) {
+   if (btb2)
+      fprintf(fp, "BTB2 hits        %10lu (%lu entries copied into the BTB)\n", meas_btb2_hit, meas_btb2_copy);
+}
+
+
+void btb_t::save_state(std::ostream &out) {
+   uint64_t geometry[5] = {banks, sets, assoc, sets2, assoc2};
+   out.write((const char *)geometry, sizeof(geometry));
+   for (uint64_t b = 0; b < banks; b++)
+      for (uint64_t s = 0; s < sets; s++)
+         out.write((const char *)btb[b][s], assoc * sizeof(btb_entry_t));
+   for (uint64_t s = 0; s < sets2; s++)
+      out.write((const char *)btb2[s], assoc2 * sizeof(btb_entry_t));
+}
+
+
+bool btb_t::restore_state(std::istream &in) {
+   uint64_t geometry[5];
+   in.read((char *)geometry, sizeof(geometry));
+   if (!in || (geometry[0] != banks) || (geometry[1] != sets) || (geometry[2] != assoc) ||
+       (geometry[3] != sets2) || (geometry[4] != assoc2))
+      return(false);
+   for (uint64_t b = 0; b < banks; b++)
+      for (uint64_t s = 0; s < sets; s++)
+         in.read((char *)btb[b][s], assoc * sizeof(btb_entry_t));
+   for (uint64_t s = 0; s < sets2; s++)
+      in.read((char *)btb2[s], assoc2 * sizeof(btb_entry_t));
+   return((bool)in);
 }
 
 
@@ -209,6 +281,88 @@ void btb_t::update_lru(uint64_t btb_bank, uint64_t set, uint64_t way) {
 }
 
 
+// Search the second-level BTB for the instruction at "insn_pc" (the pc shifted right by 2).
+// It outputs the "set" and "way" of either (a) the branch's entry (hit) or (b) the LRU entry.
+bool btb_t::search2(uint64_t insn_pc, uint64_t &set, uint64_t &way) {
+   uint64_t index = (insn_pc & (sets2 - 1));
+   uint64_t tag = (insn_pc >> log2sets2);
+
+   bool hit = false;
+   uint64_t hit_way = assoc2; // out-of-bounds
+   uint64_t lru_way = assoc2; // out-of-bounds
+   for (uint64_t i = 0; i < assoc2; i++) {
+      if (btb2[index][i].valid && (btb2[index][i].tag == tag)) {
+         hit = true;
+	 hit_way = i;
+	 break;
+      }
+      else if (btb2[index][i].lru == (assoc2 - 1)) {
+         lru_way = i;
+      }
+   }
+
+   set = index;
+   way = (hit ? hit_way : lru_way);
+   assert(way < assoc2);
+   return(hit);
+}
+
+
+void btb_t::update_lru2(uint64_t set, uint64_t way) {
+   // Make "way" most-recently-used.
+   for (uint64_t i = 0; i < assoc2; i++) {
+      if (btb2[set][i].lru < btb2[set][way].lru)
+         btb2[set][i].lru++;
+   }
+   btb2[set][way].lru = 0;
+}
+
+
+// Add the branch at "insn_pc" to the first level, if it is not there.  Returns true if it was added.
+bool btb_t::fill(uint64_t insn_pc, btb_branch_type_e branch_type, uint64_t target) {
+   uint64_t btb_bank = (insn_pc & (banks - 1));
+   uint64_t btb_pc = (insn_pc >> log2banks);
+   uint64_t set;
+   uint64_t way;
+
+   if (search(btb_bank, btb_pc, set, way))
+      return(false);
+   btb[btb_bank][set][way].valid = true;
+   btb[btb_bank][set][way].tag = (btb_pc >> log2sets);
+   update_lru(btb_bank, set, way);
+   btb[btb_bank][set][way].branch_type = branch_type;
+   btb[btb_bank][set][way].target = target;
+   return(true);
+}
+
+
+// Add (or rewrite) the branch at "insn_pc" in the second level.
+void btb_t::fill2(uint64_t insn_pc, btb_branch_type_e branch_type, uint64_t target) {
+   uint64_t set;
+   uint64_t way;
+
+   search2(insn_pc, set, way);
+   btb2[set][way].valid = true;
+   btb2[set][way].tag = (insn_pc >> log2sets2);
+   update_lru2(set, way);
+   btb2[set][way].branch_type = branch_type;
+   btb2[set][way].target = target;
+}
+
+
+// Copy the second level's branches in the aligned BTB2_REGION-instruction region around "insn_pc" into the first level.
+void btb_t::copy_region(uint64_t insn_pc) {
+   uint64_t region = (insn_pc & ~((uint64_t)BTB2_REGION - 1));
+   uint64_t set;
+   uint64_t way;
+
+   for (uint64_t i = region; i < (region + BTB2_REGION); i++) {
+      if (search2(i, set, way) && fill(i, btb2[set][way].branch_type, btb2[set][way].target))
+         meas_btb2_copy++;
+   }
+}
+
+
 btb_branch_type_e btb_t::decode(insn_t insn) {
    btb_branch_type_e branch_type;
    switch (insn.opcode()) {
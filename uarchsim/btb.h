@@ -50,6 +50,17 @@ private:
 
 	uint64_t cond_branch_per_cycle; // "m": maximum number of conditional branches in a fetch bundle.
 
+	// Second-level BTB (BTB2_ENTRIES > 0): larger, not banked, indexed by the instruction's pc.
+	// btb2[set][way]
+	btb_entry_t **btb2;
+	uint64_t sets2;
+	uint64_t assoc2;
+	uint64_t log2sets2;
+
+	// Measurements.
+	uint64_t meas_btb2_hit;		// # first-level misses supplied by the second level
+	uint64_t meas_btb2_copy;	// # entries copied into the first level, from the regions of second-level hits
+
 	////////////////////////////////////
 	// Private utility functions.
 	// Comments are in btb.cc.
@@ -59,11 +70,21 @@ private:
 	bool search(uint64_t btb_bank, uint64_t btb_pc, uint64_t &set, uint64_t &way);
 	void update_lru(uint64_t btb_bank, uint64_t set, uint64_t way);
 	btb_branch_type_e decode(insn_t insn);
+	bool search2(uint64_t insn_pc, uint64_t &set, uint64_t &way);
+	void update_lru2(uint64_t set, uint64_t way);
+	bool fill(uint64_t insn_pc, btb_branch_type_e branch_type, uint64_t target);
+	void fill2(uint64_t insn_pc, btb_branch_type_e branch_type, uint64_t target);
+	void copy_region(uint64_t insn_pc);
 	
 
 public:
 	btb_t(uint64_t num_entries, uint64_t banks, uint64_t assoc, uint64_t cond_branch_per_cycle);
 	~btb_t();
-	void lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t &next_pc);
+	bool lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t &next_pc);
 	void update(uint64_t pc, uint64_t btb_miss_bit, uint64_t btb_miss_target, insn_t insn);
+	void output(FILE *fp);
+	// Save/restore the BTB (both levels), for a checkpoint's warm state.
+	// restore_state() returns false, leaving the BTB as is, if the saved BTB has a different geometry.
+	void save_state(std::ostream &out);
+	bool restore_state(std::istream &in);
 };
@@ -3,31 +3,189 @@
 #pragma interface
 #include <cstdio>
 #include <cassert>
+#include <iostream>
 #include "common.h"
 #include "decode.h"
 
+#if defined(__AVX2__) && !defined(CACHE_NO_SIMD)
+#include <immintrin.h>
+#define CACHE_SIMD_TAG_COMPARE
+#endif
+
 
 #define	INVALID		-1
 
 
 ///////////////////////
-// STANDARD CACHE
+// REPLACEMENT POLICIES
 ///////////////////////
-template<class T>
-class cache {
+//
+// A replacement policy keeps its own per-way state for a size x assoc
+// array and provides:
+//   init(size, assoc)  allocate state and reset it
+//   reset()            reset state of all sets (flush)
+//   touch(set, way)    way was hit
+//   fill(set, way)     way was (re)filled on a miss
+//   victim(set)        way to replace in the set (must not change state)
+//   save(out)          write state (for a checkpoint's warm state)
+//   restore(in)        read state written by save()
+//
+
+// True LRU.  Each way holds its rank in the recency stack,
+// 0 = most recently used, assoc-1 = least recently used.
+class lru_policy {
+private:
+	unsigned int assoc;
+	unsigned int entries;
+	unsigned int* rank;
+
+public:
+	lru_policy() : assoc(0), entries(0), rank(NULL) { }
+	~lru_policy() { delete [] rank; }
+
+	void init(unsigned int size, unsigned int assoc) {
+		this->assoc = assoc;
+		this->entries = size * assoc;
+		rank = new unsigned int[entries];
+		reset();
+	}
+
+	void reset() {
+		for (unsigned int i = 0; i < entries; i++)
+			rank[i] = (i % assoc);
+	}
+
+	void touch(unsigned int set, unsigned int way) {
+		unsigned int* r = &rank[set * assoc];
+		unsigned int hit_rank = r[way];
+		for (unsigned int i = 0; i < assoc; i++) {
+			if (r[i] < hit_rank)
+				r[i] += 1;
+		}
+		r[way] = 0;
+	}
+
+	void fill(unsigned int set, unsigned int way) {
+		touch(set, way);
+	}
+
+	unsigned int victim(unsigned int set) {
+		unsigned int* r = &rank[set * assoc];
+		unsigned int i;
+		for (i = 0; i < assoc; i++) {
+			if (r[i] == (assoc-1))
+				break;
+		}
+		assert(i < assoc);
+		return(i);
+	}
+
+	void save(std::ostream& out) {
+		out.write((const char*)rank, entries * sizeof(rank[0]));
+	}
+
+	void restore(std::istream& in) {
+		in.read((char*)rank, entries * sizeof(rank[0]));
+	}
+};
+
+// Tree pseudo-LRU.  One bit per internal node of a binary tree over
+// the ways (assoc-1 bits per set); assoc must be a power of 2.
+// Each bit points towards the less recently used half.
+class plru_policy {
 private:
-	// The cache is a 2-D array of entries, each entry
-	// is a tag + lru + pointer to object of type T.
+	unsigned int assoc;
+	unsigned int size;
+	bool* bits;
+
+public:
+	plru_policy() : assoc(0), size(0), bits(NULL) { }
+	~plru_policy() { delete [] bits; }
+
+	void init(unsigned int size, unsigned int assoc) {
+		assert( IsPow2(assoc) );
+		this->assoc = assoc;
+		this->size = size;
+		bits = new bool[size * assoc];
+		reset();
+	}
+
+	void reset() {
+		for (unsigned int i = 0; i < size * assoc; i++)
+			bits[i] = false;
+	}
+
+	void touch(unsigned int set, unsigned int way) {
+		bool* b = &bits[set * assoc];
+		unsigned int node = 1;
+		for (unsigned int half = (assoc >> 1); half > 0; half >>= 1) {
+			bool right = ((way & half) != 0);
+			b[node] = !right;	// point away from the way just used
+			node = (node << 1) | (right ? 1 : 0);
+		}
+	}
+
+	void fill(unsigned int set, unsigned int way) {
+		touch(set, way);
+	}
+
+	unsigned int victim(unsigned int set) {
+		bool* b = &bits[set * assoc];
+		unsigned int node = 1;
+		unsigned int way = 0;
+		for (unsigned int half = (assoc >> 1); half > 0; half >>= 1) {
+			if (b[node])
+				way |= half;
+			node = (node << 1) | (b[node] ? 1 : 0);
+		}
+		return(way);
+	}
+
+	void save(std::ostream& out) {
+		out.write((const char*)bits, size * assoc * sizeof(bits[0]));
+	}
+
+	void restore(std::istream& in) {
+		in.read((char*)bits, size * assoc * sizeof(bits[0]));
+	}
+};
 
-	typedef
-	struct {
-		reg_t tag;
-		unsigned int lru;
-		T* contents;
-	} entry;
 
-	entry**	C;
+///////////////////////
+// STANDARD CACHE
+///////////////////////
+//
+// The cache is a flat size x assoc array kept as structure-of-arrays:
+// one contiguous array of tags and one of line state (T, held by value),
+// both indexed by set*assoc + way, plus whatever per-way state the
+// replacement policy R keeps.  Nothing is allocated after construction.
+//
+template<class T, class R = lru_policy>
+class cache {
+private:
+	reg_t*	tags;
+	T*	lines;
+	R	policy;
 
+	// Returns the way holding 'id' in the set starting at 'set_tags',
+	// or assoc if not present.
+	inline unsigned int find_way(const reg_t* set_tags, reg_t id) {
+		unsigned int i = 0;
+#ifdef CACHE_SIMD_TAG_COMPARE
+		__m256i key = _mm256_set1_epi64x((long long)id);
+		for (; (i + 4) <= assoc; i += 4) {
+			__m256i t = _mm256_loadu_si256((const __m256i*)&set_tags[i]);
+			int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t, key)));
+			if (mask)
+				return(i + __builtin_ctz(mask));
+		}
+#endif
+		for (; i < assoc; i++) {
+			if (set_tags[i] == id)
+				return(i);
+		}
+		return(assoc);
+	}
 
 public:
 	// size = number of entries deep
@@ -40,32 +198,23 @@ public:
 
 	// constructor
 	cache(unsigned int size, unsigned int assoc) {
-		unsigned int i,j;
-
 		// First ensure that 'size' is a power of 2.
 		assert( IsPow2(size) );
 
-		C = new entry *[size];
-		for (i = 0; i < size; i++) {
-			C[i] = new entry[assoc];
-			for (j = 0; j < assoc; j++) {
-				C[i][j].tag = INVALID;
-				C[i][j].lru = j;
-				C[i][j].contents = (T*)NULL;
-			}
-		}
-
 		this->size = size;
 		this->assoc = assoc;
 		this->num_misses = 0;
+
+		tags = new reg_t[size * assoc];
+		lines = new T[size * assoc];
+		policy.init(size, assoc);
+		flush();
 	}
 
 	// destructor
 	~cache() {
-		//unsigned int i;
-		//for (i = 0; i < size; i++)
-		//   delete C[i];
-		//delete C;
+		delete [] tags;
+		delete [] lines;
 	}
 
 	//
@@ -74,28 +223,62 @@ public:
 	// Added by Quinn Jacobson, October 7, 1998.
 	//
 	void flush() {
-		unsigned int i,j;
-
-		for (i = 0; i < size; i++) {
-			for (j = 0; j < assoc; j++) {
-				C[i][j].tag = INVALID;
-				C[i][j].lru = j;
-				C[i][j].contents = (T*)NULL;
-			}
+		for (unsigned int i = 0; i < size * assoc; i++) {
+			tags[i] = INVALID;
+			lines[i] = T();
 		}
+		policy.reset();
+	}
+
+	// Whether a tag returned through 'old_id' names a real line.
+	static bool valid(reg_t id) {
+		return(id != (reg_t)INVALID);
+	}
+
+	// Line state by flat index (set*assoc + way), 0 <= i < size*assoc.
+	T& line(unsigned int i) {
+		return(lines[i]);
+	}
+
+	// Save/restore the whole array (tags, line state, replacement state),
+	// for a checkpoint's warm state.  T is copied as raw bytes.
+	// restore() returns false, leaving the array as is, if the saved
+	// array has a different geometry.
+	void save(std::ostream& out) {
+		out.write((const char*)&size, sizeof(size));
+		out.write((const char*)&assoc, sizeof(assoc));
+		out.write((const char*)tags, size * assoc * sizeof(tags[0]));
+		out.write((const char*)lines, size * assoc * sizeof(lines[0]));
+		policy.save(out);
+	}
+
+	bool restore(std::istream& in) {
+		unsigned int saved_size, saved_assoc;
+		in.read((char*)&saved_size, sizeof(saved_size));
+		in.read((char*)&saved_assoc, sizeof(saved_assoc));
+		if (!in || (saved_size != size) || (saved_assoc != assoc))
+			return(false);
+		in.read((char*)tags, size * assoc * sizeof(tags[0]));
+		in.read((char*)lines, size * assoc * sizeof(lines[0]));
+		policy.restore(in);
+		return((bool)in);
 	}
 
 
 	// Cache lookup and maintenance.
 	// Inputs:
 	//   (1) object id
-	//   (2) pointer to object's contents
-	//   (3) replace the entry on a cache miss
+	//   (2) replace the entry on a cache miss
 	// Outputs:
 	//   (1) hit
 	//   (2) old object id (i.e. id that was replaced, if miss)
-	//   (3) return value: pointer to old object's contents
-	T* lookup(reg_t id, T* contents,
+	//   (3) return value: the line's state in the array.
+	//       On a hit this is the hit line.  On a miss it is the victim
+	//       way; it still holds the victim's state, which the caller
+	//       must read out before overwriting it with the new line's
+	//       state when 'replace' is set.  Use valid(*old_id) to tell
+	//       whether the victim way held a line at all.
+	T* lookup(reg_t id,
 	          bool* hit, reg_t* old_id,
 	          bool replace,
 	          bool use_raw_index = false,
@@ -103,88 +286,47 @@ public:
 };
 
 
-template<class T>
-T* cache<T>::lookup(reg_t id, T* contents,
-                    bool* hit, reg_t* old_id,
-                    bool replace,
-                    bool use_raw_index, unsigned int raw_index) {
+template<class T, class R>
+T* cache<T,R>::lookup(reg_t id,
+                      bool* hit, reg_t* old_id,
+                      bool replace,
+                      bool use_raw_index, unsigned int raw_index) {
 	unsigned int index;
-	entry* set;
-	unsigned int i;
-	bool found;
-	unsigned int hit_way;
-	int replace_way;
-	T* old_contents;
+	unsigned int base;
+	unsigned int way;
 
 	index = MOD((use_raw_index ? raw_index : id), size);
-	set = C[index];
-
-	i = 0;
-	found = false;
-	while (i < assoc && !found) {
-		if (set[i].tag == id) {
-			found = true;
-		}
-		else {
-			i += 1;
-		}
-	}
+	base = index * assoc;
 
-	if (found) {
-		hit_way = i;
+	way = find_way(&tags[base], id);
 
-		// Update LRU state.
-		for (i = 0; i < assoc; i++) {
-			if (set[i].lru < set[hit_way].lru) {
-				set[i].lru += 1;
-			}
-		}
-		set[hit_way].lru = 0;
+	if (way < assoc) {
+		// Update replacement state.
+		policy.touch(index, way);
 
 		// Set outputs of function.
 		*hit = true;
-		*old_id = set[hit_way].tag;
-		old_contents = set[hit_way].contents;
+		*old_id = tags[base + way];
 	}
 	else {
 		// record the miss
 		num_misses += 1;
 
-		// Find replacement entry, and update LRU state.
-		replace_way = -1;
-		if (replace) {
-			for (i = 0; i < assoc; i++) {
-				if (set[i].lru == (assoc-1)) {	// least-recently used
-					replace_way = (int)i;
-					set[i].lru = 0;
-				}
-				else {
-					set[i].lru += 1;
-				}
-			}
-		}
-		else {
-			for (i = 0; i < assoc; i++) {
-				if (set[i].lru == (assoc-1)) {	// least-recently used
-					replace_way = (int)i;
-				}
-			}
-		}
-		assert(replace_way != -1);
+		// Find replacement entry, and update replacement state.
+		way = policy.victim(index);
+		if (replace)
+			policy.fill(index, way);
 
 		// Set outputs of function.
 		*hit = false;
-		*old_id = set[replace_way].tag;
-		old_contents = set[replace_way].contents;
+		*old_id = tags[base + way];
 
 		// Perform the actual replacement.
-		if (replace) {
-			set[replace_way].tag = id;
-			set[replace_way].contents = contents;
-		}
+		if (replace)
+			tags[base + way] = id;
 	}
 
-	return(old_contents);
+	return(&lines[base + way]);
 }
 
 
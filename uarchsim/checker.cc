@@ -23,24 +23,17 @@ void pipeline_t::check_double(reg_t micro0, reg_t micro1, reg_t isa0, reg_t isa1
    }
 }
 
-void pipeline_t::check_state(state_t* micro_state, state_t* isa_state, db_t* actual) {
+// Only the registers recorded in db_state_t are checked.
+void pipeline_t::check_state(state_t* micro_state, db_state_t* isa_state, db_t* actual) {
    bool fail = false;
 
-   //if(micro_state->epc               !=  isa_state->epc              ) fail = true;
    if(micro_state->badvaddr          !=  isa_state->badvaddr         ) fail = true;
-   //if(micro_state->evec              !=  isa_state->evec             ) fail = true;
-   //if(micro_state->ptbr              !=  isa_state->ptbr             ) fail = true;
-   //if(micro_state->pcr_k0            !=  isa_state->pcr_k0           ) fail = true;
-   //if(micro_state->pcr_k1            !=  isa_state->pcr_k1           ) fail = true;
-   //if(micro_state->cause             !=  isa_state->cause            ) fail = true;
    if(micro_state->tohost            !=  isa_state->tohost           ) fail = true;
    if(micro_state->fromhost          !=  isa_state->fromhost         ) fail = true;
    if(micro_state->count             !=  isa_state->count            ) fail = true;
-   //if(micro_state->compare           !=  isa_state->compare          ) fail = true;
    if(micro_state->sr                !=  isa_state->sr               ) fail = true;
    if(micro_state->fflags            !=  isa_state->fflags           ) fail = true;
    if(micro_state->frm               !=  isa_state->frm              ) fail = true;
-   //if(micro_state->load_reservation  !=  isa_state->load_reservation ) fail = true;
 
    if (fail) {
       #ifdef RISCV_MICRO_DEBUG
@@ -51,7 +44,7 @@ void pipeline_t::check_state(state_t* micro_state, state_t* isa_state, db_t* act
         fprintf(stderr,"\nState for isa_sim:\n");
         pipe->dump(this, actual, stderr);
       #endif
-      isa_state->dump(stderr);
+      pipe->dump_state(actual, stderr);
       printf("Instruction %.0f, Cycle %.0f: State check failed.\n", (double)num_insn, (double)cycle);
       assert(0);
    }
@@ -80,7 +73,7 @@ void pipeline_t::checker() {
 	 // Validate the instruction PC.
 	 check_single(PAY.buf[head].pc, actual->a_pc, actual, "PC mismatch.");
 
-   check_state(this->get_state(),actual->a_state,actual);
+   check_state(this->get_state(),&actual->a_state,actual);
 
    // If an architectural exception
    // Make sure that MICRO_SIM also excepts but
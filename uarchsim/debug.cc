@@ -1,30 +1,26 @@
 #include <cassert>
+#include <algorithm>
 #include "debug.h"
 #include "sim.h"
 //#include "processor.h"
 #include "pipeline.h"
+#include "parameters.h"
 extern bool logging_on;
 
-// Checks to see if index 'e' lies between 'head' and 'tail'.
+// Checks to see if index 'e' lies in the active window, i.e., among the
+// 'length' entries starting at 'head'.  (The producer may be past the end
+// of the window, so 'tail' is not its end.)
 bool debug_buffer_t::is_active(unsigned int e) {
-   if (length > 0) {
-      if (head <= tail)
-         return((e >= head) && (e <= tail));
-      else
-         return((e >= head) || (e <= tail));
-   }
-   else {
-      return(false);
-   }
+   return(MOD((e + DEBUG_SIZE - head), DEBUG_SIZE) < length);
 }
 
 
 debug_buffer_t::debug_buffer_t(unsigned int window_size) {
    // Set the full size and active size of the debug buffer.
    // Both had better be a power of two.
-   // DEBUG_SIZE = 4*window_size;
-   // ACTIVE_SIZE = 2*window_size;
-   DEBUG_SIZE   = window_size; 
+   // The timing simulator sees an active window of window_size entries;
+   // the rest of the buffer is slack for a producer thread to run ahead.
+   DEBUG_SIZE   = 4*window_size;
    ACTIVE_SIZE  = window_size;
    assert(IsPow2(DEBUG_SIZE) && IsPow2(ACTIVE_SIZE));
 
@@ -33,8 +29,13 @@ debug_buffer_t::debug_buffer_t(unsigned int window_size) {
 
    for(unsigned int i=0;i<DEBUG_SIZE;i++){
      db[i].entry_id = i;
-     db[i].a_state = new state_t;
-     db[i].a_state->reset();
+   }
+
+   snapshot = new state_t[(DEBUG_SIZE + DB_SNAPSHOT_INTERVAL - 1) / DB_SNAPSHOT_INTERVAL];
+   snapshot_seq = new uint64_t[(DEBUG_SIZE + DB_SNAPSHOT_INTERVAL - 1) / DB_SNAPSHOT_INTERVAL];
+   for(unsigned int i=0;i<((DEBUG_SIZE + DB_SNAPSHOT_INTERVAL - 1) / DB_SNAPSHOT_INTERVAL);i++){
+     snapshot[i].reset();
+     snapshot_seq[i] = 0;
    }
 
    // Initialize debug buffer.
@@ -42,27 +43,100 @@ debug_buffer_t::debug_buffer_t(unsigned int window_size) {
    tail = (DEBUG_SIZE - 1);
    length = 0;
 
+   started = 0;
+   produced = 0;
+   consumed = 0;
+   producer_done = false;
+   producer_stop = false;
+   threaded = false;
+   window_ready = false;
+
    pc_ptr = 0;
    inst_sequence = 0;
+   isa_sim = NULL;
 }
 
 debug_buffer_t::~debug_buffer_t() {
+   stop();
+   delete [] db;
+   delete [] snapshot;
+   delete [] snapshot_seq;
 }
 
-void debug_buffer_t::run_ahead(){
-  fprintf(stderr, "Functional simulator running ahead\n");
-  // Set to debug mode so that simulator single steps
+void debug_buffer_t::run_ahead(std::function<sim_t*()> init){
+  // CHECKER_THREAD: 0 = no thread, 1 = thread if the host has more than one
+  // hardware thread, 2 = always a thread.
+  threaded = ((CHECKER_THREAD == 2) || ((CHECKER_THREAD == 1) && (std::thread::hardware_concurrency() > 1)));
+
+  fprintf(stderr, "Functional simulator running ahead%s\n", (threaded ? " on its own thread" : ""));
+  if (threaded) {
+    producer = std::thread(&debug_buffer_t::producer_main, this, init);
+  }
+  else {
+    isa_sim = init();
+    // Set to debug mode so that simulator single steps
+    isa_sim->set_procs_debug(true);
+    // Set to checker mode so that instructions are pushed to 
+    // debug buffer
+    isa_sim->set_procs_checker(true);
+    fill();
+  }
+}
+
+// Step the functional simulator one instruction at a time, each filling one
+// debug buffer entry, until the buffer is full or the simulator stops.
+void debug_buffer_t::fill(){
+  while(hungry() && isa_sim->running()){
+    ifprintf(logging_on,stderr, "Functional simulator hungry\n");
+    isa_sim->step(1);
+    produced.store(started, std::memory_order_release);
+  }
+}
+
+// The producer thread.
+void debug_buffer_t::producer_main(std::function<sim_t*()> init){
+  isa_sim = init();
   isa_sim->set_procs_debug(true);
-  // Set to checker mode so that instructions are pushed to 
-  // debug buffer
   isa_sim->set_procs_checker(true);
-  while(hungry()){
+
+  while (!producer_stop.load(std::memory_order_acquire)) {
+    if (!hungry()) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (!isa_sim->running())
+      break;
     ifprintf(logging_on,stderr, "Functional simulator hungry\n");
     isa_sim->step(1);
+    produced.store(started, std::memory_order_release);
   }
+  producer_done.store(true, std::memory_order_release);
+}
+
+// The timing simulator must see the same active window as if the functional
+// simulator ran in lockstep with it: full, unless the functional simulator stopped.
+// The producer may have completed more entries than that; they stay hidden.
+void debug_buffer_t::wait_window(){
+  uint64_t c = consumed.load(std::memory_order_relaxed);
+  uint64_t limit = (ACTIVE_SIZE + (c ? (c - 1) : 0));
+
+  if (threaded) {
+    while ((produced.load(std::memory_order_acquire) < limit) &&
+           !producer_done.load(std::memory_order_acquire))
+      std::this_thread::yield();
+  }
+  length = (unsigned int)(std::min(produced.load(std::memory_order_acquire), limit) - c);
+  window_ready = true;
+}
+
+void debug_buffer_t::stop(){
+  producer_stop.store(true, std::memory_order_release);
+  if (producer.joinable())
+    producer.join();
 }
 
 void debug_buffer_t::skip_till_pc(reg_t pc, unsigned int proc_id){
+  assert(!threaded);
   ifprintf(logging_on,stderr, "Functional simulator skipping till PC %" PRIreg "\n",pc);
   bool old_debug = isa_sim->get_procs_debug();
   // Set to debug mode so that simulator single steps
@@ -74,16 +148,16 @@ void debug_buffer_t::skip_till_pc(reg_t pc, unsigned int proc_id){
 }
 
 void debug_buffer_t::start() {
-   // Check for overflow and maintain 'length'.
-   assert(length < ACTIVE_SIZE);
-   length += 1;
+   // Check for overflow.
+   assert(hungry());
+   started += 1;
 
    // Initialize a new debug entry.
    tail = MOD((tail + 1), DEBUG_SIZE);
 
    assert(db[tail].entry_id == tail);
 
-   db[head].a_valid = true;
+   db[tail].a_valid = true;
    db[tail].a_exception   = false;
    db[tail].a_num_rdst = 0;
    db[tail].a_num_rsrc = 0;
@@ -225,52 +299,20 @@ void debug_buffer_t::push_exception_actual(reg_t handler_pc){
 
 void debug_buffer_t::push_state_actual(state_t* a_state_ptr,bool checkpoint_state){
 
-  // Checkpoint the entire system state
-  if(checkpoint_state){
-
-    for(size_t i = 0;i < NXPR;i++){
-      db[tail].a_state->XPR.write(i,a_state_ptr->XPR[i]);
-    }
-    for(size_t i = 0;i < NFPR;i++){
-      db[tail].a_state->FPR.write(i,a_state_ptr->FPR[i]);
-    }
-
-    db[tail].a_state->epc               =  a_state_ptr->epc;
-    db[tail].a_state->badvaddr          =  a_state_ptr->badvaddr;
-    db[tail].a_state->evec              =  a_state_ptr->evec;
-    db[tail].a_state->ptbr              =  a_state_ptr->ptbr;
-    db[tail].a_state->pcr_k0            =  a_state_ptr->pcr_k0;
-    db[tail].a_state->pcr_k1            =  a_state_ptr->pcr_k1;
-    db[tail].a_state->cause             =  a_state_ptr->cause;
-    db[tail].a_state->tohost            =  a_state_ptr->tohost;
-    db[tail].a_state->fromhost          =  a_state_ptr->fromhost;
-    db[tail].a_state->count             =  a_state_ptr->count;
-    db[tail].a_state->compare           =  a_state_ptr->compare;
-    db[tail].a_state->sr                =  a_state_ptr->sr;
-    db[tail].a_state->fflags            =  a_state_ptr->fflags;
-    db[tail].a_state->frm               =  a_state_ptr->frm;
-    db[tail].a_state->load_reservation  =  a_state_ptr->load_reservation;
-
-  } 
-  // Checkpoint only state necessary for checking
-  else 
-  {
-
-    //db[tail].a_state->epc               =  a_state_ptr->epc;
-    db[tail].a_state->badvaddr          =  a_state_ptr->badvaddr;
-    //db[tail].a_state->evec              =  a_state_ptr->evec;
-    //db[tail].a_state->ptbr              =  a_state_ptr->ptbr;
-    //db[tail].a_state->pcr_k0            =  a_state_ptr->pcr_k0;
-    //db[tail].a_state->pcr_k1            =  a_state_ptr->pcr_k1;
-    //db[tail].a_state->cause             =  a_state_ptr->cause;
-    db[tail].a_state->tohost            =  a_state_ptr->tohost;
-    db[tail].a_state->fromhost          =  a_state_ptr->fromhost;
-    db[tail].a_state->count             =  a_state_ptr->count;
-    //db[tail].a_state->compare           =  a_state_ptr->compare;
-    db[tail].a_state->sr                =  a_state_ptr->sr;
-    db[tail].a_state->fflags            =  a_state_ptr->fflags;
-    db[tail].a_state->frm               =  a_state_ptr->frm;
-    //db[tail].a_state->load_reservation  =  a_state_ptr->load_reservation;
+  // Record only the state necessary for checking.
+  db[tail].a_state.badvaddr          =  a_state_ptr->badvaddr;
+  db[tail].a_state.tohost            =  a_state_ptr->tohost;
+  db[tail].a_state.fromhost          =  a_state_ptr->fromhost;
+  db[tail].a_state.count             =  a_state_ptr->count;
+  db[tail].a_state.sr                =  a_state_ptr->sr;
+  db[tail].a_state.fflags            =  a_state_ptr->fflags;
+  db[tail].a_state.frm               =  a_state_ptr->frm;
+
+  // Checkpoint the entire system state, periodically or if asked to.
+  if(checkpoint_state || ((tail & (DB_SNAPSHOT_INTERVAL - 1)) == 0)){
+    unsigned int s = (tail / DB_SNAPSHOT_INTERVAL);
+    snapshot[s] = *a_state_ptr;
+    snapshot_seq[s] = db[tail].a_sequence;
   }
 }
 
@@ -280,6 +322,7 @@ void debug_buffer_t::push_state_actual(state_t* a_state_ptr,bool checkpoint_stat
 db_t* debug_buffer_t::pop(debug_index_t i) {
 
    ifprintf(logging_on,stderr, "Timing simulator popping entry %u\n",i);
+   sync();
    assert(i == head);
 
    // Set the valid bit to 0 so that perfect branch prediction
@@ -287,21 +330,21 @@ db_t* debug_buffer_t::pop(debug_index_t i) {
    // program.
    db[head].a_valid = false;
 
-
-   // Fill out the debug buffer
-   // Make sure the simulator is still running and is not already 
-   // done with the program.
-   while(hungry() && isa_sim->running()){
-    ifprintf(logging_on,stderr, "Functional simulator hungry\n");
-     isa_sim->step(1);
-   }
-
    // Check for underflow and maintain 'length'.
    assert(length > 0);
    length -= 1;
 
    // Pop the head entry by advancing head pointer.
+   // This frees the slot of the previously popped entry for the producer.
    head = MOD((head + 1), DEBUG_SIZE);
+   consumed.store(consumed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+   window_ready = false;
+
+   // Fill out the debug buffer
+   // Make sure the simulator is still running and is not already 
+   // done with the program.
+   if (!threaded)
+     fill();
 
 
    // Return a pointer to (what was) the head entry.
@@ -318,6 +361,8 @@ debug_index_t debug_buffer_t::check_next(debug_index_t i, reg_t pc) {
 
    unsigned int e;
 
+   sync();
+
    // get the next entry
    e = MOD((i + 1), DEBUG_SIZE);
 
@@ -334,6 +379,8 @@ debug_index_t debug_buffer_t::find(debug_index_t i, reg_t pc) {
 
    unsigned int e;
 
+   sync();
+
    // Get the next entry.
    e = MOD((i + 1), DEBUG_SIZE);
 
@@ -386,3 +433,31 @@ void debug_buffer_t::dump(pipeline_t* proc, db_t* actual, FILE* file)
   ifprintf(logging_on,file,"\n");
 } 
 
+// Print the functional simulator's state recorded for 'actual', followed by
+// the most recent full snapshot at or before it, if it has not been reused yet.
+// The producer is stopped first, so that the snapshot is stable.
+void debug_buffer_t::dump_state(db_t* actual, FILE* file)
+{
+  unsigned int s = (actual->entry_id / DB_SNAPSHOT_INTERVAL);
+
+  stop();
+
+  fprintf(file,"badvaddr : 0x%8lx\t",actual->a_state.badvaddr);
+  fprintf(file,"tohost   : 0x%8lx\t",actual->a_state.tohost  );
+  fprintf(file,"fromhost : 0x%8lx\t",actual->a_state.fromhost);
+  fprintf(file,"count    :   %8lu\t",actual->a_state.count   );
+  fprintf(file,"\n");
+  fprintf(file,"sr       : 0x%8x\t" ,actual->a_state.sr      );
+  fprintf(file,"fflags   : 0x%8x\t" ,actual->a_state.fflags  );
+  fprintf(file,"frm      : 0x%8x\t" ,actual->a_state.frm     );
+  fprintf(file,"\n");
+  if ((snapshot_seq[s] != 0) && (snapshot_seq[s] <= actual->a_sequence)) {
+    fprintf(file,"Full state after instruction %lu (%lu before this one):\n",
+            snapshot_seq[s], (actual->a_sequence - snapshot_seq[s]));
+    snapshot[s].dump(file);
+  }
+  else {
+    fprintf(file,"\n");
+  }
+}
+
@@ -3,6 +3,9 @@
 
 #include <cstdio>
 #include <cassert>
+#include <atomic>
+#include <thread>
+#include <functional>
 #include "common.h"
 #include "decode.h"
 
@@ -20,6 +23,11 @@ struct state_t;
 
 #define valid_debug_index(x) ((size_t)x != (size_t)DEBUG_INDEX_INVALID)
 
+// A full copy of the functional simulator's state is kept for one of every
+// DB_SNAPSHOT_INTERVAL debug buffer entries, for diagnosing checker failures.
+// Must be a power of two.
+#define DB_SNAPSHOT_INTERVAL	64
+
 ///////////////
 // TYPES
 ///////////////
@@ -45,6 +53,19 @@ typedef union {
 	unsigned char bytes[8];
 } store_data_t;
 
+// The part of the functional simulator's state recorded for every instruction:
+// the registers compared by pipeline_t::check_state(), and fflags, which the
+// timing simulator copies at retirement.
+typedef struct {
+  reg_t     badvaddr;
+  reg_t     tohost;
+  reg_t     fromhost;
+  reg_t     count;
+  uint32_t  sr;
+  uint32_t  fflags;
+  uint32_t  frm;
+} db_state_t;
+
 typedef struct {
 
   uint64_t      entry_id;
@@ -78,7 +99,7 @@ typedef struct {
 	// and can be accessed either as words or individual bytes.
 	store_data_t    store_data;
 
-  state_t*  a_state;
+  db_state_t  a_state;
 
 	// STATS
 	unsigned int why_vector;
@@ -99,10 +120,26 @@ private:
 	unsigned int DEBUG_SIZE;
 	unsigned int ACTIVE_SIZE;
 
+	// The debug buffer is a single-producer/single-consumer ring.
+	// The producer is the functional simulator, which may run on its own
+	// thread (see run_ahead()); it starts and fills entries at 'tail'.
+	// The consumer is the timing simulator, which sees the 'length'
+	// completed entries starting at 'head'.
 	db_t* db;
-	debug_index_t head;
-	debug_index_t tail;
-	unsigned int  length;
+	state_t* snapshot;		// full state after entry 'snapshot_seq', one per DB_SNAPSHOT_INTERVAL entries
+	uint64_t* snapshot_seq;
+	debug_index_t head;	// consumer
+	debug_index_t tail;	// producer
+	unsigned int  length;	// consumer: number of entries in the active window
+
+	uint64_t started;			// producer: number of entries started
+	std::atomic<uint64_t> produced;		// number of entries completed by the producer
+	std::atomic<uint64_t> consumed;		// number of entries popped by the consumer
+	std::atomic<bool> producer_done;	// the producer will not complete any more entries
+	std::atomic<bool> producer_stop;	// tell the producer thread to exit
+	bool threaded;				// the producer runs on its own thread
+	bool window_ready;			// consumer: active window is complete since the last pop()
+	std::thread producer;
 
   uint64_t    inst_sequence;
 
@@ -115,9 +152,20 @@ private:
   // PRIVATE FUNCTIONS
   ///////////////////////
 
-  // Checks to see if index 'e' lies between 'head' and 'tail'.
+  // Checks to see if index 'e' lies in the active window.
   bool is_active(unsigned int e);
 
+  // Producer: step the functional simulator until the buffer is full or it stops.
+  void fill();
+  void producer_main(std::function<sim_t*()> init);
+
+  // Consumer: wait until the producer has filled the active window.
+  void wait_window();
+  inline void sync() {
+    if (!window_ready)
+      wait_window();
+  }
+
 public:
 	///////////////
 	// INTERFACE
@@ -126,17 +174,25 @@ public:
 	debug_buffer_t(unsigned int window_size);
 	~debug_buffer_t();
 
-  void set_isa_sim(sim_t* _isa_sim){ isa_sim = _isa_sim; }
-  void run_ahead();
+  // Create the functional simulator by calling 'init' and fill the debug buffer.
+  // With CHECKER_THREAD, this is done on a dedicated producer thread that keeps
+  // the buffer full ahead of the timing simulator; 'init' runs on that thread
+  // because the functional simulator's HTIF is bound to the thread that creates it.
+  void run_ahead(std::function<sim_t*()> init);
+  void stop();
   void skip_till_pc(reg_t pc, unsigned int proc_id);
 
 	//////////////////////////////////////////////////////////////
 	// Interface for collecting functional simulator state.
 	//////////////////////////////////////////////////////////////
 
+	// The producer may run ahead by the whole buffer, beyond the active
+	// window. The entry popped last is still being read by the timing
+	// simulator, so its slot is not reused until the next pop.
 	inline	bool hungry() {
-    ifprintf(logging_on,stderr, "Debug buffer head: %u tail %u length %u active size %u\n",head,tail,length,ACTIVE_SIZE);
-	   return(length < ACTIVE_SIZE);
+	   uint64_t c = consumed.load(std::memory_order_acquire);
+	   ifprintf(logging_on,stderr, "Debug buffer tail %u started %lu consumed %lu size %u\n",tail,started,c,DEBUG_SIZE);
+	   return(started < (DEBUG_SIZE + (c ? (c - 1) : 0)));
 	}
 
 	void start();
@@ -155,6 +211,7 @@ public:
 	// value equal to 'pc'.
 	// Then return the index of the head entry.
 	inline debug_index_t first(reg_t pc) {
+	   sync();
 	   assert(pc == db[head].a_pc);
 	   return(head);
 	}
@@ -178,11 +235,13 @@ public:
 	// Return a pointer to the contents of an arbitrary debug buffer entry.
 	// The debug buffer entry must be in the 'active window' of the buffer.
 	inline	db_t *peek(debug_index_t i) {
+	   sync();
 	   assert(is_active(i));
 	   return( &(db[i]) );
 	}
 
 	inline	bool empty() {
+	   sync();
 	   return(length == 0);
 	}
 
@@ -193,15 +252,18 @@ public:
 	//////////////////////////////////////////////////////////////
 
 	inline	reg_t pop_pc() {
+	   sync();
 	   // Return PC of *next* instruction.
 	   pc_ptr = MOD((pc_ptr + 1), DEBUG_SIZE);
 	   return(db[pc_ptr].a_pc);
 	}
 
 	inline	bool pop_pc_valid() {
+	   sync();
 	   // Return PC valid of *next* instruction.
+	   // (Entries past the active window may still be in the producer's hands.)
 	   unsigned int ptr = MOD((pc_ptr + 1), DEBUG_SIZE);
-	   return(db[ptr].a_valid);
+	   return(is_active(ptr) && db[ptr].a_valid);
 	}
 
 	inline	void recover_pc_ptr(reg_t recover_PC) {
@@ -237,6 +299,7 @@ public:
 
 
   void dump(pipeline_t* proc, db_t* actual, FILE* file); 
+  void dump_state(db_t* actual, FILE* file);
 };
 
 
@@ -5,6 +5,7 @@ void pipeline_t::decode() {
 	unsigned int i;
 	unsigned int index;
 	insn_t inst;
+	predecode_t d;
 
 	// Stall the Decode Stage if there is not enough space in the Fetch Queue for 2x the fetch bundle width.
 	// The factor of 2x assumes that each instruction in the fetch bundle is split, in the worst case.
@@ -38,351 +39,401 @@ void pipeline_t::decode() {
 
     LOG(decode_log,cycle,PAY.buf[index].sequence,PAY.buf[index].pc,"Instruction: %08" PRIX32 "",(word_t)inst.bits());
 
-		// Set checkpoint flag.
-		switch (inst.opcode()) {
-			case OP_JAL:
-			case OP_JALR:
-			case OP_BRANCH:
-				PAY.buf[index].checkpoint = true;
-				break;
-
-			default:
-				PAY.buf[index].checkpoint = false;
-				break;
+		// Set the decode-stage fields, unless the trace cache already supplied them.
+		if (!PAY.buf[index].predecoded) {
+			predecode(inst, d);
+			PAY.set_decode(index, d);
 		}
 
-		// Set flags  and function units
-		switch(inst.opcode()) {
-
-			case OP_JAL:
-			case OP_JALR:
-				PAY.buf[index].flags = (F_CTRL|F_UNCOND);
-				PAY.buf[index].fu = FU_BR;
-				break;
-
-			case OP_BRANCH:
-				PAY.buf[index].flags = (F_CTRL|F_COND);
-				PAY.buf[index].fu = FU_BR;
-				break;
-
-			case OP_LOAD:
-				PAY.buf[index].flags = (F_MEM|F_LOAD|F_DISP);
-				PAY.buf[index].fu = FU_LS;
-				break;
-
-			case OP_STORE:
-				PAY.buf[index].flags = (F_MEM|F_STORE|F_DISP);
-				PAY.buf[index].fu = FU_LS;
-				break;
-
-			case OP_OP:
-			case OP_OP_32:  // valid only in 64bit mode - illegal inst exception in 32 bit mode
-				PAY.buf[index].flags = (F_ICOMP);
-				PAY.buf[index].fu = FU_ALU_S;
-
-				if(inst.funct7() == FN7_MULDIV) {
-					PAY.buf[index].flags = (F_ICOMP|F_LONGLAT);
-					PAY.buf[index].fu = FU_ALU_C;
-				}
-				break;
-
-			case OP_OP_IMM:
-			case OP_OP_IMM_32: // valid only in 64bit mode - illegal inst exception in 32 bit mode
-			case OP_LUI:
-			case OP_AUIPC:
-				PAY.buf[index].flags = (F_ICOMP);
-				PAY.buf[index].fu = FU_ALU_S;
-				break;
+		// 3/20/19: Fix for checker.
+		// A NOP's x0 source operand is never read, since the NOP skips the IQ.
+		if (inst.bits() == INSN_NOP)
+			PAY.buf[index].A_value.dw = 0;
+
+		// Insert one or two instructions into the Fetch Queue (indices).
+		FQ.push(index);
+		if (PAY.buf[index].split) {
+      // Should not come here in current 721sim, with unified int/fp pipeline.
+      // Will need this functionality for split-stores, however.
+      assert(0);
+			assert(PAY.buf[index+1].split);
+			assert(PAY.buf[index].upper);
+			assert(!PAY.buf[index+1].upper);
+			FQ.push(index+1);
+		}
+
+
+    #ifdef RISCV_MICRO_DEBUG
+      // Dump debug info if needed
+      //Pass a pointer to the processor
+    
+      PAY.dump(this,index,decode_log);
+    #endif
+
+
+	}
+}
+
+
+// Derive the decode-stage fields of an instruction from its bits alone.
+// Used by the Decode Stage, and by the trace cache to predecode the
+// instructions of a trace when it is filled.
+void predecode(insn_t inst, predecode_t &d) {
+	// Fields that are not set for every opcode, below.
+	d.flags = 0;
+	d.fu = FU_ALU_S;
+	d.A_log_reg = 0;
+	d.B_log_reg = 0;
+	d.C_log_reg = 0;
+	d.D_log_reg = 0;
+	d.CSR_addr = 0;
+	d.size = 0;
+	d.is_signed = false;
+
+	// Set checkpoint flag.
+	switch (inst.opcode()) {
+		case OP_JAL:
+		case OP_JALR:
+		case OP_BRANCH:
+			d.checkpoint = true;
+			break;
+
+		default:
+			d.checkpoint = false;
+			break;
+	}
+
+	// Set flags  and function units
+	switch(inst.opcode()) {
+
+		case OP_JAL:
+		case OP_JALR:
+			d.flags = (F_CTRL|F_UNCOND);
+			d.fu = FU_BR;
+			break;
+
+		case OP_BRANCH:
+			d.flags = (F_CTRL|F_COND);
+			d.fu = FU_BR;
+			break;
+
+		case OP_LOAD:
+			d.flags = (F_MEM|F_LOAD|F_DISP);
+			d.fu = FU_LS;
+			break;
+
+		case OP_STORE:
+			d.flags = (F_MEM|F_STORE|F_DISP);
+			d.fu = FU_LS;
+			break;
+
+		case OP_OP:
+		case OP_OP_32:  // valid only in 64bit mode - illegal inst exception in 32 bit mode
+			d.flags = (F_ICOMP);
+			d.fu = FU_ALU_S;
+
+			if(inst.funct7() == FN7_MULDIV) {
+				d.flags = (F_ICOMP|F_LONGLAT);
+				d.fu = FU_ALU_C;
+			}
+			break;
+
+		case OP_OP_IMM:
+		case OP_OP_IMM_32: // valid only in 64bit mode - illegal inst exception in 32 bit mode
+		case OP_LUI:
+		case OP_AUIPC:
+			d.flags = (F_ICOMP);
+			d.fu = FU_ALU_S;
+			break;
 
       // Set both F_MEM and F_FMEM so that they go to the MEM lane
       // but the FP unit requirement also gets checked in DISPATCH.
-			case OP_LOAD_FP:
-				PAY.buf[index].flags = (F_MEM|F_FMEM|F_LOAD|F_DISP);
-				PAY.buf[index].fu = FU_LS_FP;
-				break;
+		case OP_LOAD_FP:
+			d.flags = (F_MEM|F_FMEM|F_LOAD|F_DISP);
+			d.fu = FU_LS_FP;
+			break;
 
       // Set both F_MEM and F_FMEM so that they go to the MEM lane
       // but the FP unit requirement also gets checked in DISPATCH.
-			case OP_STORE_FP:
-				PAY.buf[index].flags = (F_MEM|F_FMEM|F_STORE|F_DISP);
-				PAY.buf[index].fu = FU_LS_FP;
-				break;
+		case OP_STORE_FP:
+			d.flags = (F_MEM|F_FMEM|F_STORE|F_DISP);
+			d.fu = FU_LS_FP;
+			break;
 
-			case OP_OP_FP:
+		case OP_OP_FP:
       case OP_MADD:
       case OP_MSUB:
       case OP_NMADD:
       case OP_NMSUB:
-				PAY.buf[index].flags = (F_FCOMP);
-				PAY.buf[index].fu = FU_ALU_FP;
-				break;
+			d.flags = (F_FCOMP);
+			d.fu = FU_ALU_FP;
+			break;
 
 //      	 case FMUL_S: case FMUL_D: case FDIV_S: case FDIV_D: case FSQRT_S: case FSQRT_D:
-//      	    PAY.buf[index].flags = (F_FCOMP|F_LONGLAT);
+//      	    d.flags = (F_FCOMP|F_LONGLAT);
 //      	    break;
 
-			case OP_SYSTEM:
+		case OP_SYSTEM:
         // Currently all SYSTEM ops flush the pipeline like an exception.
         // CSRxxx instructions do not invoke a exception handler whereas
         // the others do.
-				PAY.buf[index].flags = (F_TRAP|F_CSR);
-				PAY.buf[index].fu = FU_ALU_S;
-				break;
+			d.flags = (F_TRAP|F_CSR);
+			d.fu = FU_ALU_S;
+			break;
 
-			case OP_MISC_MEM:
+		case OP_MISC_MEM:
         // Currently all SYSTEM ops flush the pipeline like an exception.
         // CSRxxx instructions do not invoke a exception handler whereas
         // the others do.
-				PAY.buf[index].flags = (F_TRAP);
-				PAY.buf[index].fu = FU_ALU_S;
-				break;
+			d.flags = (F_TRAP);
+			d.fu = FU_ALU_S;
+			break;
 
-			case OP_AMO:
+		case OP_AMO:
         switch(inst.funct5()){
           case FN5_AMO_LR:
-    				PAY.buf[index].flags = (F_MEM|F_LOAD|F_DISP|F_AMO);
-		    		PAY.buf[index].fu = FU_LS;
+    				d.flags = (F_MEM|F_LOAD|F_DISP|F_AMO);
+	    		d.fu = FU_LS;
             break;
           case FN5_AMO_SC:
-    				PAY.buf[index].flags = (F_MEM|F_STORE|F_DISP|F_AMO);
-		    		PAY.buf[index].fu = FU_LS;
+    				d.flags = (F_MEM|F_STORE|F_DISP|F_AMO);
+	    		d.fu = FU_LS;
             break;
           default:
-    				PAY.buf[index].flags = (F_AMO);
-		    		PAY.buf[index].fu = FU_ALU_S;
+    				d.flags = (F_AMO);
+	    		d.fu = FU_ALU_S;
             //assert(0);
         }
-				break;
+			break;
 
-			default:
-				//assert(0);
-				break;
-		}
+		default:
+			//assert(0);
+			break;
+	}
+
+
+	// Set register operands and split instructions.
+	// Select IQ.
 
+	// Default values.
+	d.split = false;
+	d.split_store = false;
+	d.A_valid = false;
+	d.B_valid = false;
+	d.C_valid = false;
+	d.D_valid = false;
+	d.iq = SEL_IQ;
 
-		// Set register operands and split instructions.
-		// Select IQ.
-
-		// Default values.
-		PAY.buf[index].split = false;
-		PAY.buf[index].split_store = false;
-		PAY.buf[index].A_valid = false;
-		PAY.buf[index].B_valid = false;
-		PAY.buf[index].C_valid = false;
-		PAY.buf[index].D_valid = false;
-		PAY.buf[index].iq = SEL_IQ;
-
-		switch (inst.opcode()) {
-
-			case OP_JAL:
-				// dest register
-				PAY.buf[index].C_valid = true;
-				PAY.buf[index].C_log_reg = inst.rd();  // This should be either x1 or x0 as per software calling conventions
-				break;
-
-			case OP_JALR:
-				// source register
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1();
-				// dest register
-				PAY.buf[index].C_valid = true;
-				PAY.buf[index].C_log_reg = inst.rd();
-				break;
-
-			case OP_BRANCH:
-				// first source register
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1();
-				// second source register
-				PAY.buf[index].B_valid = true;
-				PAY.buf[index].B_log_reg = inst.rs2();
-				break;
-
-
-			case OP_LOAD:
-				// base register for AGEN
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1();
-				// dest register
-				PAY.buf[index].C_valid = true;
-				PAY.buf[index].C_log_reg = inst.rd();
-				break;
-
-
-			case OP_LOAD_FP:
-				// base register for AGEN
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1();
-				// dest register
-				PAY.buf[index].C_valid = true;
-				PAY.buf[index].C_log_reg = inst.rd()+NXPR;
-				break;
-
-			case OP_STORE:
-				// base register for AGEN
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1();
-				// source register
-				PAY.buf[index].B_valid = true;
-				PAY.buf[index].B_log_reg = inst.rs2();
-				break;
-
-
-			case OP_STORE_FP:
-				// base register for AGEN
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1();
-
-				// source register
-				PAY.buf[index].B_valid = true;
-				PAY.buf[index].B_log_reg = inst.rs2()+NXPR;
-				break;
-
-			case OP_OP:
-			case OP_OP_32:  // valid only in 64bit mode - illegal inst exception in 32 bit mode
-				// first source register
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1();
-				// second source register
-				PAY.buf[index].B_valid = true;
-				PAY.buf[index].B_log_reg = inst.rs2();
-				// dest register
-				PAY.buf[index].C_valid = true;
-				PAY.buf[index].C_log_reg = inst.rd();
-				break;
-
-
-			case OP_OP_IMM:
-			case OP_OP_IMM_32:  // valid only in 64bit mode - illegal inst exception in 32 bit mode
+	switch (inst.opcode()) {
+
+		case OP_JAL:
+			// dest register
+			d.C_valid = true;
+			d.C_log_reg = inst.rd();  // This should be either x1 or x0 as per software calling conventions
+			break;
+
+		case OP_JALR:
+			// source register
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1();
+			// dest register
+			d.C_valid = true;
+			d.C_log_reg = inst.rd();
+			break;
+
+		case OP_BRANCH:
+			// first source register
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1();
+			// second source register
+			d.B_valid = true;
+			d.B_log_reg = inst.rs2();
+			break;
+
+
+		case OP_LOAD:
+			// base register for AGEN
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1();
+			// dest register
+			d.C_valid = true;
+			d.C_log_reg = inst.rd();
+			break;
+
+
+		case OP_LOAD_FP:
+			// base register for AGEN
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1();
+			// dest register
+			d.C_valid = true;
+			d.C_log_reg = inst.rd()+NXPR;
+			break;
+
+		case OP_STORE:
+			// base register for AGEN
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1();
+			// source register
+			d.B_valid = true;
+			d.B_log_reg = inst.rs2();
+			break;
+
+
+		case OP_STORE_FP:
+			// base register for AGEN
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1();
+
+			// source register
+			d.B_valid = true;
+			d.B_log_reg = inst.rs2()+NXPR;
+			break;
+
+		case OP_OP:
+		case OP_OP_32:  // valid only in 64bit mode - illegal inst exception in 32 bit mode
+			// first source register
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1();
+			// second source register
+			d.B_valid = true;
+			d.B_log_reg = inst.rs2();
+			// dest register
+			d.C_valid = true;
+			d.C_log_reg = inst.rd();
+			break;
+
+
+		case OP_OP_IMM:
+		case OP_OP_IMM_32:  // valid only in 64bit mode - illegal inst exception in 32 bit mode
         if(inst.bits() == INSN_NOP){
           // Select IQ.
-          PAY.buf[index].iq = SEL_IQ_NONE;
+          d.iq = SEL_IQ_NONE;
 
-	  // 3/20/19: Fix for checker.
-          PAY.buf[index].A_valid = true;
-          PAY.buf[index].A_log_reg = inst.rs1();
-	  assert(PAY.buf[index].A_log_reg == 0);
-          PAY.buf[index].A_value.dw = 0;
+          // 3/20/19: Fix for checker.
+          d.A_valid = true;
+          d.A_log_reg = inst.rs1();
+          assert(d.A_log_reg == 0);
         } else {
-				  // source register
-				  PAY.buf[index].A_valid = true;
-				  PAY.buf[index].A_log_reg = inst.rs1();
-				  // dest register
-				  PAY.buf[index].C_valid = true;
-				  PAY.buf[index].C_log_reg = inst.rd();
+			  // source register
+			  d.A_valid = true;
+			  d.A_log_reg = inst.rs1();
+			  // dest register
+			  d.C_valid = true;
+			  d.C_log_reg = inst.rd();
         }
-				break;
+			break;
 
 
       case OP_OP_FP:
         switch(inst.funct5()){
           case FN5_FADD:  case FN5_FSUB:      case FN5_FMUL:  case FN5_FDIV:
           case FN5_FSGNJ: case FN5_FMIN_MAX: 
-				    // first source register
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1()+NXPR;
-				    // second source register
-				    PAY.buf[index].B_valid = true;
-				    PAY.buf[index].B_log_reg = inst.rs2()+NXPR;
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd()+NXPR;
-				    break;
+			    // first source register
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1()+NXPR;
+			    // second source register
+			    d.B_valid = true;
+			    d.B_log_reg = inst.rs2()+NXPR;
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd()+NXPR;
+			    break;
 
           case FN5_FCOMP:
-				    // first source register
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1()+NXPR;
-				    // second source register
-				    PAY.buf[index].B_valid = true;
-				    PAY.buf[index].B_log_reg = inst.rs2()+NXPR;
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd();
-				    break;
+			    // first source register
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1()+NXPR;
+			    // second source register
+			    d.B_valid = true;
+			    d.B_log_reg = inst.rs2()+NXPR;
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd();
+			    break;
 
           case FN5_FSQRT:  case FN5_FCVT_DS:
-				    // first source register
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1()+NXPR;
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd()+NXPR;
-				    break;
+			    // first source register
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1()+NXPR;
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd()+NXPR;
+			    break;
 
           case FN5_FCVT_I2FP: case FN5_FMV_I2FP: 
-				    // first source register
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1();
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd()+NXPR;
-				    break;
+			    // first source register
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1();
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd()+NXPR;
+			    break;
 
           case FN5_FCVT_FP2I: case FN5_FMV_FP2I: 
-				    // first source register
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1()+NXPR;
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd();
-				    break;
+			    // first source register
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1()+NXPR;
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd();
+			    break;
 
           default:
             break;
         }
         break;
        //TODO
-			/**** Decode FMOV instructions as they are special
-			 * The renamer can have a unified RMT with lower 32 integer RMT entries
-			 * and upper 32 FP RMT entries.
-			 ******/
+		/**** Decode FMOV instructions as they are special
+		 * The renamer can have a unified RMT with lower 32 integer RMT entries
+		 * and upper 32 FP RMT entries.
+		 ******/
 
 
       // System instructions flow through the pipeline without making any changes
       // until they are committed. The system registers are written or read 
-			case OP_SYSTEM:
+		case OP_SYSTEM:
         switch(inst.funct3()){
           case FN3_CLR:
           case FN3_RW:
           case FN3_SET:
-				    // first source register
+			    // first source register
             // Used as immediate in case of IMM form of the instructions
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1();
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd();
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1();
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd();
             // CSR address
-				    PAY.buf[index].CSR_addr = inst.csr();
+			    d.CSR_addr = inst.csr();
             break;
           case FN3_CLR_IMM:
           case FN3_RW_IMM:
           case FN3_SET_IMM:
-				    // first source register field is used as immediate 
+			    // first source register field is used as immediate 
             // in case of IMM form of the instructions
-				    PAY.buf[index].A_valid = false;
-				    PAY.buf[index].A_log_reg = inst.rs1();
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd();
+			    d.A_valid = false;
+			    d.A_log_reg = inst.rs1();
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd();
             // CSR address
-				    PAY.buf[index].CSR_addr = inst.csr();
+			    d.CSR_addr = inst.csr();
             break;
           case FN3_SC_SB:
             if(inst.funct12() == FN12_SRET){
-				      PAY.buf[index].CSR_addr = CSR_STATUS;
+			      d.CSR_addr = CSR_STATUS;
             }
             else {
   				    // Select IQ.
-	  			    PAY.buf[index].iq = SEL_IQ_NONE_EXCEPTION;
+  			    d.iq = SEL_IQ_NONE_EXCEPTION;
             }
             break;
           default:
             assert(0);
             break;
         }         
-				break;
+			break;
 
       // Ignores zeroed out fields (rs1,rd and imm[11:8] for forward compatibility.
       // Ignores successor and predecessor fields and does a global FENCE for all types of fences.
@@ -391,125 +442,100 @@ void pipeline_t::decode() {
       // TODO: Should go to SEL_IQ_NONE_EXCEPTION when fence is actually implemented.
       // Current implmentation is trivial.
       case OP_MISC_MEM:
-				PAY.buf[index].iq = SEL_IQ_NONE;
+			d.iq = SEL_IQ_NONE;
         break;
 
-			case OP_AMO:
+		case OP_AMO:
         switch(inst.funct5()){
           case FN5_AMO_LR:
-				    // base register for AGEN
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1();
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd();
-				    break;
+			    // base register for AGEN
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1();
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd();
+			    break;
           case FN5_AMO_SC:
-				    // base register for AGEN
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1();
-				    // source register
-				    PAY.buf[index].B_valid = true;
-				    PAY.buf[index].B_log_reg = inst.rs2();
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd();
-				    break;
+			    // base register for AGEN
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1();
+			    // source register
+			    d.B_valid = true;
+			    d.B_log_reg = inst.rs2();
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd();
+			    break;
           default:
-				    // base register for address
-				    PAY.buf[index].A_valid = true;
-				    PAY.buf[index].A_log_reg = inst.rs1();
-				    // source register
-				    PAY.buf[index].B_valid = true;
-				    PAY.buf[index].B_log_reg = inst.rs2();
-				    // dest register
-				    PAY.buf[index].C_valid = true;
-				    PAY.buf[index].C_log_reg = inst.rd();
-				    break;
+			    // base register for address
+			    d.A_valid = true;
+			    d.A_log_reg = inst.rs1();
+			    // source register
+			    d.B_valid = true;
+			    d.B_log_reg = inst.rs2();
+			    // dest register
+			    d.C_valid = true;
+			    d.C_log_reg = inst.rd();
+			    break;
             //assert(0);
         }
         break;
 
-			case OP_LUI:
-			case OP_AUIPC:
-				// dest register
-				PAY.buf[index].C_valid = true;
-				PAY.buf[index].C_log_reg = inst.rd();
-				break;
+		case OP_LUI:
+		case OP_AUIPC:
+			// dest register
+			d.C_valid = true;
+			d.C_log_reg = inst.rd();
+			break;
 
       case OP_MADD:
       case OP_MSUB:
       case OP_NMADD:
       case OP_NMSUB:
-				// first source register
-				PAY.buf[index].A_valid = true;
-				PAY.buf[index].A_log_reg = inst.rs1()+NXPR;
-				// second source register
-				PAY.buf[index].B_valid = true;
-				PAY.buf[index].B_log_reg = inst.rs2()+NXPR;
-				// third source register
-				PAY.buf[index].D_valid = true;
-				PAY.buf[index].D_log_reg = inst.rs3()+NXPR;
-				// dest register
-				PAY.buf[index].C_valid = true;
-				PAY.buf[index].C_log_reg = inst.rd()+NXPR;
-				break;
-
-			default:
+			// first source register
+			d.A_valid = true;
+			d.A_log_reg = inst.rs1()+NXPR;
+			// second source register
+			d.B_valid = true;
+			d.B_log_reg = inst.rs2()+NXPR;
+			// third source register
+			d.D_valid = true;
+			d.D_log_reg = inst.rs3()+NXPR;
+			// dest register
+			d.C_valid = true;
+			d.C_log_reg = inst.rd()+NXPR;
+			break;
+
+		default:
         // Unknown opcode: do not dispatch to IQ.
         // This is just to make sure none of the asserts in the pipeline
         // fire on seeing an unknown instruction. This instruction should
         // never get committed as this part of code can only be reached
         // if fetch has been redirected by bad branch prediction to a
         // memory region containing random values or zeroes.
-                                PAY.buf[index].iq = SEL_IQ_NONE;
-				break;
-		}
+                                d.iq = SEL_IQ_NONE;
+			break;
+	}
 
     //If destination X0 (Not F0), remove the destination as X0 should never be written to
     //or renamed for that matter. Set C_valid to 0 
-    if(PAY.buf[index].C_log_reg == 0){
-  	  PAY.buf[index].C_valid = false;
+    if(d.C_log_reg == 0){
+  	  d.C_valid = false;
     }
 
-		// Decode some details about loads and stores:
-		// size and sign of data, and left/right info.
-		switch (inst.opcode()) {
-			case OP_LOAD:
-			case OP_STORE:
-			case OP_LOAD_FP:
-			case OP_STORE_FP:
-			case OP_AMO:
-				PAY.buf[index].size = inst.ldst_size();      // Load size is encoded in funct3/width[1:0] field or inst[13:12]
-				PAY.buf[index].is_signed = inst.ldst_sign(); // Load sign is encoded in funct3/width[2] field or inst[14]
-				PAY.buf[index].left = false;
-				PAY.buf[index].right = false;
-				break;
-
-			default:
-				break;
-		}
-
-		// Insert one or two instructions into the Fetch Queue (indices).
-		FQ.push(index);
-		if (PAY.buf[index].split) {
-      // Should not come here in current 721sim, with unified int/fp pipeline.
-      // Will need this functionality for split-stores, however.
-      assert(0);
-			assert(PAY.buf[index+1].split);
-			assert(PAY.buf[index].upper);
-			assert(!PAY.buf[index+1].upper);
-			FQ.push(index+1);
-		}
-
-
-    #ifdef RISCV_MICRO_DEBUG
-      // Dump debug info if needed
-      //Pass a pointer to the processor
-    
-      PAY.dump(this,index,decode_log);
-    #endif
-
+	// Decode some details about loads and stores:
+	// size and sign of data, and left/right info.
+	switch (inst.opcode()) {
+		case OP_LOAD:
+		case OP_STORE:
+		case OP_LOAD_FP:
+		case OP_STORE_FP:
+		case OP_AMO:
+			d.size = inst.ldst_size();      // Load size is encoded in funct3/width[1:0] field or inst[13:12]
+			d.is_signed = inst.ldst_sign(); // Load sign is encoded in funct3/width[2] field or inst[14]
+			break;
 
+		default:
+			break;
 	}
 }
@@ -34,6 +34,11 @@ void pipeline_t::fetch() {
    uint64_t branch_vector;
    uint64_t pred_vector;
    uint64_t next_fetch_pc;
+   tcm_data_t *tc_data;		// On a trace cache hit: the trace's instructions and decode-stage fields (if available).
+
+   // The fetched instructions, for the trace cache line fill buffer.
+   insn_t bundle_insn[MAX_BTB_BANKS];
+   bool bundle_insn_valid;	// false if any of them had a fetch exception
  
    // Miscellaneous control signals.
    bool pred_valid;
@@ -89,11 +94,18 @@ void pipeline_t::fetch() {
    if (PERFECT_BRANCH_PRED) {
       pred_valid = false;
       fetch_bundle_length = fetch_width;
+      tc_data = NULL;
    }
    else {
       pred_valid = true;
-      fetch_pred_tag = BPU.predict(pc, pred_tags, tc_hit, fetch_bundle_length, branch_vector, pred_vector, next_fetch_pc);
+      fetch_pred_tag = BPU.predict(pc, pred_tags, tc_hit, fetch_bundle_length, branch_vector, pred_vector, next_fetch_pc, tc_data);
       assert(fetch_bundle_length <= fetch_width);
+      if (TCM_DATA == 1)
+         tc_data = NULL;
+
+      // The prediction needed the second-level BTB: the fetch bundle is late, which stalls the next fetch.
+      if (BPU.fetch_delay())
+         next_fetch_cycle = (cycle + 1 + BPU.fetch_delay());
 
       // Checkpoint PAY, so that we can squash the fetch bundle and repredict it if BTB hits are flawed.
       pay_checkpoint = PAY.checkpoint();
@@ -113,31 +125,50 @@ void pipeline_t::fetch() {
    btb_miss = false;
    next_pred_tag_index = 0;
    save_pc = pc;
+   bundle_insn_valid = true;
    while ((i < fetch_bundle_length) && (!btb_miss)) {
 
       //////////////////////////////////////////////////////
       // Fetch instruction -or- inject NOP for fetch stall.
       //////////////////////////////////////////////////////
 
-      // Try fetching the instruction via the MMU.
+      // On a trace cache hit, take the instruction from the trace data array.
+      // Otherwise, try fetching the instruction via the MMU.
       // Generate a "NOP with fetch exception" if the MMU reference generates an exception.
       fetch_exception = false;
-      try {
-         insn = (mmu->load_insn(pc)).insn;
+      if (tc_data && (TCM_DATA == 0)) {
+         insn = tc_data->insn[i];
       }
-      catch (trap_t& t) {
-         insn = insn_t(INSN_NOP);
-	 fetch_exception = true;
-         trap_cause = t.cause();
+      else {
+         try {
+            insn = (mmu->load_insn(pc)).insn;
+         }
+         catch (trap_t& t) {
+            insn = insn_t(INSN_NOP);
+	    fetch_exception = true;
+            trap_cause = t.cause();
+         }
+
+         // Cross-check the trace data array.
+         if (tc_data)
+            assert(!fetch_exception && (insn.bits() == tc_data->insn[i].bits()));
       }
+      bundle_insn[i] = insn;
+      if (fetch_exception)
+         bundle_insn_valid = false;
 
       // Put the instruction's information into PAY.
+      // On a trace cache hit, this includes its decode-stage fields.
       index = PAY.push();
       PAY.buf[index].inst = insn;
       PAY.buf[index].pc = pc;
       PAY.buf[index].sequence = sequence;
       PAY.buf[index].fetch_exception = fetch_exception;
       PAY.buf[index].fetch_exception_cause = trap_cause;
+      PAY.buf[index].fetch_bundle_start = (i == 0);
+      PAY.buf[index].predecoded = (tc_data != NULL);
+      if (tc_data)
+         PAY.set_decode(index, tc_data->pre[i]);
 
       //////////////////////////////////////////////////////
       // map_to_actual()
@@ -356,6 +387,35 @@ void pipeline_t::fetch() {
       else {
          assert(pc == next_fetch_pc);
       }
-      BPU.trace_constructor(!btb_miss, tc_hit); //call trace cache line fill buffer
+      BPU.trace_constructor(!btb_miss, tc_hit, bundle_insn, bundle_insn_valid); //call trace cache line fill buffer
    }
 }			// fetch()
+
+
+// Fetch target queue (FTQ_SIZE > 0).
+// 1. The BPU predicts one more fetch bundle into the FTQ, running ahead of the Fetch Stage.
+// 2. Fetch-directed instruction prefetching (FDIP): the I$ lines of up to FDIP queued fetch bundles
+//    are prefetched, so that they are (or are being) loaded by the time the Fetch Stage gets to them.
+void pipeline_t::fetch_ahead() {
+   uint64_t fetch_pc;
+   unsigned int line;
+
+   if (!FTQ_SIZE || PERFECT_BRANCH_PRED)
+      return;
+
+   BPU.run_ahead();
+
+   if (PERFECT_ICACHE)
+      return;
+
+   for (unsigned int i = 0; (i < FDIP) && BPU.ftq_prefetch(fetch_pc); i++) {
+      line = (fetch_pc >> L1_IC_LINE_SIZE);
+      if (IC->Prefetch(Tid, cycle, (line << L1_IC_LINE_SIZE)))
+         fdip_issued++;
+      if (IC_INTERLEAVED) {
+         // Also the next consecutive line, as the Fetch Stage accesses it.
+         if (IC->Prefetch(Tid, cycle, ((line + 1) << L1_IC_LINE_SIZE)))
+            fdip_issued++;
+      }
+   }
+}
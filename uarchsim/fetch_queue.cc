@@ -47,6 +47,11 @@ unsigned int fetch_queue::pop() {
 	return(index);
 }
 
+// returns the number of instructions in the fetch queue
+unsigned int fetch_queue::get_length() {
+	return(length);
+}
+
 // flush the fetch queue (make it empty)
 void fetch_queue::flush() {
 	head = 0;
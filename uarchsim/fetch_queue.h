@@ -21,6 +21,7 @@ public:
 
 	bool bundle_ready(unsigned int i);	// returns true if the fetch queue has enough instructions to form a bundle of i instructions
 	unsigned int pop();			// pop an instruction (its payload buffer index) from the fetch queue
+	unsigned int get_length();		// returns the number of instructions in the fetch queue
 
 	void flush();				// flush the fetch queue (make it empty)
 };
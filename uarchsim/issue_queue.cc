@@ -1,8 +1,9 @@
+#include <algorithm>
 #include "pipeline.h"
 
 
 // constructor
-issue_queue::issue_queue(unsigned int size, unsigned int num_parts, pipeline_t* _proc):proc(_proc) {
+issue_queue::issue_queue(unsigned int size, unsigned int num_parts, unsigned int num_phys_regs, pipeline_t* _proc):proc(_proc) {
 	// Initialize the issue queue.
 	q = new issue_queue_entry_t[size];
 	this->size = size;
@@ -15,6 +16,15 @@ issue_queue::issue_queue(unsigned int size, unsigned int num_parts, pipeline_t*
         this->part_size = (size/num_parts);
         this->part_next = 0;
 
+	// Initialize the ready bit vector: no entry is ready.
+	ready_words = ((size + 63) / 64);
+	ready = new uint64_t[ready_words];
+	for (unsigned int i = 0; i < ready_words; i++) {
+		ready[i] = 0;
+	}
+	age_count = 0;
+	age_sel = new unsigned int[size];
+
 	// Initialize the issue queue's free list.
 	fl = new unsigned int[size];
 	fl_head = 0;
@@ -28,6 +38,15 @@ issue_queue::issue_queue(unsigned int size, unsigned int num_parts, pipeline_t*
 	oldest = -1;
 	youngest = -1;
 
+	// Initialize the consumer lists: no operand is waiting on any physical register.
+	this->num_phys_regs = num_phys_regs;
+	cons_head = new int[num_phys_regs];
+	for (unsigned int i = 0; i < num_phys_regs; i++) {
+		cons_head[i] = -1;
+	}
+	cons_next = new int[3*size];
+	cons_prev = new int[3*size];
+
   // Needed for macro
   stats = proc->get_stats();
 }
@@ -70,6 +89,19 @@ void issue_queue::dispatch(unsigned int index, unsigned long long branch_mask, u
 	q[free].D_ready = D_ready;
 	q[free].D_tag = D_tag;
 
+	// Link operands that are still waiting into their producers' consumer lists.
+	if (IQ_WAKEUP != 1) {
+		if (A_valid && !A_ready)
+			link_consumer(A_tag, 3*free);
+		if (B_valid && !B_ready)
+			link_consumer(B_tag, 3*free + 1);
+		if (D_valid && !D_ready)
+			link_consumer(D_tag, 3*free + 2);
+	}
+
+	q[free].age = age_count++;
+	update_ready(free);
+
 	// Add this instruction to tail of linked-list for ideal age-based priority.
 	if (oldest == -1) {	// IQ empty
 	   assert(youngest == -1);
@@ -89,14 +121,89 @@ void issue_queue::dispatch(unsigned int index, unsigned long long branch_mask, u
 }
 
 void issue_queue::wakeup(unsigned int tag) {
+  inc_counter(wakeup_cam_read_count);
+
+	if (IQ_WAKEUP == 1) {
+		wakeup_cam(tag);
+	}
+	else {
+		wakeup_consumers(tag);
+
+		// Validation: no valid entry may still be waiting on the tag.
+		if (IQ_WAKEUP == 2) {
+			for (unsigned int i = 0; i < size; i++) {
+				if (q[i].valid) {
+					assert(!(q[i].A_valid && (tag == q[i].A_tag) && !q[i].A_ready));
+					assert(!(q[i].B_valid && (tag == q[i].B_tag) && !q[i].B_ready));
+					assert(!(q[i].D_valid && (tag == q[i].D_tag) && !q[i].D_ready));
+				}
+			}
+		}
+	}
+}
+
+void issue_queue::link_consumer(unsigned int tag, unsigned int slot) {
+	assert(tag < num_phys_regs);
+	cons_prev[slot] = -1;
+	cons_next[slot] = cons_head[tag];
+	if (cons_head[tag] != -1)
+		cons_prev[cons_head[tag]] = slot;
+	cons_head[tag] = slot;
+}
+
+void issue_queue::unlink_consumer(unsigned int tag, unsigned int slot) {
+	assert(tag < num_phys_regs);
+	if (cons_prev[slot] == -1) {
+		assert(cons_head[tag] == (int)slot);
+		cons_head[tag] = cons_next[slot];
+	}
+	else {
+		cons_next[cons_prev[slot]] = cons_next[slot];
+	}
+	if (cons_next[slot] != -1)
+		cons_prev[cons_next[slot]] = cons_prev[slot];
+}
+
+void issue_queue::wakeup_consumers(unsigned int tag) {
+	// Walk the consumer list of the tag and set the ready bit of each
+	// operand on it. Every operand on the list is woken, so the whole
+	// list is released at once.
+	assert(tag < num_phys_regs);
+	int slot = cons_head[tag];
+	cons_head[tag] = -1;
+
+	while (slot != -1) {
+		unsigned int i = ((unsigned int)slot / 3);
+		assert(q[i].valid);
+		switch (slot % 3) {
+			case 0:
+				assert(q[i].A_valid && (q[i].A_tag == tag) && !q[i].A_ready);
+				q[i].A_ready = true;
+				break;
+			case 1:
+				assert(q[i].B_valid && (q[i].B_tag == tag) && !q[i].B_ready);
+				q[i].B_ready = true;
+				break;
+			default:
+				assert(q[i].D_valid && (q[i].D_tag == tag) && !q[i].D_ready);
+				q[i].D_ready = true;
+				break;
+		}
+		update_ready(i);
+        #ifdef RISCV_MICRO_DEBUG
+          LOG(proc->issue_log,proc->cycle,proc->PAY.buf[q[i].index].sequence,proc->PAY.buf[q[i].index].pc,"Waking up RS%d iq entry %u",(slot % 3) + 1,i);
+          dump_iq(proc,i,proc->issue_log);
+        #endif
+		slot = cons_next[slot];
+	}
+}
+
+void issue_queue::wakeup_cam(unsigned int tag) {
 	// Broadcast the tag to every entry in the issue queue.
 	// If the broadcasted tag matches a valid tag:
 	// (1) Assert that the ready bit is initially false because if someone is 
   //      broadcasting a tag, that source can not already be valid
 	// (2) Set the ready bit.
-  
-
-  inc_counter(wakeup_cam_read_count);
 
 	for (unsigned int i = 0; i < size; i++) {
 		if (q[i].valid) {					// Only consider valid issue queue entries.
@@ -125,88 +232,115 @@ void issue_queue::wakeup(unsigned int tag) {
           dump_iq(proc,i,proc->issue_log);
         #endif
 			}
+			update_ready(i);
+		}
+	}
+}
+
+void issue_queue::update_ready(unsigned int i) {
+	if (q[i].valid && (!q[i].A_valid || q[i].A_ready) && (!q[i].B_valid || q[i].B_ready) && (!q[i].D_valid || q[i].D_ready))
+		ready[i >> 6] |= (1ULL << (i & 63));
+	else
+		ready[i >> 6] &= ~(1ULL << (i & 63));
+}
+
+int issue_queue::find_ready(unsigned int from, unsigned int to) {
+	unsigned int w;
+	uint64_t bits;
+
+	if (from >= to)
+		return(-1);
+
+	w = (from >> 6);
+	bits = (ready[w] & (~0ULL << (from & 63)));
+	while (true) {
+		if (bits) {
+			unsigned int i = ((w << 6) + __builtin_ctzll(bits));
+			return((i < to) ? (int)i : -1);
 		}
+		w++;
+		if ((w << 6) >= to)
+			return(-1);
+		bits = ready[w];
 	}
 }
 
+bool issue_queue::issue(unsigned int i, unsigned int& free_lanes, lane* Execution_Lanes) {
+   unsigned int candidates;
+
+   if (PRESTEER) {
+      // Check if the instruction's desired Execution Lane is free.
+      if (!(free_lanes & (1 << q[i].lane_id)))
+         return(false);
+   }
+   else {
+      // Pick the lowest-numbered free Execution Lane among all candidate lanes.
+      candidates = (q[i].lane_id & free_lanes);
+      if (!candidates)
+         return(false);
+      q[i].lane_id = __builtin_ctz(candidates);
+   }
+
+   assert(!Execution_Lanes[q[i].lane_id].rr.valid);
+   free_lanes &= ~(1 << q[i].lane_id);
+
+   // Issue the instruction to the Register Read Stage within the Execution Lane.
+   Execution_Lanes[q[i].lane_id].rr.valid = true;
+   Execution_Lanes[q[i].lane_id].rr.index = q[i].index;
+   Execution_Lanes[q[i].lane_id].rr.branch_mask = q[i].branch_mask;
+
+   // Remove the instruction from the issue queue.
+   remove(i);
+
+   inc_counter(issued_inst_count);
+   return(true);
+}
+
+
 void issue_queue::select_and_issue(unsigned int num_lanes, lane* Execution_Lanes) {
-   unsigned int i, j;
-   bool issue;
-   unsigned int dyn_lane_id;
+   unsigned int k, n;
+   int i;
+   unsigned int free_lanes;
    bool issuedThisCycle = false;
 
-   // Set up the first IQ index to be examined this cycle.
-   if (IDEAL_AGE_BASED) {
-      if (oldest == -1) { // IQ empty, so no age-based list to sequence through.
-         assert(youngest == -1);
-	 assert(length == 0);
-         return;
-      }
-      else {
-         i = (unsigned int)oldest;  // Start sequencing at oldest instruction in the IQ.
-      }
+   if (IDEAL_AGE_BASED && (oldest == -1)) { // IQ empty, so no age-based list to sequence through.
+      assert(youngest == -1);
+      assert(length == 0);
+      return;
    }
-   else {
-      i = part_next;
+
+   // Build the mask of Execution Lanes whose Register Read Stage is free.
+   // Selection stops as soon as every lane has been claimed.
+   free_lanes = 0;
+   for (k = 0; k < num_lanes; k++) {
+      if (!Execution_Lanes[k].rr.valid)
+         free_lanes |= (1 << k);
    }
 
-   // The same 'j' loop supports both of the following modes:
-   // - scan the entire IQ sequentially from the first index i
-   // - scan valid IQ entries in age-order from the first (oldest) index i
-   for (j = 0; j < size; j++) {
-      assert(!IDEAL_AGE_BASED || q[i].valid);
- 
-      // Check if the instruction is valid and ready.
-      if (q[i].valid && (!q[i].A_valid || q[i].A_ready) && (!q[i].B_valid || q[i].B_ready) && (!q[i].D_valid || q[i].D_ready)) {
-         if (PRESTEER) {
-            // Check if the instruction's desired Execution Lane is free.
-	    issue = !Execution_Lanes[q[i].lane_id].rr.valid;
-	 }
-	 else {
-	    // Check if there is a free Execution Lane among all candidate lanes.
-            issue = false;
-	    dyn_lane_id = 0;
-	    while (!issue && (dyn_lane_id < num_lanes)) {
-	       if ((q[i].lane_id & (1 << dyn_lane_id)) && !Execution_Lanes[dyn_lane_id].rr.valid) {
-		  issue = true;
-                  q[i].lane_id = dyn_lane_id;
-	       }
-	       else {
-	          dyn_lane_id++;
-	       }
-	    }
-         }
-
-	 if (issue) {
-            assert(q[i].lane_id < num_lanes);
-            assert(!Execution_Lanes[q[i].lane_id].rr.valid);
-
-            // Issue the instruction to the Register Read Stage within the Execution Lane.
-            Execution_Lanes[q[i].lane_id].rr.valid = true;
-            Execution_Lanes[q[i].lane_id].rr.index = q[i].index;
-            Execution_Lanes[q[i].lane_id].rr.branch_mask = q[i].branch_mask;
-
-            // Remove the instruction from the issue queue.
-            remove(i);
-   
+   if (IDEAL_AGE_BASED) {
+      // Gather the ready instructions and consider them oldest first,
+      // i.e., in the order of the age-based linked list.
+      n = 0;
+      for (i = find_ready(0, size); i != -1; i = find_ready(i + 1, size))
+         age_sel[n++] = i;
+      std::sort(age_sel, age_sel + n, [this](unsigned int x, unsigned int y) { return(q[x].age < q[y].age); });
+
+      for (k = 0; (k < n) && free_lanes; k++) {
+         assert(q[age_sel[k]].valid);
+         if (issue(age_sel[k], free_lanes, Execution_Lanes))
             issuedThisCycle = true;
-            inc_counter(issued_inst_count);
-         }
       }
-
-      if (IDEAL_AGE_BASED) {
-	 // Set q index to that of the next-oldest instruction, or break from loop if there is no next-oldest instruction.
-	 // Note: even if we issued and removed i from the IQ, above, its next pointer is still available.
-         if (q[i].next == -1)
-	    break;
-         else
-	    i = (unsigned int)q[i].next;
+   }
+   else {
+      // Consider the ready instructions in IQ index order, starting at the
+      // partition that has priority this cycle and wrapping around.
+      for (i = find_ready(part_next, size); (i != -1) && free_lanes; i = find_ready(i + 1, size)) {
+         if (issue(i, free_lanes, Execution_Lanes))
+            issuedThisCycle = true;
       }
-      else {
-         // Modulo increment q index.
-         i++;
-         if (i == size)
-            i = 0;
+      for (i = find_ready(0, part_next); (i != -1) && free_lanes; i = find_ready(i + 1, part_next)) {
+         if (issue(i, free_lanes, Execution_Lanes))
+            issuedThisCycle = true;
       }
    }
 
@@ -219,6 +353,23 @@ void issue_queue::select_and_issue(unsigned int num_lanes, lane* Execution_Lanes
       part_next = 0;
 }
 
+bool issue_queue::any_ready() {
+   for (unsigned int w = 0; w < ready_words; w++) {
+      if (ready[w])
+         return(true);
+   }
+   return(false);
+}
+
+// Equivalent to calling select_and_issue() 'cycles' times while no entry is ready:
+// only the round-robin partition priority moves.
+void issue_queue::skip_cycles(uint64_t cycles) {
+   if (IDEAL_AGE_BASED && (oldest == -1))
+      return;
+
+   part_next = (unsigned int)((part_next + (cycles % (size / part_size)) * part_size) % size);
+}
+
 void issue_queue::remove(unsigned int i) {
 	assert(length > 0);
 	assert(fl_length < size);
@@ -226,6 +377,17 @@ void issue_queue::remove(unsigned int i) {
 	// Remove the instruction from the issue queue.
 	q[i].valid = false;
 	length--;
+	ready[i >> 6] &= ~(1ULL << (i & 63));
+
+	// Unlink operands that were still waiting (only possible when squashing).
+	if (IQ_WAKEUP != 1) {
+		if (q[i].A_valid && !q[i].A_ready)
+			unlink_consumer(q[i].A_tag, 3*i);
+		if (q[i].B_valid && !q[i].B_ready)
+			unlink_consumer(q[i].B_tag, 3*i + 1);
+		if (q[i].D_valid && !q[i].D_ready)
+			unlink_consumer(q[i].D_tag, 3*i + 2);
+	}
 
 	// Push the issue queue entry back onto the free list.
 	fl[fl_tail] = i;
@@ -280,6 +442,14 @@ void issue_queue::flush() {
 
 	oldest = -1;
 	youngest = -1;
+
+	for (unsigned int i = 0; i < ready_words; i++) {
+		ready[i] = 0;
+	}
+
+	for (unsigned int i = 0; i < num_phys_regs; i++) {
+		cons_head[i] = -1;
+	}
 }
 
 void issue_queue::clear_branch_bit(unsigned int branch_ID) {
@@ -34,6 +34,7 @@ typedef struct {
 	// Support for ideal age-based priority.
 	int prev;	// IQ index of previous-oldest instruction still in the IQ.
 	int next;	// IQ index of next-oldest instruction still in the IQ.
+	uint64_t age;	// Dispatch order of the instruction (smaller is older).
 
 } issue_queue_entry_t;
 
@@ -60,16 +61,43 @@ private:
 	int oldest;	// IQ index of oldest instruction still in the IQ.
 	int youngest;	// IQ index of youngest instruction still in the IQ.
 
+	// Support for bit-vector select.
+	// Bit i of the ready vector is set iff IQ entry i is valid and all of its source operands are ready.
+	// Partitions are contiguous ranges of IQ indices, so round-robin partition priority is a
+	// find-first-set scan starting at the first word of the priority partition.
+	uint64_t* ready;		// Ready bit vector, one bit per IQ entry.
+	unsigned int ready_words;	// Number of 64-bit words in the ready bit vector.
+	uint64_t age_count;		// Age stamp given to the next dispatched instruction.
+	unsigned int* age_sel;		// Scratch list of ready IQ indices, sorted by age for ideal age-based select.
+
 	unsigned int* fl;		// This is the list of free issue queue entries, i.e., the "free list".
 	unsigned int fl_head;		// Head of issue queue's free list.
 	unsigned int fl_tail;		// Tail of issue queue's free list.
 	unsigned int fl_length;			// Length of issue queue's free list.
 
+	// Support for event-driven wakeup (IQ_WAKEUP != 1).
+	// Each source operand that is not yet ready is linked into the consumer list
+	// of its physical register at dispatch, so a wakeup only visits actual dependents.
+	// Operands are named by slot = (3 * IQ index) + operand, where operand is 0 (A), 1 (B), or 2 (D).
+	unsigned int num_phys_regs;	// Number of physical registers (consumer lists).
+	int* cons_head;			// Per physical register: first operand slot waiting on it, or -1.
+	int* cons_next;			// Per operand slot: next slot waiting on the same register, or -1.
+	int* cons_prev;			// Per operand slot: previous slot waiting on the same register, or -1.
+
 	void remove(unsigned int i);	// Remove the instruction in issue queue entry 'i' from the issue queue.
 
+	void link_consumer(unsigned int tag, unsigned int slot);
+	void unlink_consumer(unsigned int tag, unsigned int slot);
+	void update_ready(unsigned int i);				// Recompute the ready bit of IQ entry 'i'.
+	int find_ready(unsigned int from, unsigned int to);	// First ready IQ index in [from, to), or -1.
+	bool issue(unsigned int i, unsigned int& free_lanes, lane* Execution_Lanes);	// Try to issue IQ entry 'i' to a free lane.
+
+	void wakeup_cam(unsigned int tag);		// Broadcast the tag to all entries.
+	void wakeup_consumers(unsigned int tag);	// Wake up only the consumers linked to the tag.
+
 
 public:
-	issue_queue(unsigned int size, unsigned int num_parts, pipeline_t* _proc=NULL);	// constructor
+	issue_queue(unsigned int size, unsigned int num_parts, unsigned int num_phys_regs, pipeline_t* _proc=NULL);	// constructor
 	bool stall(unsigned int bundle_inst);
 	void dispatch(unsigned int index, unsigned long long branch_mask, unsigned int lane_id,
 	              bool A_valid, bool A_ready, unsigned int A_tag,
@@ -77,6 +105,8 @@ public:
 	              bool D_valid, bool D_ready, unsigned int D_tag);
 	void wakeup(unsigned int tag);
 	void select_and_issue(unsigned int num_lanes, lane* Execution_Lanes);
+	bool any_ready();				// Whether any IQ entry is ready to issue.
+	void skip_cycles(uint64_t cycles);		// Account for 'cycles' cycles in which nothing was ready to issue.
 	void flush();
 	void clear_branch_bit(unsigned int branch_ID);
 	void squash(unsigned int branch_ID);
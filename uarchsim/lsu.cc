@@ -11,10 +11,193 @@
 #include "stats.h"
 
 
+lsq_index::lsq_index(unsigned int n_entries) {
+	n_buckets = 1;
+	while (n_buckets < (2 * n_entries))
+		n_buckets <<= 1;
+
+	bucket_head = new int[n_buckets];
+	next = new int[n_entries];
+	prev = new int[n_entries];
+	bucket = new int[n_entries];
+	for (unsigned int i = 0; i < n_entries; i++)
+		bucket[i] = -1;
+	for (unsigned int i = 0; i < n_buckets; i++)
+		bucket_head[i] = -1;
+}
+
+lsq_index::~lsq_index() {
+	delete [] bucket_head;
+	delete [] next;
+	delete [] prev;
+	delete [] bucket;
+}
+
+void lsq_index::insert(unsigned int entry, reg_t addr) {
+	unsigned int b = hash(addr);
+
+	remove(entry);
+	bucket[entry] = b;
+	prev[entry] = -1;
+	next[entry] = bucket_head[b];
+	if (bucket_head[b] != -1)
+		prev[bucket_head[b]] = entry;
+	bucket_head[b] = entry;
+}
+
+void lsq_index::remove(unsigned int entry) {
+	if (bucket[entry] == -1)
+		return;
+
+	if (prev[entry] == -1)
+		bucket_head[bucket[entry]] = next[entry];
+	else
+		next[prev[entry]] = next[entry];
+	if (next[entry] != -1)
+		prev[next[entry]] = prev[entry];
+	bucket[entry] = -1;
+}
+
+void lsq_index::clear() {
+	for (unsigned int i = 0; i < n_buckets; i++) {
+		while (bucket_head[i] != -1)
+			remove(bucket_head[i]);
+	}
+}
+
+
 bool lsu::disambiguate(unsigned int lq_index,
                        unsigned int sq_index, bool sq_index_phase,
                        bool& forward,
                        unsigned int& store_entry) {
+	bool stall;
+
+	if (LSQ_SEARCH == LSQ_SEARCH_SCAN)
+		return(disambiguate_scan(lq_index, sq_index, sq_index_phase, forward, store_entry));
+
+	stall = disambiguate_indexed(lq_index, sq_index, sq_index_phase, forward, store_entry);
+
+	if (LSQ_SEARCH == LSQ_SEARCH_CHECK) {
+		bool check_stall, check_forward;
+		unsigned int check_store_entry;
+		check_stall = disambiguate_scan(lq_index, sq_index, sq_index_phase, check_forward, check_store_entry);
+		assert(stall == check_stall);
+		assert(forward == check_forward);
+		assert(!(stall || forward) || (store_entry == check_store_entry));
+	}
+
+	return(stall);
+}
+
+bool lsu::disambiguate_indexed(unsigned int lq_index,
+                               unsigned int sq_index, bool sq_index_phase,
+                               bool& forward,
+                               unsigned int& store_entry) {
+	unsigned int end;	// stores at positions [0, end) are prior to the load
+	int unknown;		// youngest prior store with an unknown address
+	unsigned int unknown_pos;
+	int match;		// youngest prior store with a conflicting address
+	unsigned int match_pos;
+	unsigned int pos;
+	unsigned int max_size;
+	unsigned int mask;
+
+	forward = false;
+
+	end = sq_pos(sq_index, sq_index_phase);
+	if (end == 0) {
+		// There are no stores prior to the load.
+		return(false);
+	}
+	assert((sq_length > 0) && (end <= sq_length));
+
+	// An unknown store address is only a reason to stall if the prediction says so.
+	unknown = -1;
+	unknown_pos = 0;
+	if (LQ[lq_index].mdp_stall) {
+		if ((sq_head + end) <= sq_size) {
+			unknown = find_last_bit(sq_unknown, sq_head, sq_head + end);
+		}
+		else {
+			unknown = find_last_bit(sq_unknown, 0, sq_head + end - sq_size);
+			if (unknown == -1)
+				unknown = find_last_bit(sq_unknown, sq_head, sq_size);
+		}
+		if (unknown != -1)
+			unknown_pos = MOD_S((sq_size + unknown - sq_head), sq_size);
+	}
+
+	// Find the youngest prior store that conflicts with the load.
+	match = -1;
+	match_pos = 0;
+	for (int e = sq_addr_index->first(LQ[lq_index].addr); e != -1; e = sq_addr_index->next_entry(e)) {
+		pos = MOD_S((sq_size + e - sq_head), sq_size);
+		if ((pos < end) && ((match == -1) || (pos > match_pos))) {
+			assert(SQ[e].valid && SQ[e].addr_avail);
+			max_size = MAX(SQ[e].size, LQ[lq_index].size);
+			mask = (~(max_size - 1));
+			if ((SQ[e].addr & mask) == (LQ[lq_index].addr & mask)) {
+				match = e;
+				match_pos = pos;
+			}
+		}
+	}
+
+	if ((unknown != -1) && ((match == -1) || (unknown_pos > match_pos))) {
+		store_entry = unknown;
+		return(true);    // stall: possible conflict
+	}
+	else if (match != -1) {
+		store_entry = match;
+		if (SQ[match].size != LQ[lq_index].size)
+			return(true);    // stall: partial conflict scenarios are hard
+		else if (!SQ[match].value_avail)
+			return(true);    // stall: must wait for value to be available
+		forward = true;    // forward: sizes match and value is available
+	}
+	return(false);
+}
+
+// Highest set bit of the bit vector in the index range [from, to), or -1.
+int lsu::find_last_bit(uint64_t* bits, unsigned int from, unsigned int to) {
+	uint64_t word;
+	unsigned int w;
+
+	while (to > from) {
+		w = ((to - 1) >> 6);
+		word = bits[w];
+		if (((to - 1) & 63) != 63)
+			word &= ((1ULL << (((to - 1) & 63) + 1)) - 1);
+		if ((w << 6) < from)
+			word &= (~0ULL << (from & 63));
+		if (word)
+			return((w << 6) + (63 - __builtin_clzll(word)));
+		to = (w << 6);
+	}
+	return(-1);
+}
+
+// Lowest set bit of the bit vector in the index range [from, to), or -1.
+int lsu::find_first_bit(uint64_t* bits, unsigned int from, unsigned int to) {
+	uint64_t word;
+	unsigned int w;
+
+	while (from < to) {
+		w = (from >> 6);
+		word = (bits[w] & (~0ULL << (from & 63)));
+		if (word) {
+			unsigned int i = ((w << 6) + __builtin_ctzll(word));
+			return((i < to) ? (int)i : -1);
+		}
+		from = ((w + 1) << 6);
+	}
+	return(-1);
+}
+
+bool lsu::disambiguate_scan(unsigned int lq_index,
+                            unsigned int sq_index, bool sq_index_phase,
+                            bool& forward,
+                            unsigned int& store_entry) {
 	bool stall;		// return value
 	unsigned int max_size;
 	unsigned int mask;
@@ -60,12 +243,64 @@ bool lsu::disambiguate(unsigned int lq_index,
 	}
 
 	return(stall);
-}	// disambiguate()
+}	// disambiguate_scan()
 
 bool lsu::ld_violation(unsigned int sq_index,
                        unsigned int lq_index, bool lq_index_phase,
                        unsigned int& load_entry) {
    bool misp;
+
+   if (LSQ_SEARCH == LSQ_SEARCH_SCAN)
+      return(ld_violation_scan(sq_index, lq_index, lq_index_phase, load_entry));
+
+   misp = ld_violation_indexed(sq_index, lq_index, lq_index_phase, load_entry);
+
+   if (LSQ_SEARCH == LSQ_SEARCH_CHECK) {
+      unsigned int check_load_entry;
+      assert(misp == ld_violation_scan(sq_index, lq_index, lq_index_phase, check_load_entry));
+      assert(!misp || (load_entry == check_load_entry));
+   }
+
+   return(misp);
+}
+
+bool lsu::ld_violation_indexed(unsigned int sq_index,
+                               unsigned int lq_index, bool lq_index_phase,
+                               unsigned int& load_entry) {
+   unsigned int start;   // loads at positions [start, lq_length) are after the store
+   int match;            // oldest later load that already has a conflicting value
+   unsigned int match_pos;
+   unsigned int pos;
+   unsigned int max_size;
+   unsigned int mask;
+
+   start = lq_pos(lq_index, lq_index_phase);
+   assert(start <= lq_length);
+
+   match = -1;
+   match_pos = 0;
+   for (int e = lq_addr_index->first(SQ[sq_index].addr); e != -1; e = lq_addr_index->next_entry(e)) {
+      pos = MOD_S((lq_size + e - lq_head), lq_size);
+      if ((pos >= start) && (pos < lq_length) && ((match == -1) || (pos < match_pos)) && LQ[e].value_avail) {
+         max_size = MAX(SQ[sq_index].size, LQ[e].size);
+         mask = (~(max_size - 1));
+         if ((SQ[sq_index].addr & mask) == (LQ[e].addr & mask)) {
+            match = e;
+            match_pos = pos;
+         }
+      }
+   }
+
+   if (match == -1)
+      return(false);
+   load_entry = match;
+   return(true);
+}
+
+bool lsu::ld_violation_scan(unsigned int sq_index,
+                            unsigned int lq_index, bool lq_index_phase,
+                            unsigned int& load_entry) {
+   bool misp;
    bool load_entry_phase;
    unsigned int max_size;
    unsigned int mask;
@@ -90,12 +325,20 @@ bool lsu::ld_violation(unsigned int sq_index,
    }
 
    return(misp);
-} // ld_violation()
+} // ld_violation_scan()
 
 void lsu::set_l2_cache(CacheClass* l2_dc){
 	DC->set_nextLevel(l2_dc);
 }
 
+void lsu::save_cache_state(std::ostream& out){
+	DC->save_state(out);
+}
+
+bool lsu::restore_cache_state(std::istream& in){
+	return(DC->restore_state(in));
+}
+
 lsu::lsu(unsigned int lq_size, unsigned int sq_size, unsigned int Tid, mmu_t* _mmu, pipeline_t* _proc):
       proc(_proc),
       mmu(_mmu)
@@ -126,6 +369,8 @@ lsu::lsu(unsigned int lq_size, unsigned int sq_size, unsigned int Tid, mmu_t* _m
 	LQ = new lsq_entry[lq_size];
 	for (unsigned int i = 0; i < lq_size; i++) {
 		LQ[i].valid = false;
+		LQ[i].replay = REPLAY_NONE;
+		LQ[i].wheel_bucket = -1;
 	}
 
 	// SQ initialization.
@@ -141,6 +386,27 @@ lsu::lsu(unsigned int lq_size, unsigned int sq_size, unsigned int Tid, mmu_t* _m
 		SQ[i].valid = false;
   }
 
+	// Search structures initialization.
+	lq_addr_index = new lsq_index(lq_size);
+	sq_addr_index = new lsq_index(sq_size);
+	sq_unknown = new uint64_t[(sq_size + 63) / 64];
+	for (unsigned int i = 0; i < ((sq_size + 63) / 64); i++) {
+		sq_unknown[i] = 0;
+	}
+
+	// Stalled-load replay initialization.
+	replay_ready = new uint64_t[(lq_size + 63) / 64];
+	replay_wait = new uint64_t[(lq_size + 63) / 64];
+	for (unsigned int i = 0; i < ((lq_size + 63) / 64); i++) {
+		replay_ready[i] = 0;
+		replay_wait[i] = 0;
+	}
+	wheel = new int[REPLAY_WHEEL_SIZE];
+	for (unsigned int i = 0; i < REPLAY_WHEEL_SIZE; i++) {
+		wheel[i] = -1;
+	}
+	wheel_next_cycle = 0;
+
 	// STATS
 	n_stall_disambig = 0;
 	n_forward = 0;
@@ -152,6 +418,12 @@ lsu::lsu(unsigned int lq_size, unsigned int sq_size, unsigned int Tid, mmu_t* _m
 
 lsu::~lsu(){
   delete DC;
+  delete lq_addr_index;
+  delete sq_addr_index;
+  delete [] sq_unknown;
+  delete [] replay_ready;
+  delete [] replay_wait;
+  delete [] wheel;
 }
 
 bool lsu::stall(unsigned int bundle_load, unsigned int bundle_store) {
@@ -200,6 +472,11 @@ void lsu::dispatch(bool load,
 
                 LQ[lq_tail].mdp_stall = mdp_stall;
 
+		// The entry may still be indexed under the address of a squashed load,
+		// and may still be scheduled for replay.
+		lq_addr_index->remove(lq_tail);
+		replay_set(lq_tail, REPLAY_NONE);
+
 		// STATS
 		LQ[lq_tail].stat_load_stall_disambig = false;
 		LQ[lq_tail].stat_load_stall_miss = false;
@@ -237,6 +514,10 @@ void lsu::dispatch(bool load,
 
 		SQ[sq_tail].pay_index = pay_index;
 
+		// The store's address is unknown until it executes.
+		sq_addr_index->remove(sq_tail);
+		sq_unknown[sq_tail >> 6] |= (1ULL << (sq_tail & 63));
+
 		// STATS
 		SQ[sq_tail].stat_load_stall_disambig = false;
 		SQ[sq_tail].stat_load_stall_miss = false;
@@ -288,6 +569,9 @@ void lsu::store_addr(cycle_t cycle,
 
    SQ[sq_index].addr_avail = true;
    SQ[sq_index].addr = addr;
+   sq_unknown[sq_index >> 6] &= ~(1ULL << (sq_index & 63));
+   sq_addr_index->insert(sq_index, addr);
+   replay_wake_store(sq_index, true);
 
    // Detect and mark load violations.
    if (SPEC_DISAMBIG) {
@@ -320,6 +604,7 @@ void lsu::store_value(unsigned int sq_index, reg_t value) {
 
 	SQ[sq_index].value_avail = true;
 	SQ[sq_index].value = value;
+	replay_wake_store(sq_index, false);
 }
 
 
@@ -334,6 +619,7 @@ bool lsu::load_addr(cycle_t cycle,
 	// Set up information for executing the load.
 	LQ[lq_index].addr_avail = true;
 	LQ[lq_index].addr = addr;
+	lq_addr_index->insert(lq_index, addr);
 	//LQ[lq_index].back_data = back_data;
 
   #ifdef RISCV_MICRO_DEBUG
@@ -363,6 +649,205 @@ bool lsu::load_addr(cycle_t cycle,
 }
 
 bool lsu::load_unstall(cycle_t cycle, unsigned int& pay_index, reg_t& value) {
+   int scan;
+   bool scan_phase;
+   bool unstalled = false;
+
+   if (LSQ_SEARCH == LSQ_SEARCH_SCAN)
+      return(load_unstall_scan(cycle, pay_index, value));
+
+   // Wake up loads whose cache misses have resolved by this cycle.
+   replay_advance(cycle);
+
+   // A load left waiting on a cache miss must still be clear of all prior stores:
+   // the linear scan would replay it now and stall on, or forward from, a store.
+   if (LSQ_SEARCH == LSQ_SEARCH_CHECK) {
+      for (unsigned int i = 0; i < lq_size; i++) {
+         if ((LQ[i].replay == REPLAY_MISS) && (MOD_S((lq_size + i - lq_head), lq_size) < lq_length)) {
+            bool check_forward;
+            unsigned int check_store_entry;
+            assert(!disambiguate_scan(i, LQ[i].sq_index, LQ[i].sq_index_phase, check_forward, check_store_entry));
+            assert(!check_forward);
+         }
+      }
+   }
+
+   // Replay the candidate loads oldest first, i.e., LQ indices [lq_head, lq_size) then [0, lq_head),
+   // until one of them unstalls. Loads that are not candidates would stall again if replayed.
+   for (unsigned int pass = 0; (pass < 2) && !unstalled; pass++) {
+      unsigned int to = ((pass == 0) ? lq_size : lq_head);
+      scan_phase = ((pass == 0) ? lq_head_phase : !lq_head_phase);
+      for (scan = find_first_bit(replay_ready, ((pass == 0) ? lq_head : 0), to);
+           (scan != -1) && !unstalled;
+           scan = find_first_bit(replay_ready, scan + 1, to)) {
+         if ((MOD_S((lq_size + scan - lq_head), lq_size) >= lq_length) || !LQ[scan].addr_avail || LQ[scan].value_avail) {
+            // The load was squashed.
+            replay_set(scan, REPLAY_NONE);
+            continue;
+         }
+         assert(LQ[scan].valid);
+
+         // If this load did not get an MHSR during initial execution, access the D$ again.
+         if (!PERFECT_DCACHE && (LQ[scan].miss_resolve_cycle == -1)) {
+            bool hit;
+            LQ[scan].miss_resolve_cycle = DC->Access(Tid, cycle, LQ[scan].addr, false, &hit);
+            LQ[scan].missed = !hit;
+         }
+
+         // Check if load is unstalled.
+         execute_load(cycle, scan, scan_phase, LQ[scan].sq_index, LQ[scan].sq_index_phase);
+         unstalled = LQ[scan].value_avail;
+         pay_index = LQ[scan].pay_index;
+         value = LQ[scan].value;
+      }
+   }
+   return(unstalled);
+}
+
+// Returns true if load_unstall() cannot replay any load before 'next_cycle':
+// no load is waiting to be replayed at the next opportunity, and every load
+// stalled on a cache miss is in the timing wheel.  'next_cycle' is lowered to
+// the earliest cycle at which one of those misses resolves.
+bool lsu::replay_idle(cycle_t& next_cycle) {
+   unsigned int i;
+
+   if (LSQ_SEARCH == LSQ_SEARCH_SCAN)
+      return(false);
+
+   for (i = 0; i < ((lq_size + 63) / 64); i++) {
+      if (replay_ready[i])
+         return(false);
+   }
+
+   for (i = 0; i < lq_size; i++) {
+      if ((LQ[i].replay == REPLAY_MISS) && (LQ[i].miss_resolve_cycle < next_cycle))
+         next_cycle = LQ[i].miss_resolve_cycle;
+   }
+   return(true);
+}
+
+// Move a load between replay states.
+void lsu::replay_set(unsigned int lq_index, unsigned int state) {
+   uint64_t bit = (1ULL << (lq_index & 63));
+
+   // Leave the current state.
+   switch (LQ[lq_index].replay) {
+      case REPLAY_POLL:
+      case REPLAY_READY:
+         replay_ready[lq_index >> 6] &= ~bit;
+         break;
+      case REPLAY_STORE:
+         replay_wait[lq_index >> 6] &= ~bit;
+         break;
+      case REPLAY_MISS:
+         if (LQ[lq_index].wheel_bucket != -1) {
+            if (LQ[lq_index].wheel_prev == -1)
+               wheel[LQ[lq_index].wheel_bucket] = LQ[lq_index].wheel_next;
+            else
+               LQ[LQ[lq_index].wheel_prev].wheel_next = LQ[lq_index].wheel_next;
+            if (LQ[lq_index].wheel_next != -1)
+               LQ[LQ[lq_index].wheel_next].wheel_prev = LQ[lq_index].wheel_prev;
+            LQ[lq_index].wheel_bucket = -1;
+         }
+         break;
+      default:
+         break;
+   }
+
+   // Enter the new state.
+   LQ[lq_index].replay = state;
+   switch (state) {
+      case REPLAY_POLL:
+      case REPLAY_READY:
+         replay_ready[lq_index >> 6] |= bit;
+         break;
+      case REPLAY_STORE:
+         replay_wait[lq_index >> 6] |= bit;
+         break;
+      case REPLAY_MISS: {
+         int b = (int)(LQ[lq_index].miss_resolve_cycle & (REPLAY_WHEEL_SIZE - 1));
+         LQ[lq_index].wheel_bucket = b;
+         LQ[lq_index].wheel_prev = -1;
+         LQ[lq_index].wheel_next = wheel[b];
+         if (wheel[b] != -1)
+            LQ[wheel[b]].wheel_prev = lq_index;
+         wheel[b] = lq_index;
+         break;
+      }
+      default:
+         break;
+   }
+}
+
+// Schedule the replay of a load that just stalled.
+void lsu::replay_stalled(unsigned int lq_index, unsigned int state, unsigned int store_entry) {
+   // Loads without an MHSR retry the D$ at every replay, and load reservations
+   // wait to reach the LQ head, so both are replayed every cycle.
+   if (LQ[lq_index].amo || (!PERFECT_DCACHE && (LQ[lq_index].miss_resolve_cycle == -1)))
+      state = REPLAY_POLL;
+   // The miss may already have been passed by the timing wheel.
+   else if ((state == REPLAY_MISS) && (LQ[lq_index].miss_resolve_cycle < wheel_next_cycle))
+      state = REPLAY_READY;
+
+   LQ[lq_index].replay_store = store_entry;
+   replay_set(lq_index, state);
+}
+
+// A store's address or value became known, or it committed: wake up loads that may no longer stall on it.
+// A load that does not stall on unknown store addresses may also find a closer conflicting store once any
+// prior store's address becomes known.  So may a later load waiting on a cache miss: it now stalls on,
+// or forwards from, the store instead of waiting for the miss.
+void lsu::replay_wake_store(unsigned int sq_index, bool addr_event) {
+   unsigned int pos;
+   unsigned int max_size;
+   unsigned int mask;
+
+   for (int l = find_first_bit(replay_wait, 0, lq_size); l != -1; l = find_first_bit(replay_wait, l + 1, lq_size)) {
+      if ((LQ[l].replay_store == sq_index) || (addr_event && !LQ[l].mdp_stall))
+         replay_set(l, REPLAY_READY);
+   }
+
+   if (addr_event) {
+      pos = MOD_S((sq_size + sq_index - sq_head), sq_size);
+      for (int e = lq_addr_index->first(SQ[sq_index].addr); e != -1; e = lq_addr_index->next_entry(e)) {
+         if ((LQ[e].replay == REPLAY_MISS) &&
+             (MOD_S((lq_size + e - lq_head), lq_size) < lq_length) &&
+             (pos < sq_pos(LQ[e].sq_index, LQ[e].sq_index_phase))) {
+            max_size = MAX(SQ[sq_index].size, LQ[e].size);
+            mask = (~(max_size - 1));
+            if ((SQ[sq_index].addr & mask) == (LQ[e].addr & mask))
+               replay_set(e, REPLAY_READY);
+         }
+      }
+   }
+}
+
+// Process the timing wheel buckets of all cycles up to and including 'cycle'.
+void lsu::replay_advance(cycle_t cycle) {
+   cycle_t c;
+   int l, next;
+
+   if (cycle < wheel_next_cycle)
+      return;
+
+   // One lap of the wheel visits every bucket.
+   c = wheel_next_cycle;
+   if ((cycle - c) >= REPLAY_WHEEL_SIZE)
+      c = (cycle - REPLAY_WHEEL_SIZE + 1);
+
+   for (; c <= cycle; c++) {
+      l = wheel[c & (REPLAY_WHEEL_SIZE - 1)];
+      while (l != -1) {
+         next = LQ[l].wheel_next;
+         if (LQ[l].miss_resolve_cycle <= cycle)
+            replay_set(l, REPLAY_READY);
+         l = next;
+      }
+   }
+   wheel_next_cycle = (cycle + 1);
+}
+
+bool lsu::load_unstall_scan(cycle_t cycle, unsigned int& pay_index, reg_t& value) {
    unsigned int scan = lq_head;
    bool scan_phase = lq_head_phase;
    bool unstalled = false;
@@ -409,6 +894,7 @@ void lsu::execute_load(cycle_t cycle,
            }
            else {
 	      // Load reservation has not yet reached the head of the LQ and must stall.
+	      replay_stalled(lq_index, REPLAY_POLL, 0);
 	      return;
 	   }
         }
@@ -425,6 +911,8 @@ void lsu::execute_load(cycle_t cycle,
 	if (stall_disambig) {
 		// STATS
 		LQ[lq_index].stat_load_stall_disambig = true;
+
+		replay_stalled(lq_index, REPLAY_STORE, store_entry);
 	}
 	else if (forward) {
 		// STATS
@@ -548,8 +1036,13 @@ void lsu::execute_load(cycle_t cycle,
 	else {
 		// STATS
 		LQ[lq_index].stat_load_stall_miss = true;
+
+		replay_stalled(lq_index, REPLAY_MISS, 0);
 	}
 
+	if (LQ[lq_index].value_avail)
+		replay_set(lq_index, REPLAY_NONE);
+
 }
 
 
@@ -712,6 +1205,9 @@ bool lsu::commit(bool load, bool atomic_op, bool& atomic_success) {
          inc_counter(store_miss_count);
       }
 
+      // Loads stalled on this store must look past it now.
+      replay_wake_store(sq_head, false);
+
       // Invalidate the entry.
       SQ[sq_head].valid = false;
   
@@ -751,6 +1247,21 @@ void lsu::flush() {
 	for (unsigned int i = 0; i < sq_size; i++) {
 		SQ[i].valid = false;
 	}
+
+	lq_addr_index->clear();
+	sq_addr_index->clear();
+
+	for (unsigned int i = 0; i < lq_size; i++) {
+		LQ[i].replay = REPLAY_NONE;
+		LQ[i].wheel_bucket = -1;
+	}
+	for (unsigned int i = 0; i < ((lq_size + 63) / 64); i++) {
+		replay_ready[i] = 0;
+		replay_wait[i] = 0;
+	}
+	for (unsigned int i = 0; i < REPLAY_WHEEL_SIZE; i++) {
+		wheel[i] = -1;
+	}
 }
 
 
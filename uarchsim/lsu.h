@@ -38,6 +38,13 @@ typedef struct {
   // and a prediction from the memory dependence predictor (MDP).
   bool mdp_stall;
 
+  // Scheduling of replays for a stalled load (see load_unstall()).
+  unsigned int replay;    // REPLAY_* state
+  unsigned int replay_store;  // SQ index of the store the load is stalled on (REPLAY_STORE)
+  int wheel_bucket;   // timing wheel bucket the load is linked into (REPLAY_MISS), or -1
+  int wheel_next;
+  int wheel_prev;
+
   // STATS
   bool stat_load_stall_disambig;  // Load stalled due to unknown store address and/or value.
   bool stat_load_stall_miss;  // Load stalled due to a cache miss.
@@ -46,6 +53,51 @@ typedef struct {
 } lsq_entry;
 
 
+// Address-hashed index over the entries of the LQ or the SQ.
+// Entries whose address is known are linked into a bucket selected by a hash of the
+// aligned doubleword containing the address. Two accesses can only conflict if they
+// fall in the same aligned doubleword, so a search only needs to visit one bucket.
+// Stale links (entries that were squashed or retired) are harmless: searches filter
+// entries by their position in the queue, and an entry is unlinked when it is reused.
+class lsq_index {
+private:
+  unsigned int n_buckets;   // power of 2
+  int* bucket_head;   // first entry in each bucket, or -1
+  int* next;          // per entry: next entry in the same bucket, or -1
+  int* prev;          // per entry: previous entry in the same bucket, or -1
+  int* bucket;        // per entry: bucket it is linked into, or -1 if not linked
+
+  unsigned int hash(reg_t addr) {
+    reg_t dw = (addr >> 3);
+    return((unsigned int)(dw ^ (dw >> 13)) & (n_buckets - 1));
+  }
+
+public:
+  lsq_index(unsigned int n_entries);
+  ~lsq_index();
+  void insert(unsigned int entry, reg_t addr);
+  void remove(unsigned int entry);
+  void clear();
+
+  // Iterate over the entries linked into the bucket of 'addr'.
+  int first(reg_t addr) { return(bucket_head[hash(addr)]); }
+  int next_entry(int entry) { return(next[entry]); }
+};
+
+// Replay state of a load in the LQ.
+#define REPLAY_NONE   0   // not stalled
+#define REPLAY_POLL   1   // replay every cycle (no MHSR yet, or an amo waiting for the LQ head)
+#define REPLAY_READY  2   // stall condition may have changed: replay at the next opportunity
+#define REPLAY_STORE  3   // stalled on a prior store: wait for that store to change
+#define REPLAY_MISS   4   // stalled on a cache miss: wait in the timing wheel until miss_resolve_cycle
+
+#define REPLAY_WHEEL_SIZE 512   // timing wheel buckets, power of 2
+
+// LSQ search modes (LSQ_SEARCH).
+#define LSQ_SEARCH_INDEXED  0   // address-hashed index
+#define LSQ_SEARCH_SCAN     1   // linear scan of the LQ/SQ
+#define LSQ_SEARCH_CHECK    2   // address-hashed index, checked against the linear scan
+
 //Forward declaring classes 
 class mmu_t;
 class pipeline_t;
@@ -85,6 +137,25 @@ private:
   bool sq_head_phase;
   bool sq_tail_phase;
 
+  //////////////////////////
+  // Search structures
+  //////////////////////////
+  lsq_index* lq_addr_index;   // Loads with known addresses.
+  lsq_index* sq_addr_index;   // Stores with known addresses.
+  uint64_t* sq_unknown;       // Bit vector of stores with unknown addresses, one bit per SQ entry.
+
+  //////////////////////////
+  // Stalled-load replay
+  //////////////////////////
+  // Only loads whose stall condition can have changed are replayed:
+  // loads in the replay_ready bit vector are replayed (oldest first), loads
+  // waiting on a store are woken by that store's events, and loads waiting on
+  // a cache miss are woken by the timing wheel when the miss resolves.
+  uint64_t* replay_ready;     // Bit vector of REPLAY_POLL/REPLAY_READY loads, one bit per LQ entry.
+  uint64_t* replay_wait;      // Bit vector of REPLAY_STORE loads, one bit per LQ entry.
+  int* wheel;                 // Timing wheel: first load of each bucket, or -1.
+  cycle_t wheel_next_cycle;   // Next cycle whose bucket has not been processed.
+
   //////////////////////////
   // Data Cache
   //////////////////////////
@@ -130,16 +201,51 @@ private:
                     unsigned int sq_index, bool sq_index_phase,
                     bool& forward,
                     unsigned int& store_entry);
+  bool disambiguate_scan(unsigned int lq_index,
+                         unsigned int sq_index, bool sq_index_phase,
+                         bool& forward,
+                         unsigned int& store_entry);
+  bool disambiguate_indexed(unsigned int lq_index,
+                            unsigned int sq_index, bool sq_index_phase,
+                            bool& forward,
+                            unsigned int& store_entry);
 
   // The load execution datapath.
   void execute_load(cycle_t cycle,
                     unsigned int lq_index, bool lq_index_phase,
                     unsigned int sq_index, bool sq_index_phase);
 
+  // Stalled-load replay scheduling.
+  void replay_set(unsigned int lq_index, unsigned int state);
+  void replay_stalled(unsigned int lq_index, unsigned int state, unsigned int store_entry);
+  void replay_wake_store(unsigned int sq_index, bool addr_event);
+  void replay_advance(cycle_t cycle);
+  bool load_unstall_scan(cycle_t cycle, unsigned int& pay_index, reg_t& value);
+
   // The path for stores to detect mispredicted loads.
   bool ld_violation(unsigned int sq_index,
                     unsigned int lq_index, bool lq_index_phase,
                     unsigned int& load_entry);
+  bool ld_violation_scan(unsigned int sq_index,
+                         unsigned int lq_index, bool lq_index_phase,
+                         unsigned int& load_entry);
+  bool ld_violation_indexed(unsigned int sq_index,
+                            unsigned int lq_index, bool lq_index_phase,
+                            unsigned int& load_entry);
+
+  int find_last_bit(uint64_t* bits, unsigned int from, unsigned int to);
+  int find_first_bit(uint64_t* bits, unsigned int from, unsigned int to);
+
+  // Position of a LQ/SQ index (with its phase bit) relative to the queue's head.
+  // Valid entries are at positions [0, length); the tail is at position length.
+  unsigned int lq_pos(unsigned int index, bool phase) {
+    unsigned int pos = MOD_S((lq_size + index - lq_head), lq_size);
+    return(((pos == 0) && (phase != lq_head_phase)) ? lq_size : pos);
+  }
+  unsigned int sq_pos(unsigned int index, bool phase) {
+    unsigned int pos = MOD_S((sq_size + index - sq_head), sq_size);
+    return(((pos == 0) && (phase != sq_head_phase)) ? sq_size : pos);
+  }
 
   // Allocate a chunk of memory.
   char* mem_newblock(void);
@@ -152,6 +258,10 @@ public:
 
   void set_l2_cache(CacheClass* l2_dc);
 
+  // Save/restore the D$ as a checkpoint's warm state (see CacheClass).
+  void save_cache_state(std::ostream& out);
+  bool restore_cache_state(std::istream& in);
+
   bool stall(unsigned int bundle_load, unsigned int bundle_store);
 
   void dispatch(bool load, unsigned int size, bool left, bool right, bool is_signed, bool amo,
@@ -173,6 +283,7 @@ public:
                  //reg_t back_data, // LWL/LWR
                  reg_t& value);
   bool load_unstall(cycle_t cycle, unsigned int& pay_index, reg_t& value);
+  bool replay_idle(cycle_t& next_cycle);
 
   void checkpoint(unsigned int& chkpt_lq_tail, bool& chkpt_lq_tail_phase,
                   unsigned int& chkpt_sq_tail, bool& chkpt_sq_tail_phase);
@@ -21,7 +21,13 @@ static void help()
 {
   fprintf(stderr, "usage: micros [host options] <target program> [target options]\n");
   fprintf(stderr, "Host Options:\n");
-  fprintf(stderr, "  -c<gz_chkpt_file>  Start simulation from a .gz checkpoint file.\n");
+  fprintf(stderr, "  -c<chkpt_file>     Start simulation from a checkpoint file (sparse, or legacy .gz).\n");
+  fprintf(stderr, "  --mkchkpt=<file>   Create a checkpoint file after fast skipping (-s)\n");
+  fprintf(stderr, "  --chkptsparse=<n>  Checkpoint format to create: 1 = sparse (default), 0 = legacy .gz\n");
+  fprintf(stderr, "  --chkptlazy=<n>    1 = restore a sparse checkpoint's memory as it is touched (default), 0 = up front\n");
+  fprintf(stderr, "  --shareimg=<n>     1 = ISA and timing simulators share one copy-on-write image of a checkpoint's memory (default), 0 = each restores its own\n");
+  fprintf(stderr, "  --htifdump=<n>     1 = dump the HTIF transactions replayed from a checkpoint to restore.htif, as text (default 0)\n");
+  fprintf(stderr, "  --chkptwarm=<n>    1 = create the checkpoint where timing simulation stops (-e), with warm caches and predictors, 0 = after fast skipping (default)\n");
   fprintf(stderr, "  -d                 Interactive debug mode\n");
   fprintf(stderr, "  -e<n>              End simulation after <n> instructions have been committed by microarchitectural simulation\n");
   fprintf(stderr, "  -g                 Track histogram of PCs\n");
@@ -33,6 +39,10 @@ static void help()
   fprintf(stderr, "  --perf=<pbp>,<pdc>,<pic>,<ptc>\tEach of pbp (perf. branch pred.), pdc (perf. D$), pic (perf. I$), and ptc (perf. T$), are 0 or 1\n");
   fprintf(stderr, "  --cp=<n>           <n> branch checkpoints for mispredict recovery\n");
   fprintf(stderr, "  --btb=<n>          BTB has <n> entries\n");
+  fprintf(stderr, "  --btb2=<n>         Second-level BTB has <n> entries (0 = off, default)\n");
+  fprintf(stderr, "  --btb2assoc=<n>    Second-level BTB associativity (default 8)\n");
+  fprintf(stderr, "  --btb2lat=<n>      Second-level BTB hit latency, in fetch cycles (default 2)\n");
+  fprintf(stderr, "  --btb2region=<n>   Second-level BTB hit: copy the branches of the aligned <n>-instruction region to the BTB (default 16)\n");
   fprintf(stderr, "  --ctiq=<n>         CTIQ / BranchQ has <n> entries\n");
   fprintf(stderr, "  --bp=<n>           Brach Counter Table has <n> entries\n");
   fprintf(stderr, "  --ras=<n>          RAS has <n> entries\n");
@@ -42,8 +52,27 @@ static void help()
   fprintf(stderr, "  --iqnp=<n>         Issue Queue has <n> partitions for round-robin partition-based priority adjustment\n");
   fprintf(stderr, "  -a                 Enable pre-steering in dispatch stage (override dynamic lane steering at issue stage)\n");
   fprintf(stderr, "  -b                 Enable ideal age-based scheduling (override position-based scheduling)\n");
+  fprintf(stderr, "  --iqwake=<n>       Issue Queue wakeup model: 0 = consumer lists (default), 1 = CAM broadcast, 2 = consumer lists checked against CAM\n");
   fprintf(stderr, "  --lsq=<n>          Load/Store Queue has <n> entries\n");
   fprintf(stderr, "  --disambig=<oracle>,<spec>,<mdp>\tEach of <oracle> (oracle memory disambig.), <spec> (speculative memory disambig.), and <mdp> (mem. dep. predictor), are 0 or 1\n");
+  fprintf(stderr, "  --lsqsearch=<n>    LSQ search: 0 = address-hashed index and scheduled load replay (default), 1 = linear scans, 2 = index checked against linear scan\n");
+  fprintf(stderr, "  --checkerthread=<n> Functional simulator (checker): 0 = stepped on demand, 1 = runs ahead on its own thread if the host has >1 hardware threads (default), 2 = always on its own thread\n");
+  fprintf(stderr, "  --idleskip=<n>     1 = skip over cycles in which the pipeline is provably idle (default), 0 = simulate every cycle\n");
+  fprintf(stderr, "  --tcpaths=<n>      Path-associative T$: up to <n> traces per start PC in a set (0 = conventional, default)\n");
+  fprintf(stderr, "  --tcpathsel=<n>    Path-associative T$ selection among matching paths: 0 = longest (default), 1 = most recently used\n");
+  fprintf(stderr, "  --tcindex=<n>      T$ index function: 0 = pc (default), 1 = pc>>2, 2 = XOR-folded pc, 3 = pc XOR branch history, 4 = skewed-associative\n");
+  fprintf(stderr, "  --tcpartial=<n>    T$ partial-match hits: 1 = deliver the agreeing prefix of a trace, 0 = full match only (default)\n");
+  fprintf(stderr, "  --tcfill=<n>       T$ fill unit: 0 = fetch-time, from predicted fetch bundles (default), 1 = retire-time, from committed instructions\n");
+  fprintf(stderr, "  --promote=<n>      Branch promotion: embed branches biased <n> consecutive times in traces with a fixed direction (0 = off, default)\n");
+  fprintf(stderr, "  --biastable=<n>    Branch-bias table entries, for branch promotion (default 1024)\n");
+  fprintf(stderr, "  --ntp=<n>          Next-trace predictor with <n> entries (0 = off, default); gshare predicts when it is not confident\n");
+  fprintf(stderr, "  --ntphist=<n>      Next-trace predictor: # of recent traces hashed into its index (default 4)\n");
+  fprintf(stderr, "  --ftq=<n>          Fetch target queue: the BPU runs up to <n> fetch bundles ahead of fetch (0 = off, default)\n");
+  fprintf(stderr, "  --fdip=<n>         Fetch-directed I$ prefetch: # queued fetch bundles prefetched per cycle (default 1, 0 = off)\n");
+  fprintf(stderr, "  --tcvictim=<n>     T$ victim buffer with <n> fully-associative entries (0 = off, default)\n");
+  fprintf(stderr, "  --tcfilter=<n>     T$ insertion filter: insert a trace only once it is constructed <n> times (0 = off, default)\n");
+  fprintf(stderr, "  --tcfilterent=<n>  T$ insertion filter: # counters in its table (default 1024)\n");
+  fprintf(stderr, "  --tcdata=<n>       Trace data array: 0 = T$ hits supply predecoded instructions (default), 1 = always fetch and decode, 2 = T$ hits checked against fetch\n");
   fprintf(stderr, "  --fw=<n>           <n> wide fetch\n");
   fprintf(stderr, "  --dw=<n>           <n> wide dispatch\n");
   fprintf(stderr, "  --iw=<n>           <n> wide issue / <n> execution lanes\n");
@@ -191,6 +220,7 @@ int main(int argc, char** argv)
   std::function<extension_t*()> extension;
 
   std::string checkpoint_file = "";
+  std::string make_checkpoint_file = "";
 
   option_parser_t parser;
   parser.help(&help);
@@ -203,6 +233,12 @@ int main(int argc, char** argv)
   parser.option('s', 0, 1, [&](const char* s){skip_amt = atoll(s); skip_enable = true;});
   parser.option('e', 0, 1, [&](const char* s){stop_amt = atoll(s); use_stop_amt = true;});
   parser.option('c', 0, 1, [&](const char* s){checkpoint_file = s;});
+  parser.option(0, "mkchkpt", 1, [&](const char* s){make_checkpoint_file = s;});
+  parser.option(0, "chkptsparse", 1, [&](const char* s){CHECKPOINT_SPARSE = atoi(s);});
+  parser.option(0, "chkptlazy", 1, [&](const char* s){CHECKPOINT_LAZY = atoi(s);});
+  parser.option(0, "shareimg", 1, [&](const char* s){SHARE_MEMORY_IMAGE = atoi(s);});
+  parser.option(0, "htifdump", 1, [&](const char* s){HTIF_DUMP = atoi(s);});
+  parser.option(0, "chkptwarm", 1, [&](const char* s){CHECKPOINT_WARM = atoi(s);});
   parser.option(0, "ic", 1, [&](const char* s){ic.reset(new icache_sim_t(s));});
   parser.option(0, "dc", 1, [&](const char* s){dc.reset(new dcache_sim_t(s));});
   parser.option(0, "l2", 1, [&](const char* s){l2.reset(cache_sim_t::construct(s, "L2$"));});
@@ -217,6 +253,10 @@ int main(int argc, char** argv)
   parser.option(0, "perf", 1, [&](const char* s){set_perfect_flags(s);});
   parser.option(0, "cp"  , 1, [&](const char* s){NUM_CHECKPOINTS = atoi(s);});
   parser.option(0, "btb" , 1, [&](const char* s){BTB_SIZE = atoi(s); BTB_MASK = BTB_SIZE-1;});
+  parser.option(0, "btb2", 1, [&](const char* s){BTB2_ENTRIES = atoi(s);});
+  parser.option(0, "btb2assoc", 1, [&](const char* s){BTB2_ASSOC = atoi(s);});
+  parser.option(0, "btb2lat", 1, [&](const char* s){BTB2_LATENCY = atoi(s);});
+  parser.option(0, "btb2region", 1, [&](const char* s){BTB2_REGION = atoi(s);});
   parser.option(0, "ctiq", 1, [&](const char* s){CTIQ_SIZE = atoi(s); CTIQ_MASK = CTIQ_SIZE-1;});
   parser.option(0, "bp"  , 1, [&](const char* s){BP_TABLE_SIZE = atoi(s); BP_INDEX_MASK = BP_TABLE_SIZE-1;});
   parser.option(0, "ras" , 1, [&](const char* s){RAS_SIZE = atoi(s);});
@@ -226,13 +266,32 @@ int main(int argc, char** argv)
   parser.option(0, "iqnp", 1, [&](const char* s){ISSUE_QUEUE_NUM_PARTS = atoi(s);});
   parser.option('a', 0, 0, [&](const char* s){PRESTEER = true;});
   parser.option('b', 0, 0, [&](const char* s){IDEAL_AGE_BASED = true;});
+  parser.option(0, "iqwake", 1, [&](const char* s){IQ_WAKEUP = atoi(s);});
   parser.option(0, "lsq" , 1, [&](const char* s){LQ_SIZE = atoi(s);SQ_SIZE = atoi(s);});
   parser.option(0, "disambig", 1, [&](const char* s){set_disambig_flags(s);});
+  parser.option(0, "lsqsearch", 1, [&](const char* s){LSQ_SEARCH = atoi(s);});
+  parser.option(0, "checkerthread", 1, [&](const char* s){CHECKER_THREAD = atoi(s);});
+  parser.option(0, "idleskip", 1, [&](const char* s){IDLE_SKIP = (atoi(s) ? true : false);});
   parser.option(0, "fw"  , 1, [&](const char* s){FETCH_WIDTH = atoi(s);});
   parser.option(0, "tc_fot"  , 1, [&](const char* s){FILL_ON_TAKEN_BRANCH = atoi(s);});
   parser.option(0, "tc_cth"  , 1, [&](const char* s){CLEAR_TCM_AT_HIT = atoi(s);});
   parser.option(0, "tcl"  , 1, [&](const char* s){TCM_LINES = atoi(s);});
   parser.option(0, "tca"  , 1, [&](const char* s){TCM_ASSOC = atoi(s);});
+  parser.option(0, "tcpaths", 1, [&](const char* s){TCM_PATHS = atoi(s);});
+  parser.option(0, "tcpathsel", 1, [&](const char* s){TCM_PATH_SELECT = atoi(s);});
+  parser.option(0, "tcindex", 1, [&](const char* s){TCM_INDEX = atoi(s);});
+  parser.option(0, "tcpartial", 1, [&](const char* s){TCM_PARTIAL = atoi(s);});
+  parser.option(0, "tcfill", 1, [&](const char* s){TCM_FILL = atoi(s);});
+  parser.option(0, "promote", 1, [&](const char* s){PROMOTE_THRESHOLD = atoi(s);});
+  parser.option(0, "biastable", 1, [&](const char* s){BIAS_TABLE_ENTRIES = atoi(s);});
+  parser.option(0, "ntp", 1, [&](const char* s){NTP_ENTRIES = atoi(s);});
+  parser.option(0, "ntphist", 1, [&](const char* s){NTP_HISTORY = atoi(s);});
+  parser.option(0, "ftq", 1, [&](const char* s){FTQ_SIZE = atoi(s);});
+  parser.option(0, "fdip", 1, [&](const char* s){FDIP = atoi(s);});
+  parser.option(0, "tcvictim", 1, [&](const char* s){TCM_VICTIM = atoi(s);});
+  parser.option(0, "tcfilter", 1, [&](const char* s){TCM_FILTER = atoi(s);});
+  parser.option(0, "tcfilterent", 1, [&](const char* s){TCM_FILTER_ENTRIES = atoi(s);});
+  parser.option(0, "tcdata", 1, [&](const char* s){TCM_DATA = atoi(s);});
   parser.option(0, "cbr"  , 1, [&](const char* s){COND_BR_PER_CYC = atoi(s);});
   parser.option(0, "dw"  , 1, [&](const char* s){DISPATCH_WIDTH = atoi(s);});
   parser.option(0, "iw"  , 1, [&](const char* s){ISSUE_WIDTH = atoi(s);});
@@ -245,6 +304,10 @@ int main(int argc, char** argv)
   auto argv1 = parser.parse(argv);
   if (!*argv1)
     help();
+  if ((make_checkpoint_file != "") && CHECKPOINT_WARM && !use_stop_amt) {
+    fprintf(stderr, "Incorrect usage of --chkptwarm=1: a warm checkpoint is created where timing simulation stops, so -e<n> is required\n");
+    exit(-1);
+  }
   std::vector<std::string> htif_args(argv1, (const char*const*)argv + argc);
   s_micro = new sim_t(nprocs, mem_mb, htif_args, MICRO_SIM);
 
@@ -261,12 +324,9 @@ int main(int argc, char** argv)
   s_micro->set_histogram(histogram);
 
   #ifdef RISCV_MICRO_CHECKER
-    s_isa = new sim_t(nprocs, mem_mb, htif_args, ISA_SIM);
+    // The ISA sim (s_isa) is created by DB->run_ahead(), below.
     DB = new debug_buffer_t(PIPE_QUEUE_SIZE);
 
-    DB->set_isa_sim(s_isa);
-
-    s_isa->set_procs_pipe(DB);
     s_micro->set_procs_pipe(DB);
   #endif
 
@@ -369,23 +429,29 @@ int main(int argc, char** argv)
     logging_on = true;
 
   #ifdef RISCV_MICRO_CHECKER
-    s_isa->boot();
-
-    if (checkpoint_file != "")
-    {
-      fprintf(stderr, "Restoring checkpoint from %s\n",checkpoint_file.c_str());
-      s_isa->restore_checkpoint(checkpoint_file);
-    }
-    else if (skip_enable) {
-      // If skip amount is provided, fast skip in the ISA sim
-      //s_isa->init_checkpoint("isa_checkpoint");
-      fprintf(stderr, "Fast skipping Spike for %lu instructions\n",skip_amt);
-      htif_code = s_isa->run_fast(skip_amt);
-      //htif_code = s_isa->create_checkpoint();
-    }
-
-    // Fill the debug buffer
-    DB->run_ahead();
+    // Create the ISA sim, bring it to the starting point, and fill the debug buffer.
+    // This may run on the debug buffer's producer thread, concurrently with the
+    // MICROS setup below.
+    DB->run_ahead([&]() {
+      s_isa = new sim_t(nprocs, mem_mb, htif_args, ISA_SIM);
+      s_isa->set_procs_pipe(DB);
+
+      s_isa->boot();
+
+      if (checkpoint_file != "")
+      {
+        fprintf(stderr, "Restoring checkpoint from %s\n",checkpoint_file.c_str());
+        s_isa->restore_checkpoint(checkpoint_file);
+      }
+      else if (skip_enable) {
+        // If skip amount is provided, fast skip in the ISA sim
+        //s_isa->init_checkpoint("isa_checkpoint");
+        fprintf(stderr, "Fast skipping Spike for %lu instructions\n",skip_amt);
+        s_isa->run_fast(skip_amt);
+        //htif_code = s_isa->create_checkpoint();
+      }
+      return s_isa;
+    });
   #endif
 
 
@@ -399,10 +465,19 @@ int main(int argc, char** argv)
   }
   else if (skip_enable) {
       // If skip amount is provided, fast skip in the MICROS sim
+      if (make_checkpoint_file != "")
+        s_micro->init_checkpoint(make_checkpoint_file);
       fprintf(stderr, "Fast skipping MICROS for %lu instructions\n",skip_amt);
       htif_code = s_micro->run_fast(skip_amt);
       // Stop simulation if HTIF returns non-zero code
-      if(!htif_code) return htif_code;
+      if(!htif_code) {
+        #ifdef RISCV_MICRO_CHECKER
+          DB->stop();
+        #endif
+        return htif_code;
+      }
+      if ((make_checkpoint_file != "") && !CHECKPOINT_WARM)
+        s_micro->create_checkpoint();
   }
 
   //htif_code = s_micro->create_checkpoint();
@@ -417,6 +492,22 @@ int main(int argc, char** argv)
   htif_code = s_micro->run();
   fprintf(stderr, "Stopping MICROS: HTIF Exit Code %d\n",htif_code);
 
+  // Warm checkpoint: the HTIF log has been recorded since fast skipping began.
+  // There is nothing to checkpoint if the target exited before -e was reached.
+  if (skip_enable && use_stop_amt && (checkpoint_file == "") && (make_checkpoint_file != "") && CHECKPOINT_WARM) {
+    if (s_micro->running())
+      s_micro->create_checkpoint(true);
+    else {
+      fprintf(stderr, "warning: the target exited before -e was reached; the warm checkpoint %s is not created\n", make_checkpoint_file.c_str());
+      s_micro->cancel_checkpoint();
+    }
+  }
+
+  #ifdef RISCV_MICRO_CHECKER
+    // Stop the ISA sim before deleting it.
+    DB->stop();
+  #endif
+
   //*** Must delete the simulator instances in order to dump stats ***
   // Stats are dumped in the destructor for the processor instances.
   delete s_isa;
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cassert>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "memory_image.h"
+
+// Shared images, by checkpoint file.
+static std::vector<memory_image_t*> shared_images;
+static std::mutex shared_images_lock;
+
+
+memory_image_t* memory_image_t::acquire(const std::string& file, char* mem, size_t memsz, bool share)
+{
+  std::lock_guard<std::mutex> guard(shared_images_lock);
+
+  if (share) {
+    for (size_t i = 0; i < shared_images.size(); i++) {
+      if ((shared_images[i]->file == file) && (shared_images[i]->memsz == memsz)) {
+        shared_images[i]->refs++;
+        return shared_images[i];
+      }
+    }
+
+    // First simulator to restore this checkpoint: create the image.
+    int fd = memfd_create("721sim-image", MFD_CLOEXEC);
+    if ((fd >= 0) && (ftruncate(fd, memsz) == 0)) {
+      char* base = (char*)mmap(NULL, memsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+      if (base != MAP_FAILED) {
+        memory_image_t* image = new memory_image_t(file, base, memsz, fd);
+        shared_images.push_back(image);
+        return image;
+      }
+    }
+    if (fd >= 0)
+      close(fd);
+    fprintf(stderr, "warning: cannot create a shared memory image; restoring checkpoint into private memory\n");
+  }
+
+  return(new memory_image_t(file, mem, memsz, -1));
+}
+
+void memory_image_t::release(memory_image_t* image)
+{
+  std::lock_guard<std::mutex> guard(shared_images_lock);
+
+  assert(image->refs > 0);
+  image->refs--;
+  if (image->refs == 0) {
+    for (size_t i = 0; i < shared_images.size(); i++) {
+      if (shared_images[i] == image) {
+        shared_images.erase(shared_images.begin() + i);
+        break;
+      }
+    }
+    delete image;
+  }
+}
+
+memory_image_t::memory_image_t(const std::string& file, char* base, size_t memsz, int fd)
+  : restored(false), base(base), sparse(NULL), file(file), memsz(memsz), fd(fd), refs(1)
+{
+}
+
+memory_image_t::~memory_image_t()
+{
+  if (sparse) {
+    fprintf(stderr, "Sparse checkpoint: restored %lu of %lu chunks\n",
+            (unsigned long)sparse->chunks_restored(), (unsigned long)sparse->chunks());
+    delete sparse;
+  }
+  if (fd >= 0) {
+    munmap(base, memsz);
+    close(fd);
+  }
+}
+
+void memory_image_t::map(char* mem)
+{
+  if (fd < 0) {
+    assert(mem == base);
+    return;
+  }
+  char* view = (char*)mmap(mem, memsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, fd, 0);
+  assert(view == mem);
+}
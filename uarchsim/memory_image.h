@@ -0,0 +1,50 @@
+#ifndef MEMORY_IMAGE_H
+#define MEMORY_IMAGE_H
+
+#include <cstddef>
+#include <string>
+#include <mutex>
+#include "sparse_checkpoint.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Target memory image restored from a checkpoint.
+//
+// The ISA and timing simulators each have their own target memory, and
+// both restore the same checkpoint.  A shared image is restored once, into
+// an anonymous shared file (memfd), and each simulator maps it copy-on-write
+// over its target memory: clean pages are shared by the simulators, and a
+// page becomes private to a simulator when that simulator first writes it.
+//
+// A private image (sharing disabled or unavailable) is the simulator's own
+// target memory, restored in place.
+//
+// The first simulator to acquire an image restores it (restored == false),
+// holding "lock"; the others wait on "lock" and then just map it.
+/////////////////////////////////////////////////////////////////////////////
+
+class memory_image_t {
+public:
+  // Get the image of checkpoint "file", for target memory "mem" (memsz bytes).
+  static memory_image_t* acquire(const std::string& file, char* mem, size_t memsz, bool share);
+  static void release(memory_image_t* image);
+
+  // Map the image over target memory "mem", replacing its contents.
+  void map(char* mem);
+
+  std::mutex lock;
+  bool restored;			// memory (and state) restored by the first simulator
+  char* base;				// the image: restore memory here
+  sparse_checkpoint_t* sparse;		// sparse checkpoint that the image is restored from (if any)
+  std::string state;			// its state other than memory
+
+private:
+  memory_image_t(const std::string& file, char* base, size_t memsz, int fd);
+  ~memory_image_t();
+
+  std::string file;
+  size_t memsz;
+  int fd;				// memfd of a shared image, -1 for a private image
+  unsigned int refs;
+};
+
+#endif //MEMORY_IMAGE_H
@@ -3,6 +3,27 @@
 
 // Pipe control
 uint32_t PIPE_QUEUE_SIZE  = 4096;
+// Functional simulator (checker) feeding the debug buffer:
+// 0: stepped on the timing simulator's thread as entries are popped
+// 1: runs ahead on its own thread, if the host has more than one hardware thread
+// 2: always runs ahead on its own thread
+uint32_t CHECKER_THREAD = 1;
+
+// Checkpoints.
+// CHECKPOINT_SPARSE: create checkpoints in the sparse, page-granular format (1) or as one .gz stream (0).
+// CHECKPOINT_LAZY: restore a sparse checkpoint's memory a chunk at a time, as it is first touched (1),
+// or all of it up front (0).  Either format is restored, whatever the setting.
+uint32_t CHECKPOINT_SPARSE = 1;
+uint32_t CHECKPOINT_LAZY = 1;
+// SHARE_MEMORY_IMAGE: the ISA and timing simulators restore a checkpoint's memory once, into one image,
+// that they share copy-on-write (1), or each into its own memory (0).
+uint32_t SHARE_MEMORY_IMAGE = 1;
+// HTIF_DUMP: when restoring a checkpoint, dump the replayed HTIF transactions to restore.htif, as text.
+uint32_t HTIF_DUMP = 0;
+// CHECKPOINT_WARM: create the checkpoint (--mkchkpt) where timing simulation stops (-e), rather than after
+// fast skipping, with the warm microarchitectural state: caches, branch prediction unit, trace cache, and
+// memory dependence predictor.  Restoring the checkpoint restores them too, if they match the configuration.
+uint32_t CHECKPOINT_WARM = 0;
 
 
 
@@ -30,15 +51,68 @@ uint32_t FILL_ON_TAKEN_BRANCH	= 0;
 uint32_t CLEAR_TCM_AT_HIT	= 0;
 uint32_t TCM_LINES		= 128;
 uint32_t TCM_ASSOC		= 1;
+// Path-associative TCM: a set may hold up to TCM_PATHS traces (paths) from the same
+// start pc (0: conventional, a trace is placed in whichever way the search selects).
+// TCM_PATH_SELECT chooses among matching paths: 0 = longest trace, 1 = most recently used.
+uint32_t TCM_PATHS		= 0;
+uint32_t TCM_PATH_SELECT	= 0;
+// TCM index function (see tcm_t::set_index()): 0 = pc, 1 = pc >> 2, 2 = XOR-folded pc,
+// 3 = pc XOR global branch history, 4 = skewed-associative (a different function per way).
+uint32_t TCM_INDEX		= 0;
+// Partial-match hits: 1 = on a miss, a trace whose branches agree with the predictions only up to
+// some branch supplies that prefix of the trace; 0 = a trace must agree in full (off).
+uint32_t TCM_PARTIAL		= 0;
+// Trace fill unit: 0 = fetch-time (traces built from predicted fetch bundles),
+// 1 = retire-time (traces built from committed instructions and their outcomes).
+uint32_t TCM_FILL		= 0;
+// Branch promotion: a conditional branch that went the same way PROMOTE_THRESHOLD consecutive
+// times (0: off) is embedded in traces with that fixed direction, not counting towards the "m"
+// conditional branches.  It is demoted when it goes the other way.  The branch-bias table that
+// tracks this has BIAS_TABLE_ENTRIES entries.
+uint32_t PROMOTE_THRESHOLD	= 0;
+uint32_t BIAS_TABLE_ENTRIES	= 1024;
+// Next-trace predictor: NTP_ENTRIES entries (0: off), indexed by a hash of the IDs of the
+// most recent NTP_HISTORY fetch bundles (traces).  When it is not confident, the conditional
+// branch predictor supplies the directions.
+uint32_t NTP_ENTRIES		= 0;
+uint32_t NTP_HISTORY		= 4;
+// Fetch target queue: the BPU predicts up to FTQ_SIZE fetch bundles (0: off) ahead of the fetch
+// stage, one per cycle.  FDIP: # queued fetch bundles whose I$ lines are prefetched per cycle.
+uint32_t FTQ_SIZE		= 0;
+uint32_t FDIP			= 1;
+// Trace victim buffer: TCM_VICTIM fully-associative entries (0: off) holding traces evicted from
+// the TCM; a hit swaps the trace back in.  Insertion filter: a new trace is written into the TCM
+// only once it has been constructed TCM_FILTER times (0 or 1: always), counted in a table of
+// TCM_FILTER_ENTRIES counters indexed by a hash of the trace's start pc and path.
+uint32_t TCM_VICTIM		= 0;
+uint32_t TCM_FILTER		= 0;
+uint32_t TCM_FILTER_ENTRIES	= 1024;
+// Trace data array (each trace's instructions and their decode-stage fields):
+// 0: a trace cache hit supplies the instructions and decode-stage fields
+// 1: none; instructions are always fetched via the MMU and decoded
+// 2: as 0, but also fetch via the MMU and check the trace's instructions
+uint32_t TCM_DATA		= 0;
 uint32_t COND_BR_PER_CYC	= 3;
 bool IC_INTERLEAVED		    = false;
 bool IC_SINGLE_BB		      = false;	// not used currently
 bool IN_ORDER_ISSUE		    = false;	// not used currently
 bool SPEC_DISAMBIG = false;
 bool MEM_DEP_PRED = false;
+// LSQ search for disambiguation, load violations, and stalled-load replay:
+// 0: address-hashed index and scheduled replay, 1: linear scans,
+// 2: address-hashed index checked against linear scan, scheduled replay
+uint32_t LSQ_SEARCH = 0;
 
 bool PRESTEER = false;
 bool IDEAL_AGE_BASED = false;
+// Issue queue wakeup model:
+// 0: per-physical-register consumer lists (only dependents are touched)
+// 1: CAM broadcast to every issue queue entry
+// 2: consumer lists, cross-checked against a CAM search after every wakeup
+uint32_t IQ_WAKEUP = 0;
+// Skip over cycles in which the pipeline is provably idle (e.g., waiting on
+// a long cache miss) instead of simulating them one by one.
+bool IDLE_SKIP = true;
 uint32_t FU_LANE_MATRIX[(unsigned int)NUMBER_FU_TYPES] = {0x5A5A /*     BR: 0101 1010 */ ,
                                                           0x2121 /*     LS: 0010 0001 */ ,
                                                           0x5A5A /*  ALU_S: 0101 1010 */ ,
@@ -113,6 +187,14 @@ unsigned int CTIQ_MASK	            = CTIQ_SIZE-1;
 unsigned int BTB_SIZE	              = 0x1000;
 unsigned int BTB_MASK	              = BTB_SIZE-1;
 
+// Second-level BTB: BTB2_ENTRIES entries (0: off), BTB2_ASSOC ways.  It is probed on
+// first-level BTB misses; a hit costs BTB2_LATENCY fetch cycles and copies the branches of
+// the surrounding BTB2_REGION-instruction aligned region into the first level.
+unsigned int BTB2_ENTRIES             = 0;
+unsigned int BTB2_ASSOC               = 8;
+unsigned int BTB2_LATENCY             = 2;
+unsigned int BTB2_REGION              = 16;
+
 // Predictor configuration
 unsigned int BP_TABLE_SIZE	        = 0x10000;
 unsigned int BP_INDEX_MASK	        = BP_TABLE_SIZE-1;
@@ -4,6 +4,12 @@
 
 // Pipe control
 extern unsigned int PIPE_QUEUE_SIZE;
+extern unsigned int CHECKER_THREAD;
+extern unsigned int CHECKPOINT_SPARSE;
+extern unsigned int CHECKPOINT_LAZY;
+extern unsigned int SHARE_MEMORY_IMAGE;
+extern unsigned int HTIF_DUMP;
+extern unsigned int CHECKPOINT_WARM;
 
 
 // Oracle controls.
@@ -30,14 +36,32 @@ extern unsigned int FILL_ON_TAKEN_BRANCH;
 extern unsigned int CLEAR_TCM_AT_HIT;
 extern unsigned int TCM_LINES;
 extern unsigned int TCM_ASSOC;
+extern unsigned int TCM_PATHS;
+extern unsigned int TCM_PATH_SELECT;
+extern unsigned int TCM_INDEX;
+extern unsigned int TCM_PARTIAL;
+extern unsigned int TCM_FILL;
+extern unsigned int PROMOTE_THRESHOLD;
+extern unsigned int BIAS_TABLE_ENTRIES;
+extern unsigned int NTP_ENTRIES;
+extern unsigned int NTP_HISTORY;
+extern unsigned int FTQ_SIZE;
+extern unsigned int FDIP;
+extern unsigned int TCM_VICTIM;
+extern unsigned int TCM_FILTER;
+extern unsigned int TCM_FILTER_ENTRIES;
+extern unsigned int TCM_DATA;
 extern unsigned int COND_BR_PER_CYC;
 extern bool         IC_INTERLEAVED;
 extern bool         IC_SINGLE_BB;		// not used currently
 extern bool         IN_ORDER_ISSUE;		// not used currently
 extern bool         SPEC_DISAMBIG;
 extern bool         MEM_DEP_PRED;
+extern unsigned int LSQ_SEARCH;
 extern bool         PRESTEER;
 extern bool         IDEAL_AGE_BASED;
+extern unsigned int IQ_WAKEUP;
+extern bool         IDLE_SKIP;
 extern unsigned int FU_LANE_MATRIX[];
 extern unsigned int FU_LAT[];
 
@@ -75,6 +99,10 @@ extern unsigned int L2_MISS_SRV_LATENCY;
 // Branch predictor and BTB
 extern unsigned int BTB_SIZE;
 extern unsigned int BTB_MASK;
+extern unsigned int BTB2_ENTRIES;
+extern unsigned int BTB2_ASSOC;
+extern unsigned int BTB2_LATENCY;
+extern unsigned int BTB2_REGION;
 extern unsigned int BP_TABLE_SIZE;
 extern unsigned int BP_INDEX_MASK;
 extern unsigned int CTIQ_SIZE;
@@ -69,6 +69,29 @@ void payload::split(unsigned int index) {
 }
 
 // Mapping of instructions to actual (functional simulation) instructions.
+// Copy the decode-stage fields of an instruction into its entry.
+void payload::set_decode(unsigned int index, const predecode_t &d) {
+	buf[index].flags       = d.flags;
+	buf[index].fu          = d.fu;
+	buf[index].checkpoint  = d.checkpoint;
+	buf[index].split       = d.split;
+	buf[index].split_store = d.split_store;
+	buf[index].A_valid     = d.A_valid;
+	buf[index].A_log_reg   = d.A_log_reg;
+	buf[index].B_valid     = d.B_valid;
+	buf[index].B_log_reg   = d.B_log_reg;
+	buf[index].C_valid     = d.C_valid;
+	buf[index].C_log_reg   = d.C_log_reg;
+	buf[index].D_valid     = d.D_valid;
+	buf[index].D_log_reg   = d.D_log_reg;
+	buf[index].iq          = d.iq;
+	buf[index].CSR_addr    = d.CSR_addr;
+	buf[index].size        = d.size;
+	buf[index].is_signed   = d.is_signed;
+	buf[index].left        = false;
+	buf[index].right       = false;
+}
+
 void payload::map_to_actual(pipeline_t* proc, unsigned int index, unsigned int Tid) {
 	unsigned int prev_index;
 	bool         first;
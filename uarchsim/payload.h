@@ -26,6 +26,32 @@ union union64_t {
 
 typedef unsigned int debug_index_t;
 
+// Decode-stage fields that are a pure function of the instruction bits.
+// The decode stage derives them with predecode(); a trace cache hit
+// supplies them already derived, from the trace data array.
+typedef struct {
+   unsigned int flags;
+   fu_type fu;
+   bool checkpoint;
+   bool split;
+   bool split_store;
+   bool A_valid;
+   unsigned int A_log_reg;
+   bool B_valid;
+   unsigned int B_log_reg;
+   bool C_valid;
+   unsigned int C_log_reg;
+   bool D_valid;
+   unsigned int D_log_reg;
+   sel_iq iq;
+   uint64_t CSR_addr;
+   unsigned int size;
+   bool is_signed;
+} predecode_t;
+
+// Derive the decode-stage fields of an instruction (decode.cc).
+void predecode(insn_t inst, predecode_t &d);
+
 typedef struct {
 
    ////////////////////////
@@ -60,6 +86,14 @@ typedef struct {
                                 // fetched instructions.  Helpful for
                                 // logging (debug traces).
 
+   bool fetch_bundle_start;     // If 'true', this instruction was the first
+                                // of its fetch bundle.
+
+   bool predecoded;             // If 'true', the decode-stage fields below
+                                // were supplied by the trace cache along
+                                // with the instruction, so the Decode Stage
+                                // need not derive them again.
+
    ////////////////////////
    // Set by Decode Stage.
    ////////////////////////
@@ -228,6 +262,7 @@ public:
 	void pop();
 	void clear();
 	void split(unsigned int index);
+	void set_decode(unsigned int index, const predecode_t &d);
 	void map_to_actual(pipeline_t* proc,unsigned int index, unsigned int Tid);
 	void rollback(unsigned int index);
 	unsigned int checkpoint();
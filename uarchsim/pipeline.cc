@@ -10,6 +10,7 @@
 #include "disasm.h"
 #include <cinttypes>
 #include <cmath>
+#include <unistd.h>
 #include <cstdlib>
 #include <iostream>
 #include <climits>
@@ -79,7 +80,7 @@ pipeline_t::pipeline_t(
   // Sakshi- changed the cond branch per cycle
   BPU(fetch_width, COND_BR_PER_CYC, 8192, 4, 20, 16, 20, 16, 64, 512),
   FQ(fq_size,this),
-  IQ(iq_size,iq_num_parts,this),
+  IQ(iq_size,iq_num_parts,(NXPR + NFPR + rob_size),this),
   LSU(lq_size, sq_size, Tid, _mmu, this)
 {
   unsigned int i, j, ex_depth;
@@ -147,7 +148,9 @@ pipeline_t::pipeline_t(
   // is in supervisor mode, and in 64-bit mode, if supported, with traps
   // and virtual memory disabled.
   pc = 0x2000;
+  next_retire_pc = pc;
   next_fetch_cycle = 0;
+  fdip_issued = 0;
 
   if(L2_PRESENT){
     L2C = new CacheClass( L2_SETS,
@@ -262,17 +265,20 @@ pipeline_t::pipeline_t(
   fprintf(stats_log, "   PARTITIONS = %d\n", iq_num_parts);
   fprintf(stats_log, "   PRESTEER = %d\n", (PRESTEER ? 1 : 0));
   fprintf(stats_log, "   IDEAL AGE-BASED = %d\n", (IDEAL_AGE_BASED ? 1 : 0));
+  fprintf(stats_log, "   WAKEUP MODEL = %s\n", ((IQ_WAKEUP == 0) ? "consumer lists" : ((IQ_WAKEUP == 1) ? "CAM" : "consumer lists + CAM check")));
   fprintf(stats_log, "LOAD/STORE UNIT:\n");
   fprintf(stats_log, "   LOAD QUEUE = %d\n", lq_size);
   fprintf(stats_log, "   STORE QUEUE = %d\n", sq_size);
   fprintf(stats_log, "   SPECULATIVE DISAMBIGUATION = %d\n", SPEC_DISAMBIG);
   fprintf(stats_log, "   USE STICKY-BIT MEMORY DEPENDENCE PREDICTOR = %d\n", MEM_DEP_PRED);
+  fprintf(stats_log, "   SEARCH = %s\n", ((LSQ_SEARCH == 0) ? "address-hashed index" : ((LSQ_SEARCH == 1) ? "linear scan" : "address-hashed index + scan check")));
 
   fprintf(stats_log, "\n=== PIPELINE STAGE WIDTHS =======================================================\n\n");
   fprintf(stats_log, "FETCH WIDTH = %d\n", fetch_width);
   fprintf(stats_log, "DISPATCH WIDTH = %d\n", dispatch_width);
   fprintf(stats_log, "ISSUE WIDTH = %d\n", issue_width);
   fprintf(stats_log, "RETIRE WIDTH = %d\n", retire_width);
+  fprintf(stats_log, "IDLE CYCLE SKIP = %d\n", (IDLE_SKIP ? 1 : 0));
 
   fprintf(stats_log, "\n=== EXECUTION LANES =============================================================\n\n");
   fprintf(stats_log, "        |latency |   BR   |   LS   |  ALU_S |  ALU_C | LS_FP  | ALU_FP |  MTF   |\n");
@@ -350,6 +356,12 @@ pipeline_t::~pipeline_t()
 #endif
 
   BPU.output(stats->get_counter("commit_count"), stats_log);
+  if (FTQ_SIZE && !PERFECT_BRANCH_PRED)
+    fprintf(stats_log, "FDIP: %lu I$ prefetches issued\n", fdip_issued);
+  size_t resident, shared;
+  sim->resident_pages(resident, shared);
+  fprintf(stats_log, "Target memory: %lu of %lu host pages resident (%.1lf MB), %lu more shared with the checkpoint image\n",
+          (unsigned long)resident, (unsigned long)sim->total_pages(), ((double)resident * sysconf(_SC_PAGESIZE) / (1 << 20)), (unsigned long)shared);
 
   #ifdef RISCV_MICRO_DEBUG
     fclose(this->fetch_log    );
@@ -426,9 +438,85 @@ static size_t next_timer(state_t* state)
   return state->compare - (uint32_t)state->count;
 }
 
-bool pipeline_t::step_micro(size_t n,size_t& instret)
+// Take a snapshot of the front-end pipeline.
+void pipeline_t::idle_snapshot(idle_state_t& s) {
+  s.sequence = sequence;
+  s.recovery_count = counter(recovery_count);
+  s.fq_length = FQ.get_length();
+  s.decode_valid = DECODE[0].valid;
+  s.rename2_valid = RENAME2[0].valid;
+  s.dispatch_valid = DISPATCH[0].valid;
+}
+
+// Called at the end of a cycle, after 'cycle' has been advanced.
+// Returns the number of cycles, starting with 'cycle', in which no pipeline
+// stage can do anything, or 0 if the pipeline may make progress in 'cycle'.
+//
+// The pipeline is idle when:
+// 1. The head of the Active List is not completed (Retire Stage is idle).
+// 2. The Execution Lanes are empty (Register Read, Execute, and Writeback Stages are idle,
+//    so nothing can complete, resolve, or wake up dependents).
+// 3. No instruction in the Issue Queue is ready (Schedule Stage is idle).
+// 4. No stalled load can be replayed until a known cycle (see lsu::replay_idle()).
+// 5. The Dispatch, Rename, and Decode Stages made no progress in the cycle that just ended.
+//    Their inputs can only be changed by the stages above, or by upstream stages that
+//    made no progress either, so they will stall again.
+// 6. The Fetch Stage is stalled by the Decode Stage, or by an I$ miss until a known cycle.
+// 7. The BPU cannot run ahead and has no queued fetch bundles left to prefetch (fetch_ahead() is idle).
+uint64_t pipeline_t::idle_cycles_ahead(const idle_state_t& before) {
+  idle_state_t after;
+  bool completed, exception, load_viol, br_misp, val_misp, load, store, branch, amo, csr;
+  reg_t PC;
+  cycle_t next_event = (cycle_t)-1;
+  unsigned int i, j;
+
+  idle_snapshot(after);
+  if ((after.sequence != before.sequence) ||
+      (after.recovery_count != before.recovery_count) ||
+      (after.fq_length != before.fq_length) ||
+      (after.decode_valid != before.decode_valid) ||
+      (after.rename2_valid != before.rename2_valid) ||
+      (after.dispatch_valid != before.dispatch_valid))
+    return(0);
+
+  if (REN->precommit(completed, exception, load_viol, br_misp, val_misp, load, store, branch, amo, csr, PC) && completed)
+    return(0);
+
+  for (i = 0; i < issue_width; i++) {
+    if (Execution_Lanes[i].rr.valid || Execution_Lanes[i].wb.valid)
+      return(0);
+    for (j = 0; j < Execution_Lanes[i].ex_depth; j++) {
+      if (Execution_Lanes[i].ex[j].valid)
+        return(0);
+    }
+  }
+
+  if (IQ.any_ready())
+    return(0);
+
+  if (!LSU.replay_idle(next_event))
+    return(0);
+
+  // The BPU is running ahead or the FTQ has fetch bundles left to prefetch.
+  if (!PERFECT_BRANCH_PRED && BPU.ftq_busy())
+    return(0);
+
+  if (!DECODE[0].valid) {
+    if (cycle >= next_fetch_cycle)
+      return(0);
+    next_event = MIN(next_event, next_fetch_cycle);
+  }
+
+  return((next_event > cycle) ? (next_event - cycle) : 0);
+}
+
+// idle_budget: maximum number of idle cycles to skip if no instruction retires in this call.
+// idle_skipped (output): number of idle cycles skipped after the cycle in which this call stopped.
+bool pipeline_t::step_micro(size_t n,size_t& instret,size_t idle_budget,size_t* idle_skipped)
 {
   instret = 0;
+  if (idle_skipped)
+    *idle_skipped = 0;
   size_t prev_instret = 0;
 
   //TODO: This is needed for functional simulator
@@ -472,6 +560,10 @@ bool pipeline_t::step_micro(size_t n,size_t& instret)
         /////////////////////////////////////////////////////////////
 
         size_t lane_number;
+        idle_state_t idle_before;
+
+        if (IDLE_SKIP)
+          idle_snapshot(idle_before);
 
         unsigned int prev_commit_count = counter(commit_count);
         for (lane_number = 0; lane_number < RETIRE_WIDTH; lane_number++) {
@@ -516,6 +608,7 @@ bool pipeline_t::step_micro(size_t n,size_t& instret)
         //if(!fetch_exception){
           fetch();            // Fetch Stage
         //}
+        fetch_ahead();        // Fetch Target Queue
 
         /////////////////////////////////////////////////////////////
         // Miscellaneous stuff that must be processed every cycle.
@@ -552,6 +645,29 @@ bool pipeline_t::step_micro(size_t n,size_t& instret)
 	  num_insn_last_beat = num_insn;
         }
 
+        // Skip ahead over cycles in which no stage can do anything. This is the same as
+        // simulating them: cycle_count is advanced by the same amount, and the only other
+        // state that changes in an idle cycle is the Issue Queue's round-robin priority.
+        // The skip stops short of the next heartbeat. If nothing retired in this call,
+        // each idle cycle would have returned to the simulator for a possible HTIF tick, so
+        // the skip is also limited by the caller's budget and reported back to it.
+        if (IDLE_SKIP) {
+          uint64_t skip = idle_cycles_ahead(idle_before);
+          skip = MIN(skip, (uint64_t)(0x400000 - MOD(cycle, 0x400000) - 1));
+          if (!instret) {
+            skip = MIN(skip, (uint64_t)idle_budget);
+            if (idle_skipped)
+              *idle_skipped = skip;
+          }
+          if (skip) {
+            cycle += skip;
+            stats->update_counter(CTR_cycle_count, (int)skip);
+            IQ.skip_cycles(skip);
+            if(cycle > (uint64_t)logging_on_at)
+              logging_on = true;
+          }
+        }
+
         // If this was an idle cycle break so that HTIF may have a chance to tick
         if(!instret)
           break;
@@ -660,6 +776,18 @@ void pipeline_t::copy_state_to_micro() {
    }
 
    pc = get_state()->pc;
+   next_retire_pc = pc;
+}
+
+void pipeline_t::copy_state_from_micro() {
+   for (unsigned int i = 0; i < NXPR; i++){
+      // Integer RF: general registers 0-31.
+      get_state()->XPR.write(i, REN->read_arch(i));
+      // Floating point RF: general registers 0-31.
+      get_state()->FPR.write(i, REN->read_arch(i+NXPR));
+   }
+
+   get_state()->pc = next_retire_pc;
 }
 
 uint64_t pipeline_t::get_arch_reg_value(int reg_id) { 
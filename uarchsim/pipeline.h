@@ -9,6 +9,7 @@
 #include <vector>
 #include <map>
 #include <cassert>
+#include <iostream>
 
 //////////////////////////////////////////////////////////////////////////////
 
@@ -172,7 +173,7 @@ public:
 //	void set_histogram(bool value);
 	bool get_histogram(){return histogram_enabled;}
 //	void reset(bool value);
-	bool step_micro(size_t n, size_t& instret); // run for n cycles
+	bool step_micro(size_t n, size_t& instret, size_t idle_budget = 0, size_t* idle_skipped = NULL); // run for n cycles
 //	void deliver_ipi(); // register an interprocessor interrupt
 //	bool running() {
 //		return run;
@@ -206,10 +207,19 @@ public:
   // Copy registers from fast skip state to pipeline register file.
   // Also reset the AMT.
   void copy_state_to_micro();
+  // Copy committed registers and the pc of the next instruction to retire
+  // from the pipeline to fast skip state, e.g., to checkpoint it.
+  void copy_state_from_micro();
   uint64_t get_arch_reg_value(int reg_id); 
   uint64_t get_pc(){return get_state()->pc;}
   uint32_t get_instruction(uint64_t inst_pc);
 
+  // Save/restore warm microarchitectural state (caches, branch prediction
+  // unit, trace cache, memory dependence predictor) as a checkpoint's
+  // optional warm state section (warm_state.cc).
+  void save_warm_state(std::ostream& out);
+  void restore_warm_state(std::istream& in);
+
 private:
 //	sim_t* sim;
 //	mmu_t* mmu; // main memory is always accessed via the mmu
@@ -300,6 +310,7 @@ private:
 	/////////////////////////////////////////////////////////////
 	reg_t pc;			// Speculative program counter.
 	cycle_t next_fetch_cycle;	// Support for I$ miss stalls.
+	uint64_t fdip_issued;		// # fetch-directed I$ prefetches issued (FTQ_SIZE > 0)
 	bpu_t BPU;			// Branch prediction unit..
   //stats(),
 
@@ -387,7 +398,7 @@ private:
 	void checker();
 	void check_single(reg_t micro, reg_t isa, db_t* actual, const char *desc);
 	void check_double(reg_t micro0, reg_t micro1, reg_t isa0, reg_t isa1, const char *desc);
-  void check_state(state_t* micro_state, state_t* isa_state, db_t* actual);
+  void check_state(state_t* micro_state, db_state_t* isa_state, db_t* actual);
   inline void clear_fetch_exception(){
         fetch_exception = false;
   }
@@ -433,9 +444,13 @@ public:
 	uint64_t num_insn;
 	uint64_t num_insn_split;
 
+	// Pc of the next instruction to retire (the architectural pc).
+	reg_t next_retire_pc;
+
 
 	// Functions for pipeline stages.
 	void fetch();
+	void fetch_ahead();		// BPU run-ahead and fetch-directed I$ prefetch (FTQ_SIZE > 0)
 	void decode();
 	void rename1();
 	void rename2();
@@ -451,6 +466,21 @@ public:
 	void set_branch_misprediction(unsigned int al_index);
 	void set_value_misprediction(unsigned int al_index);
 
+	// Idle-cycle skipping.
+	// A snapshot of the front-end pipeline taken at the start of a cycle.
+	// If it is unchanged at the end of the cycle, no front-end stage moved
+	// any instructions and none was squashed.
+	struct idle_state_t {
+		uint64_t sequence;
+		uint64_t recovery_count;
+		unsigned int fq_length;
+		bool decode_valid;
+		bool rename2_valid;
+		bool dispatch_valid;
+	};
+	void idle_snapshot(idle_state_t& s);
+	uint64_t idle_cycles_ahead(const idle_state_t& before);
+
   //TODO: Implement these functions
 	// Miscellaneous other functions.
 	//void next_cycle();
@@ -209,6 +209,11 @@ uint64_t renamer::read (uint64_t phys_reg)
 	return PRF[phys_reg];
 }
 
+uint64_t renamer::read_arch (uint64_t log_reg)
+{
+	return PRF[AMT[log_reg]];
+}
+
 void renamer::write (uint64_t phys_reg, uint64_t value)
 {
 	//std::cout<< "write start "<< "," << value << "," << phys_reg << "," << PRF[phys_reg];
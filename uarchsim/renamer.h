@@ -367,6 +367,13 @@ public:
 	/////////////////////////////////////////////////////////////////////
 	uint64_t read(uint64_t phys_reg);
 
+	/////////////////////////////////////////////////////////////////////
+	// Return the committed value of the indicated logical register,
+	// i.e., through the AMT (e.g., to checkpoint architectural state
+	// while instructions are in flight).
+	/////////////////////////////////////////////////////////////////////
+	uint64_t read_arch(uint64_t log_reg);
+
 
 	//////////////////////////////////////////
 	// Functions related to Writeback Stage.//
@@ -88,17 +88,25 @@ void pipeline_t::retire(size_t& instret) {
 	 //
 		REN->commit();
 
+         // Feed the committed instruction to the retire-time trace fill unit (once per instruction, if split).
+         if (!PERFECT_BRANCH_PRED && (!PAY.buf[PAY.head].split || PAY.buf[PAY.head].upper))
+            BPU.retire_fill(PAY.buf[PAY.head].pc, PAY.buf[PAY.head].inst, PAY.buf[PAY.head].fetch_bundle_start, branch, PAY.buf[PAY.head].pred_tag);
+
          // If the committed instruction is a branch, signal the branch predictor to commit its oldest branch.
          if (branch && !PERFECT_BRANCH_PRED) {
 	    // TODO (ER): Change the branch predictor interface as follows: BPU.commit().
             BPU.commit(PAY.buf[PAY.head].pred_tag);
          }
 
+         // FENCE.I: instructions held by the trace cache may be stale.
+         if ((PAY.buf[PAY.head].inst.opcode() == OP_MISC_MEM) && (PAY.buf[PAY.head].inst.funct3() == FN3_FENCE_I) && !PERFECT_BRANCH_PRED)
+            BPU.fence_i();
+
          // If FP op, cheat and copy the fflags from the functional simulator.
          // TODO: fflags should be (and can be) generated by the ALU. This was done to expedite porting of 721sim to RISCV from PISA.
          if (IS_FP_OP(PAY.buf[PAY.head].flags)) {
 	    db_t *actual = pipe->peek(PAY.buf[PAY.head].db_index);	// Pointer to corresponding instruction in the functional simulator.
-            get_state()->fflags = actual->a_state->fflags;
+            get_state()->fflags = actual->a_state.fflags;
          }
 
 	 // Check results.
@@ -130,6 +138,7 @@ void pipeline_t::retire(size_t& instret) {
 	    // Squash all instructions after it.
             squash_complete(next_inst_pc);
             inc_counter(recovery_count);
+            next_retire_pc = next_inst_pc;
 
 	    // Pop the instruction from PAY.
 	    if (!PAY.buf[PAY.head].split) PAY.pop();
@@ -139,6 +148,8 @@ void pipeline_t::retire(size_t& instret) {
             PAY.clear();
          }
          else {
+            next_retire_pc = (branch ? PAY.buf[PAY.head].c_next_pc : INCREMENT_PC(PAY.buf[PAY.head].pc));
+
 	    // Pop the instruction from PAY.
 	    if (!PAY.buf[PAY.head].split) PAY.pop();
 	    PAY.pop();
@@ -191,6 +202,7 @@ void pipeline_t::retire(size_t& instret) {
          // Squash the pipeline.
          squash_complete(jump_PC);
          inc_counter(recovery_count);
+         next_retire_pc = jump_PC;
 
          // Flush PAY.
          PAY.clear();
@@ -10,9 +10,43 @@
 #include <signal.h>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include <gzstream.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "pipeline.h"
 
+// Stream buffer over another one, that can record the characters read through it.
+// Unbuffered, so that it records exactly the characters consumed.
+class recording_streambuf_t : public std::streambuf {
+public:
+  recording_streambuf_t(std::streambuf* source) : recording(false), source(source) {}
+
+  bool recording;
+  std::string recorded;
+
+protected:
+  int_type underflow() {
+    return source->sgetc();
+  }
+  int_type uflow() {
+    int_type c = source->sbumpc();
+    if (recording && (c != traits_type::eof()))
+      recorded.push_back(traits_type::to_char_type(c));
+    return c;
+  }
+  std::streamsize xsgetn(char* s, std::streamsize n) {
+    std::streamsize got = source->sgetn(s, n);
+    if (recording)
+      recorded.append(s, got);
+    return got;
+  }
+
+private:
+  std::streambuf* source;
+};
+
 volatile bool ctrlc_pressed = false;
 static void handle_signal(int sig)
 {
@@ -25,9 +59,11 @@ static void handle_signal(int sig)
 
 sim_t::sim_t(size_t nprocs, size_t mem_mb, const std::vector<std::string>& args, proc_type_t _proc_type)
 	: htif(new htif_isasim_t(this, args)), procs(std::max(nprocs, size_t(1))),
-	  current_step(0), idle_cycles(0), current_proc(0), debug(false), checkpointing_enabled(false)
+	  current_step(0), idle_cycles(0), current_proc(0), debug(false), checkpointing_enabled(false),
+	  image(NULL)
 {
 	signal(SIGINT, &handle_signal);
+	htif->set_dump_replay(HTIF_DUMP);
 	// allocate target machine's memory, shrinking it as necessary
 	// until the allocation succeeds
 	size_t memsz0 = (size_t)mem_mb << 20;
@@ -38,7 +74,9 @@ sim_t::sim_t(size_t nprocs, size_t mem_mb, const std::vector<std::string>& args,
 
 	memsz = memsz0;
   ifprintf(logging_on,stderr, "Requesting target memory 0x%lx\n",(unsigned long)memsz0);
-	while ((mem = (char*)calloc(1, memsz)) == NULL) {
+	// (Anonymous memory, so that a lazily restored sparse checkpoint can protect and drop its pages,
+	// and a shared checkpoint image can be mapped over it.)
+	while ((mem = (char*)mmap(NULL, memsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED) {
 		memsz = memsz*10/11/quantum*quantum;
 	}
 
@@ -94,7 +132,58 @@ sim_t::~sim_t()
 		delete pmmu;
 	}
 	delete debug_mmu;
-	free(mem);
+	if (image) {
+		if (image->sparse)
+			image->sparse->detach(mem);
+		memory_image_t::release(image);
+	}
+	munmap(mem, memsz);
+}
+
+// Target memory is reserved up front but its pages are demand-zero:
+// only the pages that the benchmark (or a restored checkpoint) touches are resident.
+// When memory is a copy-on-write view of a shared checkpoint image, the pages it has
+// not written are the image's page cache, resident once for all simulators; only the
+// pages it has written are its own.  /proc/self/pagemap tells the two apart.
+void sim_t::resident_pages(size_t& private_pages, size_t& shared_pages)
+{
+	size_t host_page = sysconf(_SC_PAGESIZE);
+	size_t pages = total_pages();
+
+	private_pages = 0;
+	shared_pages = 0;
+
+	int fd = open("/proc/self/pagemap", O_RDONLY);
+	if (fd < 0) {
+		// No pagemap: count every resident page as this simulator's own.
+		std::vector<unsigned char> resident(pages);
+		if (mincore(mem, memsz, resident.data()) == 0) {
+			for (size_t i = 0; i < pages; i++)
+				private_pages += (resident[i] & 1);
+		}
+		return;
+	}
+
+	// One 64-bit entry per page: bit 63 present, bit 62 swapped, bit 61 file-backed or shared.
+	std::vector<uint64_t> entries(pages);
+	off_t offset = (off_t)(((uintptr_t)mem / host_page) * sizeof(uint64_t));
+	if (pread(fd, entries.data(), pages * sizeof(uint64_t), offset) == (ssize_t)(pages * sizeof(uint64_t))) {
+		for (size_t i = 0; i < pages; i++) {
+			if (!(entries[i] & (3ULL << 62)))
+				continue;
+			if (entries[i] & (1ULL << 61))
+				shared_pages++;
+			else
+				private_pages++;
+		}
+	}
+	close(fd);
+}
+
+size_t sim_t::total_pages()
+{
+	size_t host_page = sysconf(_SC_PAGESIZE);
+	return((memsz + host_page - 1) / host_page);
 }
 
 void sim_t::send_ipi(reg_t who)
@@ -151,6 +240,7 @@ bool sim_t::step(size_t n)
 	for (size_t i = 0, steps = 0; i < n; i += steps)
 	{
     size_t instret = 0;
+    size_t idle_skipped = 0;
     if(get_proc_type() == ISA_SIM){
 		  steps = std::min(n - i, INTERLEAVE - current_step);
   		procs[current_proc]->step(steps,instret);
@@ -158,7 +248,9 @@ bool sim_t::step(size_t n)
 		  steps = (INTERLEAVE - current_step);
     // This function continues until it has retired "steps" instructions
     // or it encounters a cycle with 0 retired instructions.
-  		stop_simulation = ((pipeline_t*)procs[current_proc])->step_micro(steps,instret);
+    // In the latter case it may also skip up to the remaining idle cycles
+    // before the next HTIF tick, if the pipeline is provably idle for them.
+  		stop_simulation = ((pipeline_t*)procs[current_proc])->step_micro(steps,instret,(INTERLEAVE - idle_cycles - 1),&idle_skipped);
       if(stop_simulation)
         return 0;
     }
@@ -166,7 +258,7 @@ bool sim_t::step(size_t n)
     if(instret){
       idle_cycles = 0;
     }else{
-      idle_cycles++;
+      idle_cycles += (1 + idle_skipped);
     }
 
 		//current_step += steps;
@@ -307,12 +399,21 @@ void sim_t::set_simpoint(bool enable, size_t interval)
 
 void sim_t::init_checkpoint(std::string checkpoint_file)
 {
+  checkpointing_enabled = true; 
+
+  // A sparse checkpoint collects the HTIF log in memory.  It is written out, with memory, at create_checkpoint().
+  if (CHECKPOINT_SPARSE) {
+    this->checkpoint_file = checkpoint_file;
+    sparse_chkpt.str("");
+    htif->start_checkpointing(sparse_chkpt);
+    return;
+  }
+
   // Check if file name has .gz extension. If not, append .gz to the name
   if(checkpoint_file.substr(checkpoint_file.find_last_of(".") + 1) != "gz") {
     checkpoint_file = checkpoint_file+".gz";
   }
 
-  checkpointing_enabled = true; 
   this->checkpoint_file = checkpoint_file;
   proc_chkpt.open(checkpoint_file.c_str(), std::ios::out | std::ios::binary);
   if ( ! proc_chkpt.good()) {
@@ -322,7 +423,7 @@ void sim_t::init_checkpoint(std::string checkpoint_file)
   htif->start_checkpointing(proc_chkpt);
 }
 
-bool sim_t::create_checkpoint()
+bool sim_t::create_checkpoint(bool warm)
 {
   bool htif_return = true;
 
@@ -330,6 +431,24 @@ bool sim_t::create_checkpoint()
   fprintf(stderr,"Checkpointed HTIF state\n");
   fflush(0);
 
+  // The registers are committed state in the pipeline.
+  warm = (warm && (proc_type == MICRO_SIM));
+  if (warm)
+    ((pipeline_t*)procs[current_proc])->copy_state_from_micro();
+
+  if (CHECKPOINT_SPARSE) {
+    create_register_checkpoint(sparse_chkpt);
+    if (warm)
+      ((pipeline_t*)procs[current_proc])->save_warm_state(sparse_chkpt);
+    if (!sparse_checkpoint_t::write(checkpoint_file, mem, memsz, sparse_chkpt.str())) {
+      std::cerr << "ERROR: Writing file `" << checkpoint_file << "' failed.\n";
+      exit(0);
+    }
+    sparse_chkpt.str("");
+    std::cerr << "Created sparse processor checkpoint to " << checkpoint_file << std::endl;
+    return htif_return;
+  }
+
   create_memory_checkpoint(proc_chkpt);
   fprintf(stderr,"Checkpointed memory state\n");
   fflush(0);
@@ -338,11 +457,30 @@ bool sim_t::create_checkpoint()
   fprintf(stderr,"Checkpointed register state\n");
   fflush(0);
 
+  if (warm) {
+    ((pipeline_t*)procs[current_proc])->save_warm_state(proc_chkpt);
+    fprintf(stderr,"Checkpointed warm microarchitectural state\n");
+    fflush(0);
+  }
+
   proc_chkpt.close();
   std::cerr << "Created processor checkpoint to " << checkpoint_file << std::endl;
   return htif_return;
 }
 
+void sim_t::cancel_checkpoint()
+{
+  htif->stop_checkpointing();
+
+  if (CHECKPOINT_SPARSE) {
+    sparse_chkpt.str("");
+    return;
+  }
+
+  proc_chkpt.close();
+  remove(checkpoint_file.c_str());
+}
+
 void sim_t::create_memory_checkpoint(std::ostream& memory_chkpt)
 {
   uint64_t signature = 0xbaadbeefdeadbeef;
@@ -363,11 +501,55 @@ bool sim_t::restore_checkpoint(std::string restore_file)
 {
   bool htif_return = true;
 
+  bool sparse = sparse_checkpoint_t::probe(restore_file);
+
+  // Legacy checkpoint.
   // Check if file name has .gz extension. If not, append .gz to the name
-  if(restore_file.substr(restore_file.find_last_of(".") + 1) != "gz") {
+  if(!sparse && (restore_file.substr(restore_file.find_last_of(".") + 1) != "gz")) {
     restore_file = restore_file+".gz";
   }
 
+  // Memory is restored into the checkpoint's image, by the first simulator to restore the checkpoint,
+  // and the image is then mapped over this simulator's memory (see memory_image.h).
+  image = memory_image_t::acquire(restore_file, mem, memsz, SHARE_MEMORY_IMAGE);
+  std::lock_guard<std::mutex> guard(image->lock);
+
+  // Sparse checkpoint: memory is restored from its chunks (lazily, if enabled), the rest from its state.
+  if (sparse) {
+    if (!image->restored) {
+      image->sparse = new sparse_checkpoint_t();
+      if (!image->sparse->open(restore_file, image->state)) {
+        std::cerr << "ERROR: Reading sparse checkpoint `" << restore_file << "' failed.\n";
+        return false;
+      }
+    }
+    std::istringstream restore_state(image->state);
+    htif_return = htif->restore_checkpoint(restore_state);
+    std::cerr << "Done restoring HTIF checkpoint from " << restore_file << std::endl;
+    if (!image->restored) {
+      image->sparse->restore(image->base, memsz, CHECKPOINT_LAZY);
+      image->restored = true;
+    }
+    image->map(mem);
+    image->sparse->attach(mem);
+    restore_proc_checkpoint(restore_state);
+    std::cerr << "Done restoring mem/reg checkpoint from " << restore_file << std::endl;
+    return htif_return;
+  }
+
+  // Legacy checkpoint: memory lies between the HTIF log and the registers in one .gz stream.
+  // The first simulator keeps the HTIF log and the state after memory in the image, so that
+  // the others restore from it without decompressing the memory again.
+  if (image->restored) {
+    std::istringstream restore_state(image->state);
+    htif_return = htif->restore_checkpoint(restore_state);
+    std::cerr << "Done restoring HTIF checkpoint from " << restore_file << std::endl;
+    image->map(mem);
+    restore_proc_checkpoint(restore_state);
+    std::cerr << "Done restoring mem/reg checkpoint from " << restore_file << std::endl;
+    return htif_return;
+  }
+
   //std::cerr << "Trying to restore HTIF checkpoint from " << restore_file << std::endl;
   fflush(0);
   restore_chkpt.open (restore_file.c_str(), std::ios::in | std::ios::binary);
@@ -375,21 +557,30 @@ bool sim_t::restore_checkpoint(std::string restore_file)
     std::cerr << "ERROR: Opening file `" << restore_file << "' failed.\n";
 	  return false;
   }
+  recording_streambuf_t restore_buf(restore_chkpt.rdbuf());
+  std::istream restore(&restore_buf);
 
   // This tick will restore the checkpoint.
-	htif_return = htif->restore_checkpoint(restore_chkpt);
+  restore_buf.recording = true;
+	htif_return = htif->restore_checkpoint(restore);
+  restore_buf.recording = false;
   std::cerr << "Done restoring HTIF checkpoint from " << restore_file << std::endl;
 
   //std::cerr << "Trying to restore mem/reg HTIF checkpoint from " << restore_file << std::endl;
-  restore_memory_checkpoint(restore_chkpt);
-  restore_proc_checkpoint(restore_chkpt);
+  restore_memory_checkpoint(restore, image->base);
+  std::string rest((std::istreambuf_iterator<char>(restore)), std::istreambuf_iterator<char>());
   restore_chkpt.close();
+  image->state = (restore_buf.recorded + rest);
+  image->restored = true;
+  image->map(mem);
+  std::istringstream restore_rest(rest);
+  restore_proc_checkpoint(restore_rest);
   std::cerr << "Done restoring mem/reg checkpoint from " << restore_file << std::endl;
 
   return htif_return;
 }
 
-void sim_t::restore_memory_checkpoint(std::istream& memory_chkpt)
+void sim_t::restore_memory_checkpoint(std::istream& memory_chkpt, char* target)
 {
   uint64_t signature;
   uint64_t chkpt_memsz;
@@ -398,7 +589,7 @@ void sim_t::restore_memory_checkpoint(std::istream& memory_chkpt)
   // Check that the checkpointed memory size the current simulator memory size are same
   memory_chkpt.read((char*)&chkpt_memsz,sizeof(chkpt_memsz));
   assert(memsz == chkpt_memsz);
-  memory_chkpt.read(mem,memsz);
+  memory_chkpt.read(target,memsz);
 }
 
 void sim_t::restore_proc_checkpoint(std::istream& proc_chkpt)
@@ -414,6 +605,9 @@ void sim_t::restore_proc_checkpoint(std::istream& proc_chkpt)
   if(proc_type == MICRO_SIM){
     ifprintf(logging_on,stderr,"Copying state after restoring checkpoint\n");
     ((pipeline_t*)procs[current_proc])->copy_state_to_micro();
+
+    // Warm microarchitectural state, if the checkpoint has any.
+    ((pipeline_t*)procs[current_proc])->restore_warm_state(proc_chkpt);
   }
 
   //fprintf(stderr,"State for %s:\n",proc_type == MICRO_SIM ? "micro_sim" : "isa_sim");
@@ -8,8 +8,10 @@
 #include <memory>
 #include <fstream>
 #include <gzstream.h>
+#include <sstream>
 //#include "pipeline.h"
 #include "mmu.h"
+#include "memory_image.h"
 
 #define DEBUG_MMU true
 #define MICRO_MMU true
@@ -48,6 +50,11 @@ public:
 	// deliver an IPI to a specific processor
 	void send_ipi(reg_t who);
 
+	// returns the number of host pages of target memory that are resident: pages of this
+	// simulator's own, and pages still shared with a checkpoint image; and the total
+	void resident_pages(size_t& private_pages, size_t& shared_pages);
+	size_t total_pages();
+
 	// returns the number of processors in this simulator
 	size_t num_cores() {
 		return procs.size();
@@ -57,7 +64,10 @@ public:
 	}
 
   void init_checkpoint(std::string _checkpoint_file);
-  bool create_checkpoint();
+  // warm: checkpoint the timing simulator where it stopped, with its warm microarchitectural state
+  bool create_checkpoint(bool warm=false);
+  // Stop checkpointing without creating the checkpoint, and remove a partly written file.
+  void cancel_checkpoint();
   bool restore_checkpoint(std::string restore_file);
 
 
@@ -119,8 +129,10 @@ private:
   //std::fstream restore_chkpt;
   ogzstream proc_chkpt;
   igzstream restore_chkpt;
+  std::ostringstream sparse_chkpt;		// state other than memory, for a sparse checkpoint
+  memory_image_t* image;			// checkpoint image that memory was restored from
   void create_memory_checkpoint(std::ostream& memory_chkpt);
-  void restore_memory_checkpoint(std::istream& memory_chkpt);
+  void restore_memory_checkpoint(std::istream& memory_chkpt, char* target);
   void create_register_checkpoint(std::ostream& proc_chkpt);
   void restore_proc_checkpoint(std::istream& proc_chkpt);
 
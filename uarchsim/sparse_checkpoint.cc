@@ -0,0 +1,372 @@
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <atomic>
+#include <mutex>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "sparse_checkpoint.h"
+
+#define MAX_LAZY_CHECKPOINTS 4
+
+// Checkpoints being restored lazily, for the SIGSEGV handler.
+static std::atomic<sparse_checkpoint_t*> lazy_checkpoints[MAX_LAZY_CHECKPOINTS];
+static std::mutex lazy_checkpoints_lock;
+static struct sigaction default_segv_action;
+static bool segv_handler_installed = false;
+
+
+// Deflate "n" bytes at "src" into "dst" as a single raw block, at the fastest level.
+static bool deflate_block(const char* src, size_t n, std::vector<char>& dst)
+{
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  dst.resize(deflateBound(&z, n));
+  z.next_in = (Bytef*)src;
+  z.avail_in = n;
+  z.next_out = (Bytef*)dst.data();
+  z.avail_out = dst.size();
+  int rc = deflate(&z, Z_FINISH);
+  dst.resize(z.total_out);
+  deflateEnd(&z);
+  return(rc == Z_STREAM_END);
+}
+
+static bool zero_page(const char* page, size_t page_size)
+{
+  const uint64_t* w = (const uint64_t*)page;
+  for (size_t i = 0; i < (page_size / sizeof(uint64_t)); i++) {
+    if (w[i])
+      return false;
+  }
+  return true;
+}
+
+static bool pread_all(int fd, void* buf, size_t n, uint64_t offset)
+{
+  size_t got = 0;
+  while (got < n) {
+    ssize_t r = pread(fd, (char*)buf + got, n - got, offset + got);
+    if (r <= 0)
+      return false;
+    got += r;
+  }
+  return true;
+}
+
+
+bool sparse_checkpoint_t::probe(const std::string& file)
+{
+  uint64_t magic = 0;
+  int f = ::open(file.c_str(), O_RDONLY);
+  if (f < 0)
+    return false;
+  bool sparse = (pread_all(f, &magic, sizeof(magic), 0) && (magic == SPARSE_MAGIC));
+  close(f);
+  return sparse;
+}
+
+bool sparse_checkpoint_t::write(const std::string& file, const char* mem, size_t memsz, const std::string& state)
+{
+  sparse_header_t h;
+  std::vector<sparse_chunk_t> chunk_index;
+  std::vector<char> pages;
+  std::vector<char> cbuf;
+  uint64_t chunk_bytes = (SPARSE_PAGE_SIZE * SPARSE_CHUNK_PAGES);
+
+  FILE* fp = fopen(file.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  memset(&h, 0, sizeof(h));
+  h.magic = SPARSE_MAGIC;
+  h.memsz = memsz;
+  h.page_size = SPARSE_PAGE_SIZE;
+  h.chunk_pages = SPARSE_CHUNK_PAGES;
+  bool ok = (fwrite(&h, sizeof(h), 1, fp) == 1);
+
+  // The rest of the simulator state.
+  ok = ok && deflate_block(state.data(), state.size(), cbuf);
+  h.state_offset = sizeof(h);
+  h.state_csize = cbuf.size();
+  h.state_size = state.size();
+  ok = ok && (fwrite(cbuf.data(), 1, cbuf.size(), fp) == cbuf.size());
+
+  // The chunks: only their non-zero pages.
+  uint64_t offset = (h.state_offset + h.state_csize);
+  pages.resize(chunk_bytes);
+  for (uint64_t addr = 0; ok && (addr < memsz); addr += chunk_bytes) {
+    sparse_chunk_t c;
+    uint64_t n = 0;
+    c.addr = addr;
+    c.page_mask = 0;
+    for (uint64_t p = 0; (p < SPARSE_CHUNK_PAGES) && ((addr + (p * SPARSE_PAGE_SIZE)) < memsz); p++) {
+      const char* page = (mem + addr + (p * SPARSE_PAGE_SIZE));
+      if (!zero_page(page, SPARSE_PAGE_SIZE)) {
+        c.page_mask |= ((uint64_t)1 << p);
+        memcpy(&pages[n * SPARSE_PAGE_SIZE], page, SPARSE_PAGE_SIZE);
+        n++;
+      }
+    }
+    if (n == 0)
+      continue;
+    ok = deflate_block(pages.data(), (n * SPARSE_PAGE_SIZE), cbuf);
+    c.offset = offset;
+    c.csize = cbuf.size();
+    ok = ok && (fwrite(cbuf.data(), 1, cbuf.size(), fp) == cbuf.size());
+    offset += c.csize;
+    chunk_index.push_back(c);
+  }
+
+  // The chunk index, and the completed header.
+  h.num_chunks = chunk_index.size();
+  h.index_offset = offset;
+  ok = ok && (fwrite(chunk_index.data(), sizeof(sparse_chunk_t), chunk_index.size(), fp) == chunk_index.size());
+  ok = ok && (fseek(fp, 0, SEEK_SET) == 0) && (fwrite(&h, sizeof(h), 1, fp) == 1);
+  ok = (fclose(fp) == 0) && ok;
+  return ok;
+}
+
+
+sparse_checkpoint_t::sparse_checkpoint_t()
+  : fd(-1), mem(NULL), memsz(0), chunk_bytes(0), num_restored(0), zarena_used(0), lazy(false)
+{
+  for (int i = 0; i < SPARSE_MAX_VIEWS; i++)
+    views[i].store(NULL);
+  busy.clear();
+}
+
+sparse_checkpoint_t::~sparse_checkpoint_t()
+{
+  delist();
+  if (fd >= 0)
+    close(fd);
+}
+
+bool sparse_checkpoint_t::open(const std::string& file, std::string& state)
+{
+  fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  if (!pread_all(fd, &header, sizeof(header), 0) || (header.magic != SPARSE_MAGIC))
+    return false;
+  assert((header.chunk_pages > 0) && (header.chunk_pages <= 64));
+  chunk_bytes = (header.page_size * header.chunk_pages);
+
+  index.resize(header.num_chunks);
+  if (!pread_all(fd, index.data(), (header.num_chunks * sizeof(sparse_chunk_t)), header.index_offset))
+    return false;
+
+  // Inflate the rest of the simulator state.
+  uint64_t max_csize = header.state_csize;
+  for (size_t i = 0; i < index.size(); i++)
+    max_csize = std::max(max_csize, index[i].csize);
+  cbuf.resize(max_csize);
+  if (!pread_all(fd, cbuf.data(), header.state_csize, header.state_offset))
+    return false;
+  state.resize(header.state_size);
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, -15) != Z_OK)
+    return false;
+  z.next_in = (Bytef*)cbuf.data();
+  z.avail_in = header.state_csize;
+  z.next_out = (Bytef*)&state[0];
+  z.avail_out = header.state_size;
+  int rc = inflate(&z, Z_FINISH);
+  inflateEnd(&z);
+  if ((rc != Z_STREAM_END) || (z.total_out != header.state_size))
+    return false;
+
+  ubuf.resize(chunk_bytes);
+  zarena.resize(1 << 16);
+  return true;
+}
+
+void sparse_checkpoint_t::restore(char* mem, size_t memsz, bool lazy)
+{
+  long host_page = sysconf(_SC_PAGESIZE);
+  bool aligned = ((((uintptr_t)mem % host_page) == 0) && ((memsz % host_page) == 0));
+
+  // Check that the checkpointed memory size the current simulator memory size are same
+  assert(memsz == header.memsz);
+  this->mem = mem;
+  this->memsz = memsz;
+  this->lazy = (lazy && aligned && ((chunk_bytes % host_page) == 0));
+
+  // Zero target memory.  Dropping the pages of (anonymous) memory zeroes it without touching it.
+  if (!aligned || (madvise(mem, memsz, MADV_DONTNEED) != 0))
+    memset(mem, 0, memsz);
+
+  restored.assign(index.size(), false);
+  num_restored = 0;
+  chunk_of.assign(((memsz + chunk_bytes - 1) / chunk_bytes), -1);
+  for (size_t i = 0; i < index.size(); i++)
+    chunk_of[index[i].addr / chunk_bytes] = i;
+
+  // Eager: restore all chunks now.  Lazy: see attach().
+  if (!this->lazy) {
+    for (size_t i = 0; i < index.size(); i++) {
+      bool ok = restore_chunk(i);
+      assert(ok);
+    }
+  }
+}
+
+void sparse_checkpoint_t::attach(char* view)
+{
+  int v;
+  for (v = 0; (v < SPARSE_MAX_VIEWS) && views[v].load(); v++)
+    ;
+  assert(v < SPARSE_MAX_VIEWS);
+  if (!lazy) {
+    views[v].store(view);
+    return;
+  }
+
+  // Lazy: protect each chunk in the view until it is first touched there.
+  // (Chunks already restored are protected, too: their first touch just unprotects them.)
+  assert(((uintptr_t)view % sysconf(_SC_PAGESIZE)) == 0);
+  enlist();
+  while (busy.test_and_set())
+    ;
+  for (size_t i = 0; i < index.size(); i++) {
+    int rc = mprotect((view + index[i].addr), std::min((uint64_t)chunk_bytes, (uint64_t)(memsz - index[i].addr)), PROT_NONE);
+    assert(rc == 0);
+  }
+  views[v].store(view);
+  busy.clear();
+}
+
+void sparse_checkpoint_t::detach(char* view)
+{
+  for (int v = 0; v < SPARSE_MAX_VIEWS; v++) {
+    if (views[v].load() == view)
+      views[v].store(NULL);
+  }
+}
+
+// Restore chunk "i": inflate its pages into target memory.
+// Called from the SIGSEGV handler, for lazy restore, so it does not allocate memory.
+bool sparse_checkpoint_t::restore_chunk(int64_t i)
+{
+  sparse_chunk_t& c = index[i];
+  char* base = (mem + c.addr);
+
+  if (!pread_all(fd, cbuf.data(), c.csize, c.offset))
+    return false;
+
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  z.zalloc = zalloc;
+  z.zfree = zfree;
+  z.opaque = this;
+  zarena_used = 0;
+  if (inflateInit2(&z, -15) != Z_OK)
+    return false;
+  z.next_in = (Bytef*)cbuf.data();
+  z.avail_in = c.csize;
+  z.next_out = (Bytef*)ubuf.data();
+  z.avail_out = ubuf.size();
+  int rc = inflate(&z, Z_FINISH);
+  inflateEnd(&z);
+  if (rc != Z_STREAM_END)
+    return false;
+
+  uint64_t n = 0;
+  for (uint64_t p = 0; p < header.chunk_pages; p++) {
+    if ((c.page_mask >> p) & 1) {
+      memcpy((base + (p * header.page_size)), &ubuf[n * header.page_size], header.page_size);
+      n++;
+    }
+  }
+  assert(z.total_out == (n * header.page_size));
+
+  restored[i] = true;
+  num_restored++;
+  return true;
+}
+
+// zlib allocator over a preallocated arena (see restore_chunk()).
+void* sparse_checkpoint_t::zalloc(void* opaque, unsigned int items, unsigned int size)
+{
+  sparse_checkpoint_t* c = (sparse_checkpoint_t*)opaque;
+  size_t n = ((((size_t)items * size) + 15) & ~(size_t)15);
+  if ((c->zarena_used + n) > c->zarena.size())
+    return Z_NULL;
+  void* p = &c->zarena[c->zarena_used];
+  c->zarena_used += n;
+  return p;
+}
+
+void sparse_checkpoint_t::zfree(void* opaque, void* address)
+{
+}
+
+
+void sparse_checkpoint_t::handle_fault(int sig, siginfo_t* info, void* context)
+{
+  char* addr = (char*)info->si_addr;
+
+  for (int i = 0; i < MAX_LAZY_CHECKPOINTS; i++) {
+    sparse_checkpoint_t* c = lazy_checkpoints[i].load();
+    for (int v = 0; c && (v < SPARSE_MAX_VIEWS); v++) {
+      char* view = c->views[v].load();
+      if (view && (addr >= view) && (addr < (view + c->memsz))) {
+        int64_t chunk = c->chunk_of[(addr - view) / c->chunk_bytes];
+        if (chunk >= 0) {
+          uint64_t offset = c->index[chunk].addr;
+          while (c->busy.test_and_set())
+            ;
+          bool ok = (mprotect((view + offset), std::min((uint64_t)c->chunk_bytes, (uint64_t)(c->memsz - offset)), PROT_READ | PROT_WRITE) == 0);
+          ok = ok && (c->restored[chunk] || c->restore_chunk(chunk));
+          c->busy.clear();
+          if (ok)
+            return;
+        }
+      }
+    }
+  }
+
+  // Not a lazily restored chunk: a genuine fault.  Retrying the access gets the default action.
+  sigaction(SIGSEGV, &default_segv_action, NULL);
+}
+
+void sparse_checkpoint_t::enlist()
+{
+  std::lock_guard<std::mutex> guard(lazy_checkpoints_lock);
+  if (!segv_handler_installed) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &default_segv_action);
+    segv_handler_installed = true;
+  }
+  for (int i = 0; i < MAX_LAZY_CHECKPOINTS; i++) {
+    if (lazy_checkpoints[i].load() == this)
+      return;
+  }
+  for (int i = 0; i < MAX_LAZY_CHECKPOINTS; i++) {
+    if (!lazy_checkpoints[i].load()) {
+      lazy_checkpoints[i].store(this);
+      return;
+    }
+  }
+  assert(0);
+}
+
+void sparse_checkpoint_t::delist()
+{
+  std::lock_guard<std::mutex> guard(lazy_checkpoints_lock);
+  for (int i = 0; i < MAX_LAZY_CHECKPOINTS; i++) {
+    if (lazy_checkpoints[i].load() == this)
+      lazy_checkpoints[i].store(NULL);
+  }
+}
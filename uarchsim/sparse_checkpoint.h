@@ -0,0 +1,119 @@
+#ifndef SPARSE_CHECKPOINT_H
+#define SPARSE_CHECKPOINT_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <signal.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// Sparse, page-granular checkpoint file.
+//
+// The legacy checkpoint is one gzip stream: the HTIF log, the whole target
+// memory (memsz bytes, mostly zeros), and the register state.  Restoring it
+// inflates all of memory, for each simulator instance.
+//
+// A sparse checkpoint is a plain (not gzipped) file:
+//   1. sparse_header_t
+//   2. The rest of the simulator state, i.e., the legacy stream minus memory
+//      (HTIF log, then register checkpoint), deflated as a single block.
+//   3. Chunks.  A chunk is an aligned group of SPARSE_CHUNK_PAGES pages of
+//      SPARSE_PAGE_SIZE bytes.  Only its non-zero pages are stored, deflated
+//      together (fastest level), so each chunk can be restored on its own.
+//      All-zero chunks are not stored at all.
+//   4. The chunk index: one sparse_chunk_t per chunk, by increasing address.
+//
+// Restore zeroes target memory and then either inflates every chunk (eager),
+// or inflates each chunk when it is first touched (lazy), from a SIGSEGV
+// handler.  For the latter, the chunks are protected in each "view" of the
+// restored memory: the memory itself, or private mappings of it that are
+// shared by several simulators (see memory_image.h).
+/////////////////////////////////////////////////////////////////////////////
+
+#define SPARSE_MAGIC		0x314b435053313237ULL	// "721SPCK1"
+#define SPARSE_PAGE_SIZE	4096
+#define SPARSE_CHUNK_PAGES	16			// at most 64 (page mask)
+#define SPARSE_MAX_VIEWS	4
+
+typedef struct {
+  uint64_t magic;
+  uint64_t memsz;		// target memory size
+  uint64_t page_size;
+  uint64_t chunk_pages;
+  uint64_t num_chunks;
+  uint64_t index_offset;	// file offset of the chunk index
+  uint64_t state_offset;	// file offset of the deflated state
+  uint64_t state_csize;		// its size, deflated
+  uint64_t state_size;		// and inflated
+} sparse_header_t;
+
+typedef struct {
+  uint64_t addr;		// target address of the chunk (aligned)
+  uint64_t page_mask;		// bit per page of the chunk: stored (non-zero)
+  uint64_t offset;		// file offset of the deflated pages
+  uint64_t csize;		// their size, deflated
+} sparse_chunk_t;
+
+
+class sparse_checkpoint_t {
+public:
+  // Is "file" a sparse checkpoint?
+  static bool probe(const std::string& file);
+
+  // Write a sparse checkpoint of target memory "mem" (memsz bytes) and the rest of the simulator state.
+  static bool write(const std::string& file, const char* mem, size_t memsz, const std::string& state);
+
+  sparse_checkpoint_t();
+  ~sparse_checkpoint_t();
+
+  // Open "file" and output the rest of the simulator state.
+  bool open(const std::string& file, std::string& state);
+
+  // Restore target memory "mem" (which must be as large as the checkpointed memory).
+  // Lazy restore needs "mem" to be page-aligned; otherwise, memory is restored eagerly.
+  void restore(char* mem, size_t memsz, bool lazy);
+
+  // Add/remove a view of the restored memory: "mem" itself, or a mapping of it.
+  // Chunks not yet restored are restored when first touched through any view.
+  void attach(char* view);
+  void detach(char* view);
+
+  uint64_t chunks() { return(index.size()); }
+  uint64_t chunks_restored() { return(num_restored); }
+
+private:
+  int fd;
+  sparse_header_t header;
+  std::vector<sparse_chunk_t> index;
+  std::vector<int64_t> chunk_of;	// per aligned chunk of target memory: its index entry, or -1 (all zeros)
+  std::vector<bool> restored;
+
+  char* mem;
+  size_t memsz;
+  std::atomic<char*> views[SPARSE_MAX_VIEWS];
+  uint64_t chunk_bytes;
+  uint64_t num_restored;
+
+  // Buffers for restoring a chunk, allocated up front so that the SIGSEGV handler does not allocate memory.
+  std::vector<char> cbuf;		// deflated pages
+  std::vector<char> ubuf;		// inflated pages
+  std::vector<char> zarena;		// zlib's inflate state
+  size_t zarena_used;
+
+  bool lazy;				// chunks are restored when first touched
+  std::atomic_flag busy;		// a thread is restoring a chunk or protecting a view
+
+  bool restore_chunk(int64_t i);
+  static void* zalloc(void* opaque, unsigned int items, unsigned int size);
+  static void zfree(void* opaque, void* address);
+
+  // Lazy restore: a SIGSEGV in a protected chunk of a view of a registered checkpoint
+  // unprotects the chunk in that view and restores it, if not yet restored.
+  static void handle_fault(int sig, siginfo_t* info, void* context);
+  void enlist();
+  void delist();
+};
+
+#endif //SPARSE_CHECKPOINT_H
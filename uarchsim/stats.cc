@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cassert>
 #include "stats.h"
 #include "pipeline.h"
 #include "parameters.h"
@@ -6,6 +8,12 @@ stats_t::stats_t(pipeline_t* _proc){
 
   this->proc = _proc;
 
+  // Reserve the statically known counters first, so that each one's handle
+  // equals its CTR_<name> enumerator. They are only dumped once declared.
+#define STATS_COUNTER_RESERVE(name) add_counter(#name, "proc");
+  STATS_COUNTER_LIST(STATS_COUNTER_RESERVE)
+#undef STATS_COUNTER_RESERVE
+
   DECLARE_COUNTER(this, cycle_count               ,proc);
   DECLARE_COUNTER(this, commit_count              ,proc);
 #if 0
@@ -155,54 +163,74 @@ void stats_t::set_log_files(FILE* _stats_log,FILE* _phase_log){
 
 void stats_t::set_phase_interval(const char* name,uint64_t interval)
 {
-  std::strcpy(phase_counter_name,name);
+  phase_counter = find_counter(name);
   phase_interval = interval;
-  ifprintf(logging_on,stderr,"Setting phase interval to %s = %lu\n",phase_counter_name,interval);
+  ifprintf(logging_on,stderr,"Setting phase interval to %s = %lu\n",counter_info[phase_counter].name,interval);
 }
 
 void stats_t::reset_counters(){
-  std::map<std::string, counter_t*, ltstr>::iterator ctr_iter;
-  for(ctr_iter = counter_map.begin();ctr_iter != counter_map.end(); ctr_iter++){
-    ctr_iter->second->count = 0;
-  }
+  std::fill(count.begin(), count.end(), 0);
 }
 
 void stats_t::reset_phase_counters(){
-  std::map<std::string, counter_t*, ltstr>::iterator ctr_iter;
-  for(ctr_iter = counter_map.begin();ctr_iter != counter_map.end(); ctr_iter++){
-    ctr_iter->second->phase_count = 0;
-  }
+  std::fill(phase_count.begin(), phase_count.end(), 0);
+}
+
+// Allocate a new (not yet declared) counter slot and return its handle.
+counter_handle_t stats_t::add_counter(const char* name, const char* hierarchy){
+  counter_t c;
+  c.name         = new char[strlen(name)+1];
+  c.hierarchy    = new char[strlen(hierarchy)+1];
+  c.declared     = false;
+  c.valid_phase_counter    = false;
+  strcpy(c.name,name);
+  strcpy(c.hierarchy,hierarchy);
+
+  counter_handle_t ctr = counter_info.size();
+  counter_info.push_back(c);
+  count.push_back(0);
+  phase_count.push_back(0);
+  counter_map[name] = ctr;
+  return ctr;
 }
 
-void stats_t::register_counter(const char* name, const char* hierarchy){
-
-  counter_t* c    = new counter_t;
-  c->count        = 0;
-  c->phase_count  = 0;
-  c->name         = new char[strlen(name)+1];
-  c->hierarchy    = new char[strlen(hierarchy)+1];
-  c->valid_phase_counter    = false;
-  strcpy(c->name,name);
-  strcpy(c->hierarchy,hierarchy);
-  counter_map[name] = c;
+counter_handle_t stats_t::find_counter(const char* name){
+  std::map<std::string, counter_handle_t, ltstr>::iterator ctr_iter = counter_map.find(name);
+  assert(ctr_iter != counter_map.end());
+  return ctr_iter->second;
+}
+
+counter_handle_t stats_t::register_counter(const char* name, const char* hierarchy){
+  counter_handle_t ctr;
+  std::map<std::string, counter_handle_t, ltstr>::iterator ctr_iter = counter_map.find(name);
+  if(ctr_iter != counter_map.end()){
+    ctr = ctr_iter->second;
+    delete[] counter_info[ctr].hierarchy;
+    counter_info[ctr].hierarchy = new char[strlen(hierarchy)+1];
+    strcpy(counter_info[ctr].hierarchy,hierarchy);
+  } else {
+    ctr = add_counter(name, hierarchy);
+  }
+  counter_info[ctr].declared = true;
+  count[ctr] = 0;
+  phase_count[ctr] = 0;
   ifprintf(logging_on,stderr,"Counter name %s %s\n",name,hierarchy);
+  return ctr;
 }
 
-void stats_t::register_phase_counter(const char* name, const char* hierarchy){
+counter_handle_t stats_t::register_phase_counter(const char* name, const char* hierarchy){
+  counter_handle_t ctr;
+  std::map<std::string, counter_handle_t, ltstr>::iterator ctr_iter = counter_map.find(name);
   // If the counter has been declared, mark it as a phase counter
-  if(counter_map.find(name) != counter_map.end()){
-    counter_map[name]->valid_phase_counter = true;
+  if((ctr_iter != counter_map.end()) && counter_info[ctr_iter->second].declared){
+    ctr = ctr_iter->second;
   } 
   // If it does not exist, declare it and mark it as a phase counter
   else {
-    counter_t* c    = new counter_t;
-    c->name         = new char[strlen(name)+1];
-    c->hierarchy    = new char[strlen(hierarchy)+1];
-    c->valid_phase_counter  = true;
-    strcpy(c->name,name);
-    strcpy(c->hierarchy,hierarchy);
-    counter_map[name] = c;
+    ctr = register_counter(name, hierarchy);
   }
+  counter_info[ctr].valid_phase_counter = true;
+  return ctr;
 }
 
 void stats_t::register_rate(const char* name, const char* hierarchy, const char* numerator, const char* denominator, double multiplier){
@@ -254,22 +282,16 @@ void stats_t::register_knob(const char* name, const char* hierarchy, unsigned in
 }
 
 
-void stats_t::update_counter(const char* name,unsigned int inc){
+// Slow path for counters that are only known by name.
+void stats_t::update_counter(const char* name,int inc){
+  std::map<std::string, counter_handle_t, ltstr>::iterator ctr_iter = counter_map.find(name);
   // If the counter has been declared and initialized
-  if(counter_map.find(name) != counter_map.end()){
-    counter_map[name]->count++;
-    counter_map[name]->phase_count++;
-  }
-  // Tick the phase check mechanism if updating the 
-  // counter on which phases are based on. Normally this
-  // would be commit_count or cycle_count.
-  if(!std::strcmp(name, phase_counter_name)){
-    phase_tick();
-  }
+  if(ctr_iter != counter_map.end())
+    update_counter(ctr_iter->second, inc);
 }
 
 uint64_t stats_t::get_counter(const char* name){
-  return counter_map[name]->count;
+  return count[find_counter(name)];
 }
 
 unsigned int stats_t::get_knob(const char* name){
@@ -277,7 +299,7 @@ unsigned int stats_t::get_knob(const char* name){
 }
 
 void stats_t::phase_tick(){
-  if(counter_map[phase_counter_name]->phase_count >= phase_interval){
+  if(phase_count[phase_counter] >= phase_interval){
     phase_id++;
     update_rates();
     dump_phase_counters();
@@ -292,29 +314,33 @@ void stats_t::phase_tick(){
 void stats_t::update_rates(){
   std::map<std::string, rate_t*, ltstr>::iterator rate_iter;
   for(rate_iter = rate_map.begin();rate_iter != rate_map.end(); rate_iter++){
-    if(counter_map[rate_iter->second->denominator]->count == 0){
+    counter_handle_t numerator = find_counter(rate_iter->second->numerator);
+    counter_handle_t denominator = find_counter(rate_iter->second->denominator);
+
+    if(count[denominator] == 0){
       rate_iter->second->rate = (double)0.0;
     } else {
       rate_iter->second->rate = rate_iter->second->multiplier*
-                                double(counter_map[rate_iter->second->numerator]->count)/
-                                double(counter_map[rate_iter->second->denominator]->count);
+                                double(count[numerator])/
+                                double(count[denominator]);
     }
 
-    if(counter_map[rate_iter->second->denominator]->phase_count == 0){
+    if(phase_count[denominator] == 0){
       rate_iter->second->phase_rate = (double)0.0;
     } else {
       rate_iter->second->phase_rate = rate_iter->second->multiplier*
-                                      double(counter_map[rate_iter->second->numerator]->phase_count)/
-                                      double(counter_map[rate_iter->second->denominator]->phase_count);
+                                      double(phase_count[numerator])/
+                                      double(phase_count[denominator]);
     }
   }
 }
 
 void stats_t::dump_counters(){
   fprintf(stats_log,"[stats]\n");
-  std::map<std::string, counter_t*, ltstr>::iterator ctr_iter;
+  std::map<std::string, counter_handle_t, ltstr>::iterator ctr_iter;
   for(ctr_iter = counter_map.begin();ctr_iter != counter_map.end(); ctr_iter++){
-    fprintf(stats_log,"%s : %" PRIu64 "\n",ctr_iter->second->name, ctr_iter->second->count);
+    if(counter_info[ctr_iter->second].declared)
+      fprintf(stats_log,"%s : %" PRIu64 "\n",counter_info[ctr_iter->second].name, count[ctr_iter->second]);
   }
 }
 
@@ -328,10 +354,10 @@ void stats_t::dump_rates(){
 
 void stats_t::dump_phase_counters(){
   fprintf(phase_log,"-------- Phase Counters Phase ID %" PRIu64 "--------\n",phase_id);
-  std::map<std::string, counter_t*, ltstr>::iterator ctr_iter;
+  std::map<std::string, counter_handle_t, ltstr>::iterator ctr_iter;
   for(ctr_iter = counter_map.begin();ctr_iter != counter_map.end(); ctr_iter++){
-    if(ctr_iter->second->valid_phase_counter)
-      fprintf(phase_log,"%s : %" PRIu64 "\n",ctr_iter->second->name, ctr_iter->second->phase_count);
+    if(counter_info[ctr_iter->second].valid_phase_counter)
+      fprintf(phase_log,"%s : %" PRIu64 "\n",counter_info[ctr_iter->second].name, phase_count[ctr_iter->second]);
   }
 }
 
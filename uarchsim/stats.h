@@ -4,20 +4,99 @@
 #include <cinttypes>
 #include <cstring>
 #include <map>
+#include <string>
+#include <vector>
 #include <cstdio>
 
 
 // Statistics related variables and funcions
 
-#define inc_counter(x)  stats->update_counter(#x,1)
+// Every counter that is referenced by name in the source (inc_counter(), counter(),
+// DECLARE_COUNTER(), ...) must be listed here. Each entry gets a dense handle,
+// CTR_<name>, into the flat counter arrays of stats_t, so that bumping or reading
+// a counter is an indexed add/load instead of a string map lookup.
+// Counters whose names are only known at run time (e.g., per-cache counters) are
+// added after these, by register_counter().
+#define STATS_COUNTER_LIST(X) \
+  X(cycle_count) \
+  X(commit_count) \
+  X(load_count) \
+  X(store_count) \
+  X(fp_count) \
+  X(branch_count) \
+  X(cond_branch_count) \
+  X(uncond_branch_count) \
+  X(mispredict_count) \
+  X(ld_vio_count) \
+  X(exception_count) \
+  X(spec_inst_count) \
+  X(spec_cond_branch_count) \
+  X(spec_uncond_branch_count) \
+  X(spec_mispredict_count) \
+  X(load_stall_count) \
+  X(load_stall_miss_count) \
+  X(load_forward_count) \
+  X(spec_load_count) \
+  X(spec_store_count) \
+  X(load_replay_count) \
+  X(load_miss_count) \
+  X(store_miss_count) \
+  X(spec_load_miss_count) \
+  X(spec_store_miss_count) \
+  X(store_mhsr_miss_count) \
+  X(load_mhsr_miss_count) \
+  X(ld_replay_mhsr_miss_count) \
+  X(fetched_bundle_count) \
+  X(fetched_inst_count) \
+  X(btb_write_count) \
+  X(bp_write_count) \
+  X(ras_read_count) \
+  X(ras_write_count) \
+  X(ctiq_read_count) \
+  X(ctiq_write_count) \
+  X(dispatched_bundle_count) \
+  X(dispatched_inst_count) \
+  X(dispatched_load_count) \
+  X(dispatched_store_count) \
+  X(issued_bundle_count) \
+  X(issued_inst_count) \
+  X(retired_bundle_count) \
+  X(retired_inst_count) \
+  X(lane0_inst_executed_count) \
+  X(lane1_inst_executed_count) \
+  X(lane2_inst_executed_count) \
+  X(lane3_inst_executed_count) \
+  X(lane4_inst_executed_count) \
+  X(lane5_inst_executed_count) \
+  X(lane6_inst_executed_count) \
+  X(lane7_inst_executed_count) \
+  X(prf_read_count) \
+  X(prf_write_count) \
+  X(rmt_write_count) \
+  X(amt_write_count) \
+  X(recovery_count) \
+  X(wakeup_cam_read_count) \
+  X(freelist_write_count)
+
+typedef unsigned int counter_handle_t;
+
+typedef enum {
+#define STATS_COUNTER_ENUM(name) CTR_##name,
+  STATS_COUNTER_LIST(STATS_COUNTER_ENUM)
+#undef STATS_COUNTER_ENUM
+  NUM_STATIC_COUNTERS
+} static_counter_e;
+
+#define inc_counter(x)  stats->update_counter(CTR_##x,1)
 #define inc_counter_str(x)  stats->update_counter(x,1)
-#define dec_counter(x)  stats->update_counter(#x,-1)
-#define counter(x)      stats->get_counter(#x)
+#define dec_counter(x)  stats->update_counter(CTR_##x,-1)
+#define counter(x)      stats->get_counter(CTR_##x)
 #define knob(x)         stats->get_knob(#x)
 
 // Macro has been written this way to swallow semicolon
 #define DECLARE_COUNTER(stats,name,hierarchy) \
   do  {\
+    (void)CTR_##name;  \
     stats->register_counter(#name, #hierarchy);  \
   } while(0) 
 
@@ -30,6 +109,7 @@
 // Macro has been written this way to swallow semicolon
 #define DECLARE_PHASE_COUNTER(stats,name,hierarchy) \
   do  {\
+    (void)CTR_##name;  \
     stats->register_phase_counter(#name, #hierarchy);  \
   } while(0) 
 
@@ -55,11 +135,12 @@ struct ltstr
     }
 };
 
+// Name and dump attributes of a counter. Its values live in stats_t::count[]
+// and stats_t::phase_count[], at the counter's handle.
 typedef struct counter {
-  uint64_t count;
-  uint64_t phase_count;
   char* name;
   char* hierarchy;
+  bool declared;              // When "true", the counter has been declared and is dumped
   bool valid_phase_counter;   // When "true", indicates this must be dumped for each phase
 } counter_t;
 
@@ -95,13 +176,13 @@ public:
   stats_t(pipeline_t* _proc);
   ~stats_t(){}
   void set_phase_interval(const char* name,uint64_t interval);
-  void update_counter(const char* name,unsigned int inc=1);
+  void update_counter(const char* name,int inc=1);
   void update_pc_histogram(size_t pc);
   void update_br_histogram(size_t pc,bool misp);
   uint64_t get_counter(const char* name);
   unsigned int get_knob(const char* name);
-  void register_counter(const char* name, const char* hierarchy);
-  void register_phase_counter(const char* name, const char* hierarchy);
+  counter_handle_t register_counter(const char* name, const char* hierarchy);
+  counter_handle_t register_phase_counter(const char* name, const char* hierarchy);
   void register_rate(const char* name, const char* hierarchy, const char* numerator, const char* denominator, double multiplier);
   void register_phase_rate(const char* name, const char* hierarchy, const char* numerator, const char* denominator, double multiplier);
   void register_knob(const char* name, const char* hierarchy, unsigned int value);
@@ -118,11 +199,29 @@ public:
   void dump_pc_histogram();  
   void dump_br_histogram();  
 
+  // Fast path used by the inc_counter()/counter() macros and by modules that
+  // hold handles returned by register_counter().
+  inline void update_counter(counter_handle_t ctr,int inc=1){
+    count[ctr] += inc;
+    phase_count[ctr] += inc;
+    // Tick the phase check mechanism if updating the 
+    // counter on which phases are based on. Normally this
+    // would be commit_count or cycle_count.
+    if(ctr == phase_counter)
+      phase_tick();
+  }
+  inline uint64_t get_counter(counter_handle_t ctr){return count[ctr];}
+
   //inline void set_histogram(bool val){histogram_enabled = val;}
 
 private:
 
-  std::map<std::string, counter_t*, ltstr> counter_map;
+  // Flat counter storage, indexed by counter handle.
+  std::vector<uint64_t> count;
+  std::vector<uint64_t> phase_count;
+  std::vector<counter_t> counter_info;
+  // Name to handle, for lookup by name and for dumping in name order.
+  std::map<std::string, counter_handle_t, ltstr> counter_map;
   std::map<std::string, rate_t*, ltstr> rate_map;
   //map<const char*, counter_t*, ltstr> phase_counter_map;
   std::map<std::string, knob_t*, ltstr> knob_map;
@@ -131,13 +230,15 @@ private:
 
   uint64_t phase_id;
   uint64_t phase_interval;
-  char phase_counter_name[16];
+  counter_handle_t phase_counter;
   FILE* stats_log;
   FILE* phase_log;
 
   pipeline_t* proc;
   //bool histogram_enabled;
 
+  counter_handle_t add_counter(const char* name, const char* hierarchy);
+  counter_handle_t find_counter(const char* name);
   void phase_tick();
 };
 
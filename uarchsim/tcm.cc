@@ -10,6 +10,7 @@
 #include <iostream>
 #include <stdio.h>
 #include "parameters.h"
+#include "histogram.h"
 using namespace std;
 
 tcm_t::tcm_t(uint64_t num_entries, uint64_t assoc, uint64_t num_instr_per_cycle, uint64_t cond_branch_per_cycle)
@@ -20,20 +21,63 @@ tcm_t::tcm_t(uint64_t num_entries, uint64_t assoc, uint64_t num_instr_per_cycle,
 	this->cond_branch_per_cycle = cond_branch_per_cycle;
 
 	assert(IsPow2(sets));
+	assert(assoc <= MAX_TCM_ASSOC);
 
 	log2sets = (uint64_t) log2((double)sets);
+
+	meas_fill = 0;
+	meas_path_conflict = 0;
+	meas_multi_path = 0;
+	meas_full_hit = 0;
+	meas_full_len = 0;
+	meas_partial_hit = 0;
+	meas_partial_len = 0;
+	meas_set_fill = new uint64_t[sets];
+	meas_set_evict = new uint64_t[sets];
+
 	// Allocate the 2D array.
 	tcm = new tcm_entry_t *[sets];
+	data = new tcm_data_t *[sets];
 	
 	for (uint64_t s = 0; s < sets; s++) 
 	{
 		tcm[s] = new tcm_entry_t[assoc];
+		data[s] = new tcm_data_t[assoc];
+		meas_set_fill[s] = 0;
+		meas_set_evict[s] = 0;
 	 	for (uint64_t way = 0; way < assoc; way++)
 	 	{
 	    	tcm[s][way].valid = false;
-	    	tcm[s][way].lru = way;
+	    	tcm[s][way].last_use = (assoc - 1 - way);	// way assoc-1 is replaced first
+	    	data[s][way].valid = false;
 	 	}  
 	}
+	use_clock = assoc;
+
+	// Allocate the trace victim buffer.
+	victim_entries = TCM_VICTIM;
+	victim = NULL;
+	if (victim_entries) {
+		victim = new tcm_victim_t[victim_entries];
+		for (uint64_t i = 0; i < victim_entries; i++) {
+			victim[i].entry.valid = false;
+			victim[i].entry.last_use = 0;
+			victim[i].data.valid = false;
+		}
+	}
+
+	// Allocate the insertion filter's counter table.
+	filter_entries = TCM_FILTER_ENTRIES;
+	filter = NULL;
+	if (TCM_FILTER > 1) {
+		assert(IsPow2(filter_entries));
+		filter = new uint64_t[filter_entries];
+		for (uint64_t i = 0; i < filter_entries; i++)
+			filter[i] = 0;
+	}
+	meas_victim_hit = 0;
+	meas_victim_insert = 0;
+	meas_filtered = 0;
 }
 
 
@@ -44,7 +88,8 @@ tcm_t::~tcm_t()
 
 //Inputs:
 // 1. pc: The start pc of the fetch bundle.
-// 2. cb_predictions: A uint64_t packed with "m" 2-bit counters for predicting conditional branches.
+// 2. bhr: The global branch history at the start of the fetch bundle (used by some index functions).
+// 3. cb_predictions: A uint64_t packed with "m" 2-bit counters for predicting conditional branches.
 // this->cond_branch_per_cycle: "m", the maximum number of conditional branches allowed in a fetch bundle.
 
 // Output:
@@ -53,8 +98,11 @@ tcm_t::~tcm_t()
 // 2. Its length (fetch_bundle_length).
 // 3. BTB information (hit, type, target) at each slot within the fetch bundle (btb_fetch_bundle[]).
 // 4. Its next pc, if it can be provided by the BTB (next_pc, an output of this function).
+// 5. Its instructions and their decode-stage fields, if held by the trace data array (tcm_data).
+// 6. Its promoted conditional branches and their fixed directions (tcm_promoted_mask, tcm_promoted_taken).
 //
-bool tcm_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &tcm_bundle_length, btb_output_t tcm_fetch_bundle[], uint64_t &tcm_next_pc)
+bool tcm_t::lookup(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &tcm_bundle_length, btb_output_t tcm_fetch_bundle[], uint64_t &tcm_next_pc, tcm_data_t* &tcm_data,
+                   uint64_t &tcm_promoted_mask, uint64_t &tcm_promoted_taken)
 {
 	uint64_t set;
    	uint64_t way;
@@ -68,13 +116,17 @@ bool tcm_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &tcm_bundle_le
    	
 
         tcm_bundle_length = 0;
+	tcm_data = NULL;
+	tcm_promoted_mask = 0;
+	tcm_promoted_taken = 0;
 	predictions = 0;
    	for (int i = 0 ; i <cond_branch_per_cycle ; i++)
    	{
    		predictions = predictions | (((cb_predictions_tmp & 3) >= 2) << i);
 		cb_predictions_tmp = cb_predictions_tmp >> 2;
     }
-   	if (search(pc, cb_predictions, set, way))
+   	if ((TCM_PATHS ? search_paths(pc, bhr, cb_predictions, set, way) : search(pc, bhr, cb_predictions, set, way)) ||
+	    (victim_entries && victim_search(pc, bhr, cb_predictions, set, way)))
    	{
          // TCM hit.  The TCM coordinates of this branch are {set, way}.
         tcm_hit = true;
@@ -107,11 +159,36 @@ bool tcm_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &tcm_bundle_le
         	tcm_next_pc = tcm[set][way].fall_thru_pc; // Fallthrough-pc 
         }
 
+        // The trace's instructions, from the trace data array.
+        if (data[set][way].valid)
+        	tcm_data = &data[set][way];
+
+        tcm_promoted_mask = tcm[set][way].promoted_mask;
+        tcm_promoted_taken = tcm[set][way].promoted_taken;
+
          // Update LRU.
 	 	update_lru(set, way);
 
+		meas_full_hit++;
+		meas_full_len += tcm_bundle_length;
 	}
 
+    else if (TCM_PARTIAL && search_partial(pc, bhr, cb_predictions, set, way, tcm_bundle_length, tcm_next_pc))
+    {
+	 // Partial TCM hit: only the first tcm_bundle_length instructions of the trace at {set, way} are on the predicted path.
+         tcm_hit = true;
+         for (int i = 0; i < tcm_bundle_length; i++)
+       		tcm_fetch_bundle[i] = tcm[set][way].tcm_fetch_bundle[i];
+         if (data[set][way].valid)
+        	tcm_data = &data[set][way];
+         tcm_promoted_mask = tcm[set][way].promoted_mask;
+         tcm_promoted_taken = tcm[set][way].promoted_taken;
+	 update_lru(set, way);
+
+	 meas_partial_hit++;
+	 meas_partial_len += tcm_bundle_length;
+    }
+
     else 
     {
 	 // TCM miss.
@@ -123,9 +200,13 @@ bool tcm_t::lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &tcm_bundle_le
 }
 
 // Called after btb is hit and fetch bundle is formed
-void tcm_t::line_fill_buffer(uint64_t pc, uint64_t cb_predictions, uint64_t fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t next_pc){
+// A promoted conditional branch is embedded like a jump direct in the direction it was promoted in:
+// it neither counts towards the "m" conditional branches nor uses a counter from cb_predictions.
+void tcm_t::line_fill_buffer(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t promoted_mask, uint64_t promoted_taken,
+                             uint64_t fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t next_pc, insn_t fetch_insn[], bool insn_valid){
 	if(valid_line_fill==0){
 		pc_line_fill = pc;
+		bhr_line_fill = bhr;
 		cb_predictions_line_fill = cb_predictions;
 		valid_line_fill = 1;
 		cond_branch_line_fill = 0;
@@ -134,7 +215,12 @@ void tcm_t::line_fill_buffer(uint64_t pc, uint64_t cb_predictions, uint64_t fetc
 		line_fill_buffer_entry.ends_in_br = 0;
 		line_fill_buffer_entry.valid = 1;
 		line_fill_buffer_entry.tcm_bundle_length = 0;
+		line_fill_buffer_entry.promoted_mask = 0;
+		line_fill_buffer_entry.promoted_taken = 0;
+		line_fill_data.valid = (TCM_DATA != 1);
 	}
+	if (!insn_valid)
+		line_fill_data.valid = false;
 	uint64_t pos = line_fill_buffer_entry.tcm_bundle_length;
 	uint64_t bundle_len = 0;
 	uint64_t br_fall_thru = pc;
@@ -146,7 +232,14 @@ void tcm_t::line_fill_buffer(uint64_t pc, uint64_t cb_predictions, uint64_t fetc
 			bundle_len++;
 			last_br = 0;
 			br_next_pc = INCREMENT_PC(br_next_pc);
-			if ((btb_fetch_bundle[i].branch_type == BTB_BRANCH) && btb_fetch_bundle[i].hit){
+			if ((btb_fetch_bundle[i].branch_type == BTB_BRANCH) && btb_fetch_bundle[i].hit && (promoted_mask & (1 << i))){
+				line_fill_buffer_entry.promoted_mask |= ((uint64_t)1 << (i+pos));
+				if (promoted_taken & (1 << i)) {
+					line_fill_buffer_entry.promoted_taken |= ((uint64_t)1 << (i+pos));
+					br_next_pc = btb_fetch_bundle[i].target;
+				}
+			}
+			else if ((btb_fetch_bundle[i].branch_type == BTB_BRANCH) && btb_fetch_bundle[i].hit){
 				br_fall_thru = br_next_pc;
 				last_br = 1;
 				cond_branch_line_fill = ((cond_branch_line_fill << 1) | ((cb_predictions & 3) >= 2));
@@ -161,6 +254,7 @@ void tcm_t::line_fill_buffer(uint64_t pc, uint64_t cb_predictions, uint64_t fetc
 				br_next_pc = btb_fetch_bundle[i].target;
 			}
 			line_fill_buffer_entry.tcm_fetch_bundle[i+pos] = btb_fetch_bundle[i];
+			line_fill_data.insn[i+pos] = fetch_insn[i];
 			if (((btb_fetch_bundle[i].branch_type == BTB_CALL_DIRECT) || 
 			     (btb_fetch_bundle[i].branch_type == BTB_JUMP_INDIRECT) ||
 			     (btb_fetch_bundle[i].branch_type == BTB_CALL_INDIRECT) ||
@@ -232,20 +326,77 @@ void tcm_t::commit_line_fill() {
 	bool hit;
 	uint64_t commit_set;
 	uint64_t commit_way;
+	uint64_t index[MAX_TCM_ASSOC];
+	uint64_t tag = tag_of(pc_line_fill);
 	if (line_fill_full == 1){
 		valid_line_fill = 0;
 		line_fill_full = 0;
-		hit = search(pc_line_fill, cb_predictions_line_fill, commit_set, commit_way);
+		if (TCM_PATHS) {
+			set_index(pc_line_fill, bhr_line_fill, index);
+			commit_way = fill_way(index, tag, cond_branch_line_fill, br_mask_line_fill);
+			commit_set = index[commit_way];
+		}
+		else {
+			hit = search(pc_line_fill, bhr_line_fill, cb_predictions_line_fill, commit_set, commit_way);
+		}
+
+		// Is the trace already in the TCM (it is rewritten in place)?
+		tcm_entry_t &old = tcm[commit_set][commit_way];
+		bool present = (old.valid && (old.tag == tag) && (old.br_mask == br_mask_line_fill) && (old.br_flags == cond_branch_line_fill));
+
+		// A copy in the victim buffer is superseded.  It proves the trace is reused: skip the insertion filter.
+		bool reused = false;
+		for (uint64_t i = 0; i < victim_entries; i++) {
+			tcm_victim_t &v = victim[i];
+			if (v.entry.valid && (v.pc == pc_line_fill) && (v.entry.br_mask == br_mask_line_fill) && (v.entry.br_flags == cond_branch_line_fill)) {
+				v.entry.valid = false;
+				reused = true;
+			}
+		}
+
+		// Insertion filter.
+		if (!present && !reused && (TCM_FILTER > 1) && !filter_insert(pc_line_fill, cond_branch_line_fill, br_mask_line_fill)) {
+			meas_filtered++;
+			line_fill_buffer_entry.valid = 0;
+			return;
+		}
+
+		// Measure traces that replace a valid trace: conflicts, in general, and
+		// conflicts with a different path from the same start pc, in particular.
+		meas_fill++;
+		meas_set_fill[commit_set]++;
+		if (tcm[commit_set][commit_way].valid) {
+			if ((tcm[commit_set][commit_way].tag != tag) ||
+			    (tcm[commit_set][commit_way].br_mask != br_mask_line_fill) || (tcm[commit_set][commit_way].br_flags != cond_branch_line_fill))
+				meas_set_evict[commit_set]++;
+			if ((tcm[commit_set][commit_way].tag == tag) &&
+			    ((tcm[commit_set][commit_way].br_mask != br_mask_line_fill) || (tcm[commit_set][commit_way].br_flags != cond_branch_line_fill)))
+				meas_path_conflict++;
+			// The replaced trace goes to the victim buffer.
+			if (victim_entries && !present)
+				victim_insert(commit_set, commit_way);
+		}
+
 		update_lru(commit_set, commit_way);
 		tcm[commit_set][commit_way].valid = line_fill_buffer_entry.valid;
-		tcm[commit_set][commit_way].tag = (pc_line_fill >> log2sets);
+		tcm[commit_set][commit_way].tag = tag;
 		tcm[commit_set][commit_way].br_flags = cond_branch_line_fill;
 		tcm[commit_set][commit_way].br_mask = br_mask_line_fill;
 		tcm[commit_set][commit_way].tcm_bundle_length = line_fill_buffer_entry.tcm_bundle_length;
 		tcm[commit_set][commit_way].ends_in_br = line_fill_buffer_entry.ends_in_br;
+		tcm[commit_set][commit_way].promoted_mask = line_fill_buffer_entry.promoted_mask;
+		tcm[commit_set][commit_way].promoted_taken = line_fill_buffer_entry.promoted_taken;
    		for (uint64_t i = 0; i < num_instr_per_cycle; i++)
 			tcm[commit_set][commit_way].tcm_fetch_bundle[i] = line_fill_buffer_entry.tcm_fetch_bundle[i];
 		tcm[commit_set][commit_way].fall_thru_pc = line_fill_buffer_entry.fall_thru_pc; // fall through address to be used in case bundle does not en with a branch or branch is not taken BUG_FIX
+		// Fill the trace data array, predecoding the trace's instructions.
+		data[commit_set][commit_way].valid = line_fill_data.valid;
+		if (line_fill_data.valid) {
+			for (uint64_t i = 0; i < line_fill_buffer_entry.tcm_bundle_length; i++) {
+				data[commit_set][commit_way].insn[i] = line_fill_data.insn[i];
+				predecode(line_fill_data.insn[i], data[commit_set][commit_way].pre[i]);
+			}
+		}
 		line_fill_buffer_entry.valid = 0;
 	}
 }
@@ -258,11 +409,9 @@ void tcm_t::commit_line_fill() {
 /// Private Functions////
 /////////////////////////
 
-bool tcm_t::search(uint64_t pc, uint64_t cb_predictions, uint64_t &set, uint64_t &way)
+// Pack the "m" T/NT predictions in the order that br_flags records a trace's branch outcomes.
+uint64_t tcm_t::path_predictions(uint64_t cb_predictions)
 {
-	uint64_t tcm_pc = pc ;  
-	uint64_t index = (tcm_pc & (sets - 1)); 
-   	uint64_t tag = (tcm_pc >> log2sets);
    	uint64_t predictions;
 
    	predictions = 0;
@@ -273,6 +422,77 @@ bool tcm_t::search(uint64_t pc, uint64_t cb_predictions, uint64_t &set, uint64_t
    		predictions = predictions << 1;
     }
    		predictions = predictions >> 2;
+	return(predictions);
+}
+
+// The set that "pc" indexes in each way (index[way]).
+// TCM_INDEX selects the index function (x = pc >> 2, i.e., the pc without its always-zero bits):
+// 0: pc (the low pc bits, as in the original TCM)
+// 1: x
+// 2: x, XOR-folded down to log2sets bits
+// 3: x XOR the global branch history at the start of the trace (bhr), XOR-folded
+// 4: skewed: way w XORs the low log2sets bits of x with the next log2sets bits rotated by w
+void tcm_t::set_index(uint64_t pc, uint64_t bhr, uint64_t index[])
+{
+	uint64_t x = (pc >> 2);
+	uint64_t low, high;
+
+	switch (TCM_INDEX) {
+		case 0:
+			index[0] = (pc & (sets - 1));
+			break;
+		case 1:
+			index[0] = (x & (sets - 1));
+			break;
+		case 2:
+			index[0] = fold(x);
+			break;
+		case 3:
+			index[0] = (fold(x) ^ fold(bhr));
+			break;
+		case 4:
+			low = (x & (sets - 1));
+			high = ((x >> log2sets) & (sets - 1));
+			for (uint64_t w = 0; w < assoc; w++) {
+				uint64_t r = (log2sets ? (w % log2sets) : 0);
+				index[w] = (low ^ (r ? (((high << r) | (high >> (log2sets - r))) & (sets - 1)) : high));
+			}
+			return;
+		default:
+			assert(0);
+			break;
+	}
+	for (uint64_t w = 1; w < assoc; w++)
+		index[w] = index[0];
+}
+
+// XOR-fold "x" down to log2sets bits.
+uint64_t tcm_t::fold(uint64_t x)
+{
+	uint64_t f = 0;
+	if (log2sets == 0)
+		return(0);
+	while (x) {
+		f ^= (x & (sets - 1));
+		x >>= log2sets;
+	}
+	return(f);
+}
+
+// The tag stored with a trace.  Other than for the original index function,
+// the set does not imply any pc bits, so the whole pc is the tag.
+uint64_t tcm_t::tag_of(uint64_t pc)
+{
+	return((TCM_INDEX == 0) ? (pc >> log2sets) : pc);
+}
+
+bool tcm_t::search(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way)
+{
+	uint64_t index[MAX_TCM_ASSOC];
+   	uint64_t tag = tag_of(pc);
+   	uint64_t predictions = path_predictions(cb_predictions);
+
+	set_index(pc, bhr, index);
 	   
    
    // Search the indexed set.
@@ -284,42 +504,342 @@ bool tcm_t::search(uint64_t pc, uint64_t cb_predictions, uint64_t &set, uint64_t
    
    for (uint64_t i = 0; i < assoc; i++) 
    {
-   		br_mask_search = (tcm[index][i].br_mask >> 1);
-   		br_flags_search = (tcm[index][i].br_flags >> 1);
+		tcm_entry_t &e = tcm[index[i]][i];
+   		br_mask_search = (e.br_mask >> 1);
+   		br_flags_search = (e.br_flags >> 1);
 
    		// Trace Cache Hit if Index is Valid, Tag match and m predictions from predictor matches with the predictions saved in TCM
-		if (tcm[index][i].valid && (tcm[index][i].tag == tag) && ((br_mask_search & predictions) == (br_mask_search & br_flags_search))) 
+		if (e.valid && (e.tag == tag) && ((br_mask_search & predictions) == (br_mask_search & br_flags_search))) 
 		{
 			hit = true;
 			hit_way = i;
 			break;
 		}
 
-    	else if (tcm[index][i].lru == (assoc - 1)) 
+    	else if ((lru_way == assoc) || (e.last_use < tcm[index[lru_way]][lru_way].last_use)) 
       	{
         	lru_way = i;
       	}
    }
 
    // Outputs.
-   set = index;
    way = (hit ? hit_way : lru_way);
    assert(way < assoc);
+   set = index[way];
    return(hit);
 }
 
 
+// Path-associative search (TCM_PATHS > 0).
+// A set may hold several traces from the same start pc, one per path.  Among the traces whose
+// path agrees with the predictions, select the longest (TCM_PATH_SELECT = 0, ties go to the
+// most recently used) or the most recently used (TCM_PATH_SELECT = 1).
+// On a miss, "way" is the set's LRU way.
+bool tcm_t::search_paths(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way)
+{
+	uint64_t index[MAX_TCM_ASSOC];
+	uint64_t tag = tag_of(pc);
+	uint64_t predictions = path_predictions(cb_predictions);
+	uint64_t br_mask_search;
+	uint64_t hit_way = assoc; // out-of-bounds
+	uint64_t lru_way = assoc; // out-of-bounds
+	uint64_t matches = 0;
+
+	set_index(pc, bhr, index);
+
+	for (uint64_t i = 0; i < assoc; i++)
+	{
+		tcm_entry_t &e = tcm[index[i]][i];
+		br_mask_search = (e.br_mask >> 1);
+		if (e.valid && (e.tag == tag) && ((br_mask_search & predictions) == (br_mask_search & (e.br_flags >> 1))))
+		{
+			matches++;
+			if (hit_way == assoc) {
+				hit_way = i;
+			}
+			else {
+				tcm_entry_t &h = tcm[index[hit_way]][hit_way];
+				if ((TCM_PATH_SELECT == 0) ?
+				    ((e.tcm_bundle_length > h.tcm_bundle_length) ||
+				     ((e.tcm_bundle_length == h.tcm_bundle_length) && (e.last_use > h.last_use))) :
+				    (e.last_use > h.last_use))
+					hit_way = i;
+			}
+		}
+		if ((lru_way == assoc) || (e.last_use < tcm[index[lru_way]][lru_way].last_use))
+			lru_way = i;
+	}
+
+	if (matches > 1)
+		meas_multi_path++;
+
+	// Outputs.
+	way = ((hit_way < assoc) ? hit_way : lru_way);
+	assert(way < assoc);
+	set = index[way];
+	return(hit_way < assoc);
+}
+
+// Partial-match search (TCM_PARTIAL), after search() or search_paths() missed.
+// Walk each trace with a matching start pc, comparing its embedded conditional branches (other than
+// promoted branches) with the predictions, in order.  The trace agrees with the predictions up to and including the first branch
+// that diverges: deliver that prefix ("length"), continuing at the diverging branch's predicted
+// direction ("next_pc").  Select the trace with the longest prefix (ties go to the most recently used).
+// A trace that agrees in full would have hit, so every candidate diverges somewhere.
+bool tcm_t::search_partial(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way, uint64_t &length, uint64_t &next_pc)
+{
+	uint64_t index[MAX_TCM_ASSOC];
+	uint64_t tag = tag_of(pc);
+	uint64_t hit_way = assoc; // out-of-bounds
+
+	set_index(pc, bhr, index);
+
+	for (uint64_t i = 0; i < assoc; i++)
+	{
+		tcm_entry_t &e = tcm[index[i]][i];
+		if (!e.valid || (e.tag != tag))
+			continue;
+
+		uint64_t slot_pc = pc;
+		uint64_t cb = cb_predictions;
+		uint64_t k = 0;		// position of the current conditional branch in the trace
+		for (uint64_t j = 0; j < e.tcm_bundle_length; j++)
+		{
+			btb_output_t &slot = e.tcm_fetch_bundle[j];
+			bool stored_taken = false;
+			if (slot.hit && (slot.branch_type == BTB_BRANCH) && ((e.promoted_mask >> j) & 1))
+			{
+				// A promoted branch goes its fixed direction.
+				stored_taken = (((e.promoted_taken >> j) & 1) == 1);
+			}
+			else if (slot.hit && (slot.branch_type == BTB_BRANCH))
+			{
+				bool predicted_taken = ((cb & 3) >= 2);
+				cb = (cb >> 2);
+				// The trace's last branch, when it ends the trace, may go either way.
+				if (!((j == (e.tcm_bundle_length - 1)) && e.ends_in_br))
+				{
+					stored_taken = (((e.br_flags >> (cond_branch_per_cycle - 1 - k)) & 1) == 1);
+					if (predicted_taken != stored_taken)
+					{
+						if ((hit_way == assoc) || ((j + 1) > length) ||
+						    (((j + 1) == length) && (e.last_use > tcm[index[hit_way]][hit_way].last_use)))
+						{
+							hit_way = i;
+							length = (j + 1);
+							next_pc = (predicted_taken ? slot.target : INCREMENT_PC(slot_pc));
+						}
+						break;
+					}
+				}
+				k++;
+			}
+			if (slot.hit && ((slot.branch_type == BTB_JUMP_DIRECT) || ((slot.branch_type == BTB_BRANCH) && stored_taken)))
+				slot_pc = slot.target;
+			else
+				slot_pc = INCREMENT_PC(slot_pc);
+		}
+	}
+
+	if (hit_way == assoc)
+		return(false);
+	way = hit_way;
+	set = index[way];
+	return(true);
+}
+
+// Path-associative replacement (TCM_PATHS > 0).  Returns the way to write the trace into.
+// 1. A trace with the same start pc and path is rewritten in place.
+// 2. If the start pc already has TCM_PATHS paths in the set, its least recently used path is replaced.
+// 3. Otherwise, the set's least recently used trace is replaced.
+uint64_t tcm_t::fill_way(uint64_t index[], uint64_t tag, uint64_t br_flags, uint64_t br_mask)
+{
+	uint64_t paths = 0;
+	uint64_t lru_path = assoc; // out-of-bounds
+	uint64_t lru_way = assoc;  // out-of-bounds
+
+	for (uint64_t i = 0; i < assoc; i++)
+	{
+		tcm_entry_t &e = tcm[index[i]][i];
+		if (e.valid && (e.tag == tag))
+		{
+			if ((e.br_mask == br_mask) && (e.br_flags == br_flags))
+				return(i);
+			paths++;
+			if ((lru_path == assoc) || (e.last_use < tcm[index[lru_path]][lru_path].last_use))
+				lru_path = i;
+		}
+		if ((lru_way == assoc) || (e.last_use < tcm[index[lru_way]][lru_way].last_use))
+			lru_way = i;
+	}
+
+	assert(lru_way < assoc);
+	return((paths >= TCM_PATHS) ? lru_path : lru_way);
+}
+
+
 void tcm_t::update_lru(uint64_t set, uint64_t way)
 {
 	// Make "way" most-recently-used.
-	for (uint64_t i = 0; i < assoc; i++)
+	tcm[set][way].last_use = ++use_clock;
+}
+
+// The start pc of the trace with "tag" in "set" (the inverse of set_index() and tag_of()).
+uint64_t tcm_t::pc_of(uint64_t set, uint64_t tag)
+{
+	return((TCM_INDEX == 0) ? ((tag << log2sets) | set) : tag);
+}
+
+// Victim buffer search, after the TCM missed.  The matching trace (selected like search()) is swapped
+// with the trace at the TCM's replacement way for "pc", and the hit is delivered from there: {set, way}.
+bool tcm_t::victim_search(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way)
+{
+	uint64_t index[MAX_TCM_ASSOC];
+	uint64_t predictions = path_predictions(cb_predictions);
+	uint64_t hit_i = victim_entries; // out-of-bounds
+
+	for (uint64_t i = 0; i < victim_entries; i++)
 	{
-		if (tcm[set][i].lru < tcm[set][way].lru)
-		tcm[set][i].lru++;
+		tcm_entry_t &e = victim[i].entry;
+		uint64_t br_mask_search = (e.br_mask >> 1);
+		if (e.valid && (victim[i].pc == pc) && ((br_mask_search & predictions) == (br_mask_search & (e.br_flags >> 1))))
+		{
+			hit_i = i;
+			break;
+		}
+	}
+	if (hit_i == victim_entries)
+		return(false);
+	meas_victim_hit++;
+
+	// On a miss, search() and search_paths() output the replacement way; with TCM_PATHS, honor its per-pc limit.
+	if (TCM_PATHS) {
+		set_index(pc, bhr, index);
+		way = fill_way(index, tag_of(pc), victim[hit_i].entry.br_flags, victim[hit_i].entry.br_mask);
+		set = index[way];
+	}
+
+	// Swap.
+	tcm_victim_t v = victim[hit_i];
+	victim[hit_i].entry.valid = false;
+	if (tcm[set][way].valid) {
+		victim[hit_i].pc = pc_of(set, tcm[set][way].tag);
+		victim[hit_i].entry = tcm[set][way];
+		victim[hit_i].entry.last_use = ++use_clock;
+		victim[hit_i].data = data[set][way];
+	}
+	tcm[set][way] = v.entry;
+	tcm[set][way].tag = tag_of(pc);
+	data[set][way] = v.data;
+	update_lru(set, way);
+	return(true);
+}
+
+// Move the trace at {set, way}, about to be replaced, into the victim buffer's LRU entry.
+void tcm_t::victim_insert(uint64_t set, uint64_t way)
+{
+	uint64_t lru_i = 0;
+	for (uint64_t i = 0; i < victim_entries; i++) {
+		if (!victim[i].entry.valid) {
+			lru_i = i;
+			break;
+		}
+		if (victim[i].entry.last_use < victim[lru_i].entry.last_use)
+			lru_i = i;
 	}
-	tcm[set][way].lru = 0;
+	victim[lru_i].pc = pc_of(set, tcm[set][way].tag);
+	victim[lru_i].entry = tcm[set][way];
+	victim[lru_i].entry.last_use = ++use_clock;
+	victim[lru_i].data = data[set][way];
+	meas_victim_insert++;
+}
+
+// Insertion filter: count another construction of the trace.  Returns true once it was constructed
+// TCM_FILTER times; the count then starts over, so that a trace evicted since must prove itself again.
+bool tcm_t::filter_insert(uint64_t pc, uint64_t br_flags, uint64_t br_mask)
+{
+	uint64_t &ctr = filter[((pc >> 2) ^ (br_mask << 5) ^ (br_flags << 11)) & (filter_entries - 1)];
+	if (++ctr < TCM_FILTER)
+		return(false);
+	ctr = 0;
+	return(true);
 }
 
 void tcm_t::clear_line_fill() {
 	valid_line_fill = 0;
 }
+
+void tcm_t::invalidate_data() {
+	for (uint64_t s = 0; s < sets; s++)
+		for (uint64_t way = 0; way < assoc; way++)
+			data[s][way].valid = false;
+	for (uint64_t i = 0; i < victim_entries; i++)
+		victim[i].data.valid = false;
+	line_fill_data.valid = false;
+}
+
+void tcm_t::save_state(std::ostream &out) {
+	uint64_t geometry[7] = {sets, assoc, num_instr_per_cycle, cond_branch_per_cycle, TCM_INDEX,
+	                        victim_entries, (filter ? filter_entries : 0)};
+	out.write((const char *)geometry, sizeof(geometry));
+	for (uint64_t s = 0; s < sets; s++) {
+		out.write((const char *)tcm[s], assoc * sizeof(tcm_entry_t));
+		out.write((const char *)data[s], assoc * sizeof(tcm_data_t));
+	}
+	out.write((const char *)&use_clock, sizeof(use_clock));
+	if (victim)
+		out.write((const char *)victim, victim_entries * sizeof(tcm_victim_t));
+	if (filter)
+		out.write((const char *)filter, filter_entries * sizeof(uint64_t));
+}
+
+bool tcm_t::restore_state(std::istream &in) {
+	uint64_t geometry[7];
+	in.read((char *)geometry, sizeof(geometry));
+	if (!in || (geometry[0] != sets) || (geometry[1] != assoc) || (geometry[2] != num_instr_per_cycle) ||
+	    (geometry[3] != cond_branch_per_cycle) || (geometry[4] != TCM_INDEX) ||
+	    (geometry[5] != victim_entries) || (geometry[6] != (filter ? filter_entries : 0)))
+		return(false);
+	for (uint64_t s = 0; s < sets; s++) {
+		in.read((char *)tcm[s], assoc * sizeof(tcm_entry_t));
+		in.read((char *)data[s], assoc * sizeof(tcm_data_t));
+	}
+	in.read((char *)&use_clock, sizeof(use_clock));
+	if (victim)
+		in.read((char *)victim, victim_entries * sizeof(tcm_victim_t));
+	if (filter)
+		in.read((char *)filter, filter_entries * sizeof(uint64_t));
+	return((bool)in);
+}
+
+void tcm_t::output(FILE *fp) {
+	HistogramClass occupancy(assoc + 1);	// # sets by # valid ways
+	HistogramClass conflicts(17);		// # sets by conflicts: 0, then [2^(b-1), 2^b)
+	uint64_t touched = 0;
+
+	for (uint64_t s = 0; s < sets; s++) {
+		uint64_t valid_ways = 0;
+		for (uint64_t way = 0; way < assoc; way++)
+			if (tcm[s][way].valid)
+				valid_ways++;
+		occupancy.Increment((int)valid_ways);
+		conflicts.Increment(meas_set_evict[s] ? (64 - __builtin_clzll(meas_set_evict[s])) : 0);
+		if (meas_set_fill[s])
+			touched++;
+	}
+
+	fprintf(fp, "TCM fills        %10lu\n", meas_fill);
+	fprintf(fp, "TCM path confl.  %10lu\n", meas_path_conflict);
+	fprintf(fp, "TCM multi-path   %10lu\n", meas_multi_path);
+	fprintf(fp, "TCM full hits    %10lu (avg. length %.2lf)\n", meas_full_hit, (meas_full_hit ? ((double)meas_full_len/(double)meas_full_hit) : 0.0));
+	fprintf(fp, "TCM partial hits %10lu (avg. length %.2lf)\n", meas_partial_hit, (meas_partial_hit ? ((double)meas_partial_len/(double)meas_partial_hit) : 0.0));
+	if (victim_entries)
+		fprintf(fp, "TCM victim buf.  %10lu hits, %lu traces inserted (%lu entries)\n", meas_victim_hit, meas_victim_insert, victim_entries);
+	if (filter)
+		fprintf(fp, "TCM ins. filter  %10lu traces not inserted (of %lu constructed)\n", meas_filtered, meas_filtered + meas_fill);
+	fprintf(fp, "TCM SETS (index function %u): %lu of %lu sets ever filled\n", TCM_INDEX, touched, sets);
+	fprintf(fp, "TCM set occupancy at exit (valid ways, # sets):\n");
+	occupancy.Print(fp);
+	fprintf(fp, "TCM set conflicts (b: 0 = none, else [2^(b-1), 2^b) traces replaced; # sets):\n");
+	conflicts.Print(fp);
+}
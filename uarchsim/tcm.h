@@ -1,6 +1,8 @@
 
 #include "btb.h"
+#include "payload.h"
 #define MAX_TCM_BUNDLE 16
+#define MAX_TCM_ASSOC 64
 
 
 // A TCM entry
@@ -9,10 +11,12 @@ struct {
    // Metadata for hit/miss determination and replacement.
    bool valid;
    uint64_t tag;
-   uint64_t lru;
+   uint64_t last_use;	// for LRU replacement: time of the last hit or fill
    uint64_t br_flags;
    uint64_t br_mask;
    uint64_t ends_in_br;
+   uint64_t promoted_mask;   // bit per slot: a promoted conditional branch (not in br_flags/br_mask, direction fixed)
+   uint64_t promoted_taken;  // bit per slot: the fixed direction of a promoted conditional branch
 
    // Payload.
    uint64_t tcm_bundle_length; //length of the trace cache bundle
@@ -20,19 +24,41 @@ struct {
    uint64_t fall_thru_pc; //equal to pc incremented by fetch bundle width BUG_FIX
 } tcm_entry_t;
 
+// A trace data entry: the instructions of the trace held by the TCM entry
+// at the same {set, way}, along with their decode-stage fields.
+typedef
+struct {
+   bool valid;                       // the trace was fetched without exceptions
+   insn_t insn[MAX_TCM_BUNDLE];      // instructions of the trace
+   predecode_t pre[MAX_TCM_BUNDLE];  // their decode-stage fields, derived when the trace is filled
+} tcm_data_t;
+
+
+// A trace victim buffer entry: a trace evicted from the TCM, with its trace data.
+typedef
+struct {
+   uint64_t pc;          // start pc of the trace (the TCM entry's tag need not hold all of it)
+   tcm_entry_t entry;    // entry.valid: the victim buffer entry is valid
+   tcm_data_t data;
+} tcm_victim_t;
+
 
 class tcm_t {
 private:
 	// The trace cache has 2 dimensions: number of sets and number of ways per set (associativity)
 	tcm_entry_t **tcm;
+	// Trace data array, alongside the TCM.
+	tcm_data_t **data;
 	uint64_t cond_branch_per_cycle;
 	uint64_t num_instr_per_cycle;
 	uint64_t sets;
 	uint64_t assoc;
 
 	uint64_t log2sets;  // number of pc bits that selects the set within a bank
+	uint64_t use_clock; // advances on every hit or fill, for LRU replacement
 
 	uint64_t pc_line_fill;
+	uint64_t bhr_line_fill;
 	uint64_t cb_predictions_line_fill;
 	uint64_t br_cntr_line_fill;
 	uint64_t cond_branch_line_fill; // "m": maximum number of conditional branches in the line fill.
@@ -42,6 +68,29 @@ private:
 	uint64_t tag_line_fill;
 	uint64_t line_fill_full; // assert when m branches or max instructions present in line fill, deassert when commit or rollback
 	tcm_entry_t line_fill_buffer_entry;
+	tcm_data_t line_fill_data;
+
+	// Trace victim buffer (TCM_VICTIM > 0), fully-associative with LRU replacement.
+	tcm_victim_t *victim;
+	uint64_t victim_entries;
+
+	// Insertion filter (TCM_FILTER > 1): # times each trace (hashed) was constructed since it was last inserted.
+	uint64_t *filter;
+	uint64_t filter_entries;
+
+	// Measurements.
+	uint64_t meas_fill;		// # traces written
+	uint64_t meas_path_conflict;	// # traces written over a different path from the same start pc
+	uint64_t meas_multi_path;	// # hits with more than one matching path to select from
+	uint64_t meas_full_hit;		// # hits delivering the whole trace
+	uint64_t meas_full_len;		// # instructions delivered by full hits
+	uint64_t meas_partial_hit;	// # hits delivering only the prefix of a trace (TCM_PARTIAL)
+	uint64_t meas_partial_len;	// # instructions delivered by partial hits
+	uint64_t meas_victim_hit;	// # hits supplied by the victim buffer
+	uint64_t meas_victim_insert;	// # traces moved into the victim buffer
+	uint64_t meas_filtered;		// # traces not inserted by the insertion filter
+	uint64_t *meas_set_fill;	// per set: # traces written
+	uint64_t *meas_set_evict;	// per set: # traces written over a valid trace (conflicts)
 
 	//line fill buffer checkpoint
 	uint64_t valid;
@@ -56,8 +105,19 @@ private:
 	// Comments are in tcm.cc.
 	////////////////////////////////////
 
-	bool search(uint64_t pc, uint64_t cb_predictions, uint64_t &set, uint64_t &way);
+	void set_index(uint64_t pc, uint64_t bhr, uint64_t index[]);
+	uint64_t fold(uint64_t x);
+	uint64_t tag_of(uint64_t pc);
+	uint64_t path_predictions(uint64_t cb_predictions);
+	bool search(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way);
+	bool search_paths(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way);
+	bool search_partial(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way, uint64_t &length, uint64_t &next_pc);
+	uint64_t fill_way(uint64_t index[], uint64_t tag, uint64_t br_flags, uint64_t br_mask);
 	void update_lru(uint64_t set, uint64_t way);
+	uint64_t pc_of(uint64_t set, uint64_t tag);
+	bool victim_search(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &set, uint64_t &way);
+	void victim_insert(uint64_t set, uint64_t way);
+	bool filter_insert(uint64_t pc, uint64_t br_flags, uint64_t br_mask);
 	//void checkpoint_line_fill();
 	
 
@@ -66,18 +126,36 @@ public:
 	~tcm_t();
 	// Search the TCM for a hit
 	// Inputs: pc: PC for the first instruction of the bundle
+	//         bhr: global branch history at the start of the bundle (for TCM_INDEX = 3)
 	//         cb_predictions: "m" predictions from branch predictor
 	// Outputs:returns true if TCM hit else returns false
+	//         (with TCM_PARTIAL, also if only a prefix of a trace agrees with cb_predictions: the bundle is
+	//         truncated after the first branch that diverges, and next_pc follows that branch's prediction)
 	// 	   tcm_bundle_length: length of the bundle
 	// 	   tcm_detch_bundle: the non sequential fetch bundle
 	// 	   next_pc: used as fall through pc for call direct and jump, call indirect and return
-	bool lookup(uint64_t pc, uint64_t cb_predictions, uint64_t &tcm_bundle_length, btb_output_t tcm_fetch_bundle[], uint64_t &tcm_next_pc);
+	// 	   tcm_data: the trace's instructions, or NULL if the trace data array cannot supply them
+	// 	   tcm_promoted_mask, tcm_promoted_taken: the trace's promoted conditional branches and their directions (bit per slot)
+	bool lookup(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t &tcm_bundle_length, btb_output_t tcm_fetch_bundle[], uint64_t &tcm_next_pc, tcm_data_t* &tcm_data,
+	            uint64_t &tcm_promoted_mask, uint64_t &tcm_promoted_taken);
 	// Called after btb is hit and fetch bundle is formed
-	void line_fill_buffer(uint64_t pc, uint64_t cb_predictions, uint64_t fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t next_pc);//TODO assert while filling line, last_pc == next_pc
+	// cb_predictions: one 2-bit counter per conditional branch of the bundle that is not promoted
+	// promoted_mask, promoted_taken: the bundle's promoted conditional branches and their directions (bit per slot)
+	// fetch_insn[]: the instructions fetched for the bundle (valid only if insn_valid)
+	void line_fill_buffer(uint64_t pc, uint64_t bhr, uint64_t cb_predictions, uint64_t promoted_mask, uint64_t promoted_taken,
+	                      uint64_t fetch_bundle_length, btb_output_t btb_fetch_bundle[], uint64_t next_pc, insn_t fetch_insn[], bool insn_valid);//TODO assert while filling line, last_pc == next_pc
 	// At btb_miss, clear the last entry pushed in line fill buffer
 	//void rollback_line_fill();
 	// At the end of a properly formed fetch bundle, 
 	// commit the last entry pushed in line fill buffer
 	void commit_line_fill();
 	void clear_line_fill();
+	// Invalidate the trace data array (e.g., at FENCE.I).  The TCM itself is kept.
+	void invalidate_data();
+	// Output trace cache measurements, including per-set occupancy and conflict histograms.
+	void output(FILE *fp);
+	// Save/restore the TCM, its trace data, victim buffer and insertion filter, for a checkpoint's warm state.
+	// restore_state() returns false, leaving the TCM as is, if the saved TCM has a different geometry or indexing.
+	void save_state(std::ostream &out);
+	bool restore_state(std::istream &in);
 };
@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sstream>
+
+#include "pipeline.h"
+#include "CacheClass.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Warm microarchitectural state, an optional section of a checkpoint.
+//
+// The section follows the register checkpoint:
+//   1. WARM_STATE_SIGNATURE
+//   2. Records, one per structure: its name (8 bytes, NUL-padded), the size
+//      of its contents (8 bytes), and its contents (the structure's
+//      save_state()).
+//   3. A record named "END", without contents.
+//
+// Each record is restored on its own: a record for a structure that is
+// absent, or that has a different geometry in this configuration, is
+// skipped, and that structure starts cold.
+//
+// Only state that outlives the instructions in flight is saved: cache
+// contents, predictor tables, the BTB, the TCM and its trace data, and the
+// memory dependence predictor.  Misses in flight, global histories, the RAS
+// and the branch queue are not.
+/////////////////////////////////////////////////////////////////////////////
+
+#define WARM_STATE_SIGNATURE	0xbeefbaaddeadbeefULL
+#define WARM_STATE_NAME_SIZE	8
+
+static void write_record(std::ostream& out, const char* name, const std::string& contents)
+{
+  char record_name[WARM_STATE_NAME_SIZE];
+  uint64_t size = contents.size();
+
+  memset(record_name, 0, sizeof(record_name));
+  strncpy(record_name, name, sizeof(record_name));
+  out.write(record_name, sizeof(record_name));
+  out.write((const char*)&size, sizeof(size));
+  out.write(contents.data(), size);
+}
+
+void pipeline_t::save_warm_state(std::ostream& out)
+{
+  uint64_t signature = WARM_STATE_SIGNATURE;
+  out.write((const char*)&signature, sizeof(signature));
+
+  std::ostringstream contents;
+
+  IC->save_state(contents);
+  write_record(out, "IC", contents.str());
+  contents.str("");
+
+  LSU.save_cache_state(contents);
+  write_record(out, "DC", contents.str());
+  contents.str("");
+
+  if (L2C) {
+    L2C->save_state(contents);
+    write_record(out, "L2", contents.str());
+    contents.str("");
+  }
+
+  BPU.save_state(contents);
+  write_record(out, "BPU", contents.str());
+  contents.str("");
+
+  BPU.save_btb_state(contents);
+  write_record(out, "BTB", contents.str());
+  contents.str("");
+
+  BPU.save_tcm_state(contents);
+  write_record(out, "TCM", contents.str());
+  contents.str("");
+
+  uint64_t entries = MDP.size();
+  contents.write((const char*)&entries, sizeof(entries));
+  for (std::map<uint64_t, bool>::iterator it = MDP.begin(); it != MDP.end(); it++) {
+    uint64_t pc = it->first;
+    uint8_t value = (it->second ? 1 : 0);
+    contents.write((const char*)&pc, sizeof(pc));
+    contents.write((const char*)&value, sizeof(value));
+  }
+  write_record(out, "MDP", contents.str());
+
+  write_record(out, "END", "");
+}
+
+void pipeline_t::restore_warm_state(std::istream& in)
+{
+  uint64_t signature;
+
+  // No warm state section: all structures start cold.
+  in.read((char*)&signature, sizeof(signature));
+  if (!in || (signature != WARM_STATE_SIGNATURE))
+    return;
+
+  while (true) {
+    char record_name[WARM_STATE_NAME_SIZE + 1];
+    uint64_t size;
+
+    memset(record_name, 0, sizeof(record_name));
+    in.read(record_name, WARM_STATE_NAME_SIZE);
+    in.read((char*)&size, sizeof(size));
+    if (!in) {
+      fprintf(stderr, "warning: warm state is truncated\n");
+      return;
+    }
+
+    std::string name(record_name);
+    if (name == "END")
+      break;
+
+    std::string contents(size, '\0');
+    in.read(&contents[0], size);
+    if (!in) {
+      fprintf(stderr, "warning: warm state is truncated\n");
+      return;
+    }
+    std::istringstream record(contents);
+
+    bool restored = false;
+    if (name == "IC")
+      restored = IC->restore_state(record);
+    else if (name == "DC")
+      restored = LSU.restore_cache_state(record);
+    else if ((name == "L2") && L2C)
+      restored = L2C->restore_state(record);
+    else if (name == "BPU")
+      restored = BPU.restore_state(record);
+    else if (name == "BTB")
+      restored = BPU.restore_btb_state(record);
+    else if (name == "TCM")
+      restored = BPU.restore_tcm_state(record);
+    else if (name == "MDP") {
+      uint64_t entries;
+      record.read((char*)&entries, sizeof(entries));
+      for (uint64_t i = 0; record && (i < entries); i++) {
+        uint64_t pc;
+        uint8_t value;
+        record.read((char*)&pc, sizeof(pc));
+        record.read((char*)&value, sizeof(value));
+        if (record)
+          MDP[pc] = (value != 0);
+      }
+      restored = (bool)record;
+    }
+
+    if (restored)
+      fprintf(stderr, "Restored warm state: %s\n", name.c_str());
+    else
+      fprintf(stderr, "warning: warm state: %s does not match this configuration; it starts cold\n", name.c_str());
+  }
+}